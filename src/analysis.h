@@ -0,0 +1,280 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "decode.h"
+#include "font.h"
+
+namespace Chip8 {
+    /// @brief what a program can do, worked out from its bytes before it runs. See analyze_program().
+    struct ProgramAnalysis {
+        /// @brief the bytes [start, end)
+        struct Range {
+            uint16_t start;
+            uint16_t end;
+        };
+
+        constexpr static size_t STACK_SIZE = 16;
+
+        /// addresses of reachable instructions
+        std::bitset<4096> instructions;
+        /// bytes that can be executed as part of an instruction
+        std::bitset<4096> code;
+        /// loaded bytes that are never executed: data, or dead code
+        std::vector<Range> unreachable;
+        /// reachable instructions that aren't valid
+        std::vector<uint16_t> unknown_opcodes;
+        /// reachable instructions that jump, call, or carry on outside of memory
+        std::vector<uint16_t> out_of_bounds;
+        /// the deepest the stack can get, or nullopt if a subroutine can call itself
+        std::optional<size_t> max_call_depth = 0;
+        /// 00ee can run with nothing on the stack
+        bool returns_from_main = false;
+        /// bnnn is reachable, so the control flow above may be missing paths
+        bool has_indirect_jumps = false;
+        /// fx33 or fx55 may write over reachable code, so the control flow above may not hold for long
+        bool may_modify_code = false;
+
+        /// @brief true if no reachable path can overflow or underflow the stack, or call outside of memory. The cores
+        /// skip those checks for programs like this.
+        bool is_stack_safe() const {
+            return this->max_call_depth.has_value() && this->max_call_depth.value() <= STACK_SIZE
+                && !this->returns_from_main && this->out_of_bounds.empty() && this->unknown_opcodes.empty()
+                && !this->has_indirect_jumps && !this->may_modify_code;
+        }
+
+        /// @brief one line per thing that can go wrong when the program runs: bad instructions, leaving memory, &
+        /// misusing the stack
+        std::vector<std::string> hazards() const {
+            std::vector<std::string> lines;
+            for (uint16_t address : this->unknown_opcodes)
+                lines.push_back(std::format("0x{:03x}: unknown instruction", address));
+            for (uint16_t address : this->out_of_bounds)
+                lines.push_back(std::format("0x{:03x}: leads outside of memory", address));
+            if (!this->max_call_depth.has_value())
+                lines.push_back("a subroutine can call itself, so the stack may overflow");
+            else if (this->max_call_depth.value() > STACK_SIZE)
+                lines.push_back(std::format("calls nest {} deep, but the stack only holds {}", this->max_call_depth.value(), STACK_SIZE));
+            if (this->returns_from_main)
+                lines.push_back("00ee can run with an empty stack");
+            return lines;
+        }
+
+        /// @brief hazards(), then the limits of the analysis & the bytes that never run. Most programs keep data
+        /// (sprites, tables) after their code, so the last is only worth reading alongside a disassembly.
+        std::vector<std::string> problems() const {
+            std::vector<std::string> lines = this->hazards();
+            if (this->has_indirect_jumps)
+                lines.push_back("bnnn jumps can't be followed, so some paths weren't checked");
+            if (this->may_modify_code)
+                lines.push_back("fx33/fx55 may overwrite code");
+            for (Range range : this->unreachable)
+                lines.push_back(std::format("0x{:03x}-0x{:03x}: never executed", range.start, range.end - 1));
+            return lines;
+        }
+    };
+
+    namespace Analysis {
+        constexpr static uint16_t PROGRAM_STARTING_ADDRESS = 0x200;
+        constexpr static uint16_t BUILT_IN_CHAR_STARTING_ADDRESS = 0x100;
+        constexpr static size_t MEMORY_SIZE = 4096;
+
+        /// @brief everything reachable from one subroutine's entry without following its calls
+        struct Function {
+            std::vector<uint16_t> callees;
+            bool returns = false;
+            // for finding recursion
+            enum class Mark : uint8_t { New, Visiting, Done } mark = Mark::New;
+            std::optional<size_t> depth;
+        };
+
+        class Walker {
+        private:
+            std::span<const uint8_t, MEMORY_SIZE> memory;
+            ProgramAnalysis& result;
+            std::unordered_map<uint16_t, Function> functions;
+
+            // what fx33 & fx55 could write over
+            std::vector<uint16_t> i_constants;
+            bool is_i_in_font = false;
+            bool is_i_unknown = false;
+            size_t max_write_size = 0;
+
+            void walk_function(uint16_t entry) {
+                Function function;
+                std::bitset<MEMORY_SIZE> visited;
+                std::vector<uint16_t> pending = { entry };
+
+                auto follow = [&](uint16_t from, size_t to){
+                    if (to > MEMORY_SIZE - 2)
+                        this->result.out_of_bounds.push_back(from);
+                    else if (!visited[to])
+                        pending.push_back((uint16_t)to);
+                };
+
+                while (!pending.empty()) {
+                    uint16_t address = pending.back();
+                    pending.pop_back();
+                    if (visited[address])
+                        continue;
+                    visited[address] = true;
+                    this->result.instructions[address] = true;
+                    this->result.code[address] = true;
+                    this->result.code[address + 1] = true;
+
+                    Instruction instruction = decode((this->memory[address] << 8) + this->memory[address + 1]);
+                    switch (instruction.opcode) {
+                        case Opcode::Unknown:
+                            this->result.unknown_opcodes.push_back(address);
+                            break;
+                        case Opcode::Ret:
+                            function.returns = true;
+                            break;
+                        case Opcode::Jp:
+                            follow(address, instruction.nnn());
+                            break;
+                        case Opcode::Call:
+                            if (instruction.nnn() > MEMORY_SIZE - 2) {
+                                this->result.out_of_bounds.push_back(address);
+                                break;
+                            }
+                            function.callees.push_back(instruction.nnn());
+                            // assume the subroutine comes back
+                            follow(address, address + 2);
+                            break;
+                        case Opcode::JumpReg0:
+                            this->result.has_indirect_jumps = true;
+                            break;
+                        case Opcode::LoadAddress:
+                            this->i_constants.push_back(instruction.nnn());
+                            follow(address, address + 2);
+                            break;
+                        case Opcode::LoadSprite:
+                            this->is_i_in_font = true;
+                            follow(address, address + 2);
+                            break;
+                        case Opcode::IncrementIReg:
+                            this->is_i_unknown = true;
+                            follow(address, address + 2);
+                            break;
+                        case Opcode::LoadBcd:
+                            this->max_write_size = std::max<size_t>(this->max_write_size, 3);
+                            follow(address, address + 2);
+                            break;
+                        case Opcode::LoadRegToMem:
+                            this->max_write_size = std::max<size_t>(this->max_write_size, instruction.x() + 1);
+                            follow(address, address + 2);
+                            break;
+                        default:
+                            follow(address, address + 2);
+                            if (is_skip(instruction.opcode))
+                                follow(address, address + 4);
+                            break;
+                    }
+                }
+
+                for (uint16_t callee : function.callees)
+                    if (!this->functions.contains(callee)) {
+                        // reserve the entry before walking, so that recursive calls don't walk it again
+                        this->functions[callee];
+                        this->walk_function(callee);
+                    }
+                this->functions[entry] = std::move(function);
+            }
+
+            /// @returns nullopt if `entry` can end up calling itself
+            std::optional<size_t> depth_of(uint16_t entry) {
+                Function& function = this->functions[entry];
+                if (function.mark == Function::Mark::Visiting)
+                    return std::nullopt;
+                else if (function.mark == Function::Mark::Done)
+                    return function.depth;
+
+                function.mark = Function::Mark::Visiting;
+                std::optional<size_t> depth = 0;
+                for (uint16_t callee : function.callees) {
+                    auto callee_depth = this->depth_of(callee);
+                    if (!callee_depth.has_value()) {
+                        depth = std::nullopt;
+                        break;
+                    }
+                    depth = std::max(depth.value(), callee_depth.value() + 1);
+                }
+
+                function.mark = Function::Mark::Done;
+                function.depth = depth;
+                return depth;
+            }
+
+            bool can_write_over_code() const {
+                if (this->max_write_size == 0)
+                    return false;
+                else if (this->is_i_unknown)
+                    return true;
+
+                auto overlaps_code = [this](size_t start, size_t end){
+                    for (size_t address = start; address < std::min(end, MEMORY_SIZE); address++)
+                        if (this->result.code[address])
+                            return true;
+                    return false;
+                };
+                if (this->is_i_in_font
+                    && overlaps_code(BUILT_IN_CHAR_STARTING_ADDRESS, BUILT_IN_CHAR_STARTING_ADDRESS + 16 * BUILT_IN_CHAR_SIZE + this->max_write_size))
+                    return true;
+                return std::ranges::any_of(this->i_constants, [&](uint16_t start){
+                    return overlaps_code(start, start + this->max_write_size);
+                });
+            }
+
+        public:
+            Walker(std::span<const uint8_t, MEMORY_SIZE> memory, ProgramAnalysis& result) : memory(memory), result(result) {}
+
+            void run(size_t program_size) {
+                this->functions[PROGRAM_STARTING_ADDRESS];
+                this->walk_function(PROGRAM_STARTING_ADDRESS);
+
+                this->result.max_call_depth = this->depth_of(PROGRAM_STARTING_ADDRESS);
+                this->result.returns_from_main = this->functions[PROGRAM_STARTING_ADDRESS].returns;
+                this->result.may_modify_code = this->can_write_over_code();
+
+                for (auto* addresses : { &this->result.unknown_opcodes, &this->result.out_of_bounds }) {
+                    std::ranges::sort(*addresses);
+                    auto duplicates = std::ranges::unique(*addresses);
+                    addresses->erase(duplicates.begin(), duplicates.end());
+                }
+
+                size_t end = std::min(PROGRAM_STARTING_ADDRESS + program_size, MEMORY_SIZE);
+                for (size_t address = PROGRAM_STARTING_ADDRESS; address < end; address++) {
+                    if (this->result.code[address])
+                        continue;
+                    auto& ranges = this->result.unreachable;
+                    if (!ranges.empty() && ranges.back().end == address)
+                        ranges.back().end += 1;
+                    else
+                        ranges.push_back(ProgramAnalysis::Range{ (uint16_t)address, (uint16_t)(address + 1) });
+                }
+            }
+        };
+    }
+
+    /// @brief walks the control flow of the program loaded into `memory` from 0x200, one subroutine at a time, &
+    /// works out where it can go. Conditional skips are assumed to go both ways & subroutines are assumed to return;
+    /// bnnn targets aren't followed.
+    /// @param program_size how many bytes were loaded at 0x200, for finding the ones that never run
+    inline ProgramAnalysis analyze_program(std::span<const uint8_t, 4096> memory, size_t program_size) {
+        ProgramAnalysis result;
+        Analysis::Walker(memory, result).run(program_size);
+        return result;
+    }
+}
+
+#endif
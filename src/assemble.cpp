@@ -0,0 +1,75 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include "assembler.h"
+
+const char* USAGE = (
+    "usage: chip8-asm <source> [options]\n"
+    "options:\n"
+    "  -o <path>       write the program to <path>: .chip8 as text, anything else as a raw image. Defaults to text on stdout\n"
+    "  --map <path>    write the address of each statement & the source line it came from\n"
+);
+
+bool write_file(const std::filesystem::path& path, const std::string& contents) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(contents.data(), contents.size());
+    return (bool)file;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cout << "ERROR: expected a path to an assembly file\n" << USAGE << std::endl;
+        exit(1);
+    }
+
+    std::filesystem::path source_path(argv[1]);
+    std::filesystem::path output_path;
+    std::filesystem::path map_path;
+    for (int arg_i = 2; arg_i < argc; arg_i++) {
+        std::string option(argv[arg_i]);
+        bool has_value = arg_i + 1 < argc;
+        if (option == "-o" && has_value) {
+            output_path = argv[++arg_i];
+        } else if (option == "--map" && has_value) {
+            map_path = argv[++arg_i];
+        } else {
+            std::cout << "ERROR: unknown option " << option << "\n" << USAGE << std::endl;
+            exit(1);
+        }
+    }
+
+    std::ifstream source_file(source_path, std::ios::binary);
+    if (!source_file) {
+        std::cerr << "ERROR: can't read " << source_path.string() << std::endl;
+        exit(1);
+    }
+    std::string source((std::istreambuf_iterator<char>(source_file)), std::istreambuf_iterator<char>());
+
+    Chip8::Assembly assembly = Chip8::assemble(source);
+    if (!assembly.ok()) {
+        for (const std::string& error : assembly.errors)
+            std::cerr << source_path.string() << ": " << error << std::endl;
+        exit(1);
+    }
+
+    if (output_path.empty()) {
+        std::cout << assembly.to_text();
+    } else {
+        std::string contents = (output_path.extension() == ".chip8")
+            ? assembly.to_text()
+            : std::string(assembly.bytes.begin(), assembly.bytes.end());
+        if (!write_file(output_path, contents)) {
+            std::cerr << "ERROR: can't write " << output_path.string() << std::endl;
+            exit(1);
+        }
+    }
+
+    if (!map_path.empty() && !write_file(map_path, assembly.line_map_text())) {
+        std::cerr << "ERROR: can't write " << map_path.string() << std::endl;
+        exit(1);
+    }
+    return 0;
+}
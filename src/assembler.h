@@ -0,0 +1,417 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cstdint>
+#include <format>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Chip8 {
+    /// @brief a program assembled by assemble(), ready to load at 0x200
+    struct Assembly {
+        /// @brief the bytes [address, address + size) came from `line` of the source
+        struct LineMapping {
+            uint16_t address;
+            uint16_t size;
+            size_t line;
+            std::string statement;
+        };
+
+        constexpr static uint16_t PROGRAM_STARTING_ADDRESS = 0x200;
+
+        std::vector<uint8_t> bytes;
+        std::vector<LineMapping> line_map;
+        std::map<std::string, uint16_t, std::less<>> labels;
+        /// one per problem, as "line N: what". Nothing else is meaningful unless this is empty.
+        std::vector<std::string> errors;
+
+        bool ok() const {
+            return this->errors.empty();
+        }
+
+        /// @brief the .chip8 text format, one word per line with the statement it came from as a comment. Labels are
+        /// marked with the address they stand for, like the hand-written programs: `// 0x21a: loop`
+        std::string to_text() const {
+            std::multimap<uint16_t, std::string_view> labels_at;
+            for (const auto& [name, address] : this->labels)
+                labels_at.emplace(address, name);
+
+            std::string text;
+            auto mapping = this->line_map.begin();
+            for (size_t offset = 0; offset < this->bytes.size(); offset += 2) {
+                uint16_t address = (uint16_t)(PROGRAM_STARTING_ADDRESS + offset);
+                auto [first, last] = labels_at.equal_range(address);
+                for (auto label = first; label != last; label++)
+                    text += std::format("// 0x{:03x}: {}\n", address, label->second);
+
+                uint16_t word = (this->bytes[offset] << 8) + this->bytes[offset + 1];
+                while (mapping != this->line_map.end() && mapping->address + mapping->size <= address)
+                    mapping++;
+                if (mapping != this->line_map.end() && mapping->address == address)
+                    text += std::format("0x{:04x} // {}\n", word, mapping->statement);
+                else
+                    text += std::format("0x{:04x}\n", word);
+            }
+            return text;
+        }
+
+        /// @brief one "address line" pair per statement, for tools that map the program counter back to the source
+        std::string line_map_text() const {
+            std::string text;
+            for (const LineMapping& mapping : this->line_map)
+                text += std::format("0x{:03x} {}\n", mapping.address, mapping.line);
+            return text;
+        }
+    };
+
+    namespace Assembler {
+        constexpr static size_t MAX_PROGRAM_SIZE = 4096 - Assembly::PROGRAM_STARTING_ADDRESS;
+
+        struct Operand {
+            enum class Kind : uint8_t {
+                Register,
+                /// a number, or a label resolved once the whole source has been read
+                Value,
+                I, IndirectI, DelayTimer, SoundTimer, Key, Font, Bcd,
+            };
+
+            Kind kind;
+            uint8_t reg = 0;
+            long value = 0;
+            std::string label = {};
+        };
+
+        /// @brief a field to fill in once `label` is known
+        struct Fixup {
+            size_t offset;
+            // 0x0fff for nnn fields, 0x00ff for kk fields & DB, 0xffff for DW
+            uint16_t field_mask;
+            std::string label;
+            long addend;
+            size_t line;
+            // a DB byte, rather than a field of a word
+            bool is_byte = false;
+        };
+
+        inline std::string_view trim(std::string_view text) {
+            size_t start = text.find_first_not_of(" \t\r\n\v\f");
+            if (start == std::string_view::npos)
+                return {};
+            size_t end = text.find_last_not_of(" \t\r\n\v\f");
+            return text.substr(start, end - start + 1);
+        }
+
+        inline bool is_identifier(std::string_view text) {
+            if (text.empty() || std::isdigit((unsigned char)text[0]))
+                return false;
+            return std::ranges::all_of(text, [](char c){ return std::isalnum((unsigned char)c) || c == '_' || c == '.'; });
+        }
+
+        inline std::string upper(std::string_view text) {
+            std::string result(text);
+            for (char& c : result)
+                c = (char)std::toupper((unsigned char)c);
+            return result;
+        }
+
+        class Parser {
+        private:
+            Assembly& result;
+            std::vector<Fixup> fixups;
+            size_t line = 0;
+
+            void error(std::string_view what) {
+                this->result.errors.push_back(std::format("line {}: {}", this->line, what));
+            }
+
+            /// @returns nullopt, having reported why, if `text` isn't an operand
+            std::optional<Operand> parse_operand(std::string_view text) {
+                std::string name = upper(text);
+                if (name.size() == 2 && name[0] == 'V' && std::isxdigit((unsigned char)name[1]))
+                    return Operand{ Operand::Kind::Register, (uint8_t)std::stoul(name.substr(1), nullptr, 16) };
+                else if (name == "I")
+                    return Operand{ Operand::Kind::I };
+                else if (name == "[I]")
+                    return Operand{ Operand::Kind::IndirectI };
+                else if (name == "DT")
+                    return Operand{ Operand::Kind::DelayTimer };
+                else if (name == "ST")
+                    return Operand{ Operand::Kind::SoundTimer };
+                else if (name == "K")
+                    return Operand{ Operand::Kind::Key };
+                else if (name == "F")
+                    return Operand{ Operand::Kind::Font };
+                else if (name == "B")
+                    return Operand{ Operand::Kind::Bcd };
+
+                // label, label+n, label-n, or n
+                Operand operand{ Operand::Kind::Value };
+                size_t sign = text.find_first_of("+-", 1);
+                std::string_view base = trim(text.substr(0, sign));
+                if (is_identifier(base)) {
+                    operand.label = std::string(base);
+                    if (sign == std::string_view::npos)
+                        return operand;
+                    text = text.substr(sign);
+                }
+
+                std::string number;
+                std::ranges::copy_if(text, std::back_inserter(number), [](char c){ return !std::isspace((unsigned char)c); });
+                size_t length = 0;
+                try {
+                    operand.value = std::stol(number, &length, 0);
+                } catch (const std::exception&) {
+                    length = 0;
+                }
+                if (number.empty() || length != number.size()) {
+                    this->error(std::format("expected a register, number or label, got '{}'", text));
+                    return std::nullopt;
+                }
+                return operand;
+            }
+
+            void emit_byte(uint8_t byte) {
+                this->result.bytes.push_back(byte);
+            }
+
+            void emit_word(uint16_t word) {
+                this->emit_byte(word >> 8);
+                this->emit_byte(word & 0x00ff);
+            }
+
+            /// @brief emits `word` with `value` or'd into the bits of `field_mask`, now or once its label is known
+            void emit_with_value(uint16_t word, uint16_t field_mask, const Operand& value) {
+                size_t offset = this->result.bytes.size();
+                this->emit_word(word);
+                if (!value.label.empty())
+                    this->fixups.push_back(Fixup{ offset, field_mask, value.label, value.value, this->line });
+                else
+                    this->patch(offset, field_mask, value.value);
+            }
+
+            void patch(size_t offset, uint16_t field_mask, long value, bool is_byte = false) {
+                if (value < 0 || value > field_mask) {
+                    this->error(std::format("{} doesn't fit in {} bits", value, std::popcount(field_mask)));
+                    return;
+                } else if (is_byte) {
+                    this->result.bytes[offset] = (uint8_t)value;
+                    return;
+                }
+
+                uint16_t word = (this->result.bytes[offset] << 8) + this->result.bytes[offset + 1];
+                word |= (uint16_t)value & field_mask;
+                this->result.bytes[offset] = word >> 8;
+                this->result.bytes[offset + 1] = word & 0x00ff;
+            }
+
+            void emit_data(const std::string& directive, const std::vector<std::string_view>& arguments) {
+                for (std::string_view argument : arguments) {
+                    auto value = this->parse_operand(argument);
+                    if (!value.has_value())
+                        continue;
+                    else if (value->kind != Operand::Kind::Value)
+                        return this->error(std::format("{} takes numbers or labels", directive));
+
+                    size_t offset = this->result.bytes.size();
+                    if (directive == "DW") {
+                        this->emit_with_value(0, 0xffff, value.value());
+                        continue;
+                    }
+
+                    this->emit_byte(0);
+                    if (!value->label.empty())
+                        this->fixups.push_back(Fixup{ offset, 0x00ff, value->label, value->value, this->line, true });
+                    else
+                        this->patch(offset, 0x00ff, value->value, true);
+                }
+                // the .chip8 text format holds whole words, so keep instructions after data aligned
+                if (this->result.bytes.size() % 2 != 0)
+                    this->emit_byte(0);
+            }
+
+            void emit_instruction(const std::string& mnemonic, const std::vector<Operand>& operands) {
+                using Kind = Operand::Kind;
+                auto is = [&operands](std::initializer_list<Kind> kinds){
+                    return std::ranges::equal(operands, kinds, {}, &Operand::kind);
+                };
+                auto x = [&operands](size_t i){ return (uint16_t)(operands[i].reg << 8); };
+                auto y = [&operands](size_t i){ return (uint16_t)(operands[i].reg << 4); };
+
+                if (mnemonic == "CLS" && is({}))
+                    return this->emit_word(0x00e0);
+                else if (mnemonic == "RET" && is({}))
+                    return this->emit_word(0x00ee);
+                else if (mnemonic == "SYS" && is({ Kind::Value }))
+                    return this->emit_with_value(0x0000, 0x0fff, operands[0]);
+                else if (mnemonic == "JP" && is({ Kind::Value }))
+                    return this->emit_with_value(0x1000, 0x0fff, operands[0]);
+                else if (mnemonic == "JP" && is({ Kind::Register, Kind::Value }) && operands[0].reg == 0)
+                    return this->emit_with_value(0xb000, 0x0fff, operands[1]);
+                else if (mnemonic == "CALL" && is({ Kind::Value }))
+                    return this->emit_with_value(0x2000, 0x0fff, operands[0]);
+                else if (mnemonic == "SE" && is({ Kind::Register, Kind::Value }))
+                    return this->emit_with_value(0x3000 | x(0), 0x00ff, operands[1]);
+                else if (mnemonic == "SNE" && is({ Kind::Register, Kind::Value }))
+                    return this->emit_with_value(0x4000 | x(0), 0x00ff, operands[1]);
+                else if (mnemonic == "SE" && is({ Kind::Register, Kind::Register }))
+                    return this->emit_word(0x5000 | x(0) | y(1));
+                else if (mnemonic == "SNE" && is({ Kind::Register, Kind::Register }))
+                    return this->emit_word(0x9000 | x(0) | y(1));
+                else if (mnemonic == "ADD" && is({ Kind::Register, Kind::Value }))
+                    return this->emit_with_value(0x7000 | x(0), 0x00ff, operands[1]);
+                else if (mnemonic == "ADD" && is({ Kind::Register, Kind::Register }))
+                    return this->emit_word(0x8004 | x(0) | y(1));
+                else if (mnemonic == "ADD" && is({ Kind::I, Kind::Register }))
+                    return this->emit_word(0xf01e | x(1));
+                else if (mnemonic == "RND" && is({ Kind::Register, Kind::Value }))
+                    return this->emit_with_value(0xc000 | x(0), 0x00ff, operands[1]);
+                else if (mnemonic == "DRW" && is({ Kind::Register, Kind::Register, Kind::Value }))
+                    return this->emit_with_value(0xd000 | x(0) | y(1), 0x000f, operands[2]);
+                else if (mnemonic == "SKP" && is({ Kind::Register }))
+                    return this->emit_word(0xe09e | x(0));
+                else if (mnemonic == "SKNP" && is({ Kind::Register }))
+                    return this->emit_word(0xe0a1 | x(0));
+                else if (mnemonic == "SHR" && (is({ Kind::Register }) || is({ Kind::Register, Kind::Register })))
+                    return this->emit_word(0x8006 | x(0) | (operands.size() > 1 ? y(1) : 0));
+                else if (mnemonic == "SHL" && (is({ Kind::Register }) || is({ Kind::Register, Kind::Register })))
+                    return this->emit_word(0x800e | x(0) | (operands.size() > 1 ? y(1) : 0));
+
+                constexpr std::array<std::pair<std::string_view, uint16_t>, 5> ALU = {{
+                    { "OR", 0x8001 }, { "AND", 0x8002 }, { "XOR", 0x8003 }, { "SUB", 0x8005 }, { "SUBN", 0x8007 },
+                }};
+                for (auto [name, word] : ALU)
+                    if (mnemonic == name && is({ Kind::Register, Kind::Register }))
+                        return this->emit_word(word | x(0) | y(1));
+
+                if (mnemonic == "LD") {
+                    if (is({ Kind::Register, Kind::Value }))
+                        return this->emit_with_value(0x6000 | x(0), 0x00ff, operands[1]);
+                    else if (is({ Kind::Register, Kind::Register }))
+                        return this->emit_word(0x8000 | x(0) | y(1));
+                    else if (is({ Kind::I, Kind::Value }))
+                        return this->emit_with_value(0xa000, 0x0fff, operands[1]);
+                    else if (is({ Kind::Register, Kind::DelayTimer }))
+                        return this->emit_word(0xf007 | x(0));
+                    else if (is({ Kind::Register, Kind::Key }))
+                        return this->emit_word(0xf00a | x(0));
+                    else if (is({ Kind::DelayTimer, Kind::Register }))
+                        return this->emit_word(0xf015 | x(1));
+                    else if (is({ Kind::SoundTimer, Kind::Register }))
+                        return this->emit_word(0xf018 | x(1));
+                    else if (is({ Kind::Font, Kind::Register }))
+                        return this->emit_word(0xf029 | x(1));
+                    else if (is({ Kind::Bcd, Kind::Register }))
+                        return this->emit_word(0xf033 | x(1));
+                    else if (is({ Kind::IndirectI, Kind::Register }))
+                        return this->emit_word(0xf055 | x(1));
+                    else if (is({ Kind::Register, Kind::IndirectI }))
+                        return this->emit_word(0xf065 | x(0));
+                }
+
+                this->error(std::format("no form of {} takes these operands", mnemonic));
+            }
+
+            void statement(std::string_view text) {
+                size_t colon = text.find(':');
+                if (colon != std::string_view::npos && is_identifier(trim(text.substr(0, colon)))) {
+                    std::string label(trim(text.substr(0, colon)));
+                    if (this->parse_operand(label)->kind != Operand::Kind::Value)
+                        this->error(std::format("'{}' is reserved, & can't be a label", label));
+                    else if (!this->result.labels.emplace(label, Assembly::PROGRAM_STARTING_ADDRESS + this->result.bytes.size()).second)
+                        this->error(std::format("'{}' is already defined", label));
+                    text = trim(text.substr(colon + 1));
+                    if (text.empty())
+                        return;
+                }
+
+                size_t mnemonic_end = text.find_first_of(" \t");
+                std::string mnemonic = upper(text.substr(0, mnemonic_end));
+                std::vector<std::string_view> arguments;
+                if (mnemonic_end != std::string_view::npos) {
+                    std::string_view rest = text.substr(mnemonic_end);
+                    while (true) {
+                        size_t comma = rest.find(',');
+                        arguments.push_back(trim(rest.substr(0, comma)));
+                        if (comma == std::string_view::npos)
+                            break;
+                        rest = rest.substr(comma + 1);
+                    }
+                }
+
+                size_t start = this->result.bytes.size();
+                if (mnemonic == "DB" || mnemonic == "DW") {
+                    this->emit_data(mnemonic, arguments);
+                } else {
+                    std::vector<Operand> operands;
+                    for (std::string_view argument : arguments) {
+                        auto operand = this->parse_operand(argument);
+                        if (!operand.has_value())
+                            return;
+                        operands.push_back(std::move(operand.value()));
+                    }
+                    this->emit_instruction(mnemonic, operands);
+                }
+
+                if (this->result.bytes.size() > start)
+                    this->result.line_map.push_back(Assembly::LineMapping{
+                        (uint16_t)(Assembly::PROGRAM_STARTING_ADDRESS + start),
+                        (uint16_t)(this->result.bytes.size() - start),
+                        this->line, std::string(text)
+                    });
+            }
+
+        public:
+            Parser(Assembly& result) : result(result) {}
+
+            void run(std::string_view source) {
+                while (!source.empty()) {
+                    this->line += 1;
+                    size_t end = source.find('\n');
+                    std::string_view text = source.substr(0, end);
+                    source = (end == std::string_view::npos) ? std::string_view() : source.substr(end + 1);
+
+                    size_t comment = std::min(text.find(';'), text.find("//"));
+                    text = trim(text.substr(0, comment));
+                    if (!text.empty())
+                        this->statement(text);
+                }
+
+                if (this->result.bytes.size() > MAX_PROGRAM_SIZE)
+                    this->result.errors.push_back(std::format(
+                        "program is {} bytes, but only {} fit in memory", this->result.bytes.size(), MAX_PROGRAM_SIZE
+                    ));
+
+                // one pass is enough for everything but forward references, which are patched in here
+                for (const Fixup& fixup : this->fixups) {
+                    this->line = fixup.line;
+                    auto label = this->result.labels.find(fixup.label);
+                    if (label == this->result.labels.end())
+                        this->error(std::format("'{}' is never defined", fixup.label));
+                    else
+                        this->patch(fixup.offset, fixup.field_mask, label->second + fixup.addend, fixup.is_byte);
+                }
+            }
+        };
+    }
+
+    /// @brief assembles Cowgod-style mnemonics (the same ones the disassembler prints) into a program for 0x200.
+    ///
+    /// One statement per line, optionally after a `label:`. Comments start with ; or //. Operands are registers
+    /// (v0-vf), I, [I], DT, ST, K, F, B, numbers (decimal, 0x hex or 0 octal), or labels with an optional +/- offset.
+    /// DB & DW emit bytes & big endian words; DB pads to a whole word so that code after it stays aligned.
+    inline Assembly assemble(std::string_view source) {
+        Assembly result;
+        Assembler::Parser(result).run(source);
+        return result;
+    }
+}
+
+#endif
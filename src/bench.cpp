@@ -0,0 +1,129 @@
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_main.h> // redefines main for portability reasons
+
+#include "gym.h"
+#include "lockstep.h"
+#include "program_file.h"
+#include "scheduler.h"
+
+const char* USAGE = (
+    "usage: chip8-bench <.chip8/.ch8 file> [options]\n"
+    "runs many copies of a program without a window & reports how fast each engine gets through them\n"
+    "options:\n"
+    "  --frames <n>    guest frames to run every copy for. Defaults to 3600 (a minute of guest time)\n"
+    "  --workers <n>   threads for the scheduler & gym environment. Defaults to 1, to compare against the single lock-step thread\n"
+);
+
+// one AVX2 register of byte lanes
+constexpr size_t LANES = 32;
+
+using Clock = std::chrono::steady_clock;
+
+void report(const std::string& engine, size_t copies, size_t frames, Clock::duration took) {
+    double seconds = std::chrono::duration<double>(took).count();
+    std::cout << engine << ": " << copies << " copies x " << frames << " frames in " << seconds << "s, "
+        << (double)(copies * frames) / seconds << " frames/s" << std::endl;
+}
+
+void bench_lockstep(const std::vector<uint8_t>& program, size_t frames) {
+    // too big for the stack
+    auto engine = std::make_unique<Chip8::LockstepEngine<LANES>>();
+    engine->load_program_bytes(program);
+
+    auto start = Clock::now();
+    for (size_t frame_i = 0; frame_i < frames; frame_i++)
+        engine->run_frame();
+    report("lockstep", LANES, frames, Clock::now() - start);
+    std::cout << "  " << engine->average_group_size() << " lanes per instruction on average" << std::endl;
+}
+
+void bench_scheduler(const std::vector<uint8_t>& program, size_t frames, size_t workers) {
+    Chip8::Scheduler scheduler(workers);
+    for (size_t copy_i = 0; copy_i < LANES; copy_i++) {
+        auto id = scheduler.add_session(program);
+        scheduler.core(id).seed(copy_i + 1);
+    }
+
+    auto start = Clock::now();
+    scheduler.run_frames(frames);
+    report("scheduler", LANES, frames, Clock::now() - start);
+}
+
+void bench_gym(const std::vector<uint8_t>& program, size_t frames, size_t workers) {
+    constexpr size_t FRAMES_PER_STEP = 4;
+    Chip8::BatchEnv env(program, LANES, [](const auto&){ return Chip8::ProbeResult{}; }, FRAMES_PER_STEP, workers);
+
+    std::vector<uint64_t> seeds(LANES);
+    for (size_t lane = 0; lane < LANES; lane++)
+        seeds[lane] = lane + 1;
+    env.reset(seeds);
+
+    // a random policy, so that programs waiting on input still get somewhere
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<uint16_t> action_dist(0, 0xffff);
+    std::vector<uint16_t> actions(LANES);
+    size_t resets = 0;
+
+    auto start = Clock::now();
+    size_t steps = frames / FRAMES_PER_STEP;
+    for (size_t step_i = 0; step_i < steps; step_i++) {
+        for (auto& action : actions)
+            action = action_dist(rng);
+
+        auto result = env.step(actions);
+        for (size_t lane = 0; lane < LANES; lane++) {
+            if (result.done[lane]) {
+                env.reset_lane(lane, rng());
+                resets++;
+            }
+        }
+    }
+    report("gym", LANES, steps * FRAMES_PER_STEP, Clock::now() - start);
+    std::cout << "  " << resets << " lanes reset after finishing" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cout << "ERROR: expected a path to a .chip8 or .ch8 file\n" << USAGE << std::endl;
+        exit(1);
+    }
+
+    size_t frames = 3600;
+    size_t workers = 1;
+    try {
+        for (int arg_i = 2; arg_i < argc; arg_i++) {
+            std::string option(argv[arg_i]);
+            bool has_value = arg_i + 1 < argc;
+            if (option == "--frames" && has_value) {
+                frames = std::stoul(argv[++arg_i]);
+            } else if (option == "--workers" && has_value) {
+                workers = std::max<size_t>(std::stoul(argv[++arg_i]), 1);
+            } else {
+                std::cout << "ERROR: unknown option " << option << "\n" << USAGE << std::endl;
+                exit(1);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cout << "ERROR: " << e.what() << std::endl;
+        exit(1);
+    }
+
+    auto program = Chip8::read_program_file(argv[1]);
+    if (!program.has_value()) {
+        std::cout << "ERROR: can't read " << argv[1] << std::endl;
+        exit(1);
+    }
+
+    bench_lockstep(program.value(), frames);
+    bench_scheduler(program.value(), frames, workers);
+    bench_gym(program.value(), frames, workers);
+    return 0;
+}
@@ -0,0 +1,251 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <format>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "geblib.h"
+#include "framebuffer.h"
+
+namespace Chip8 {
+    /// @brief records presented frames to a file or pipe at 60 frames per second. Frames are handed over by the
+    /// presenting thread & expanded and written by a background thread. If the writer falls behind, frames are
+    /// dropped (and counted) rather than blocking the emulator.
+    class VideoCapture : public FrameSink {
+    public:
+        /// @brief how presents map onto the 60fps output
+        enum class Timing {
+            /// each present is one output frame. For headless cores, which present once per guest frame.
+            EveryPresent,
+            /// the latest presented frame is written once per 60hz tick of the wall clock, however many presents
+            /// happened since the last tick. For interactive cores, which present on every draw.
+            WallClock,
+        };
+
+        enum class Format {
+            /// YUV4MPEG2 with a single luma plane, playable by ffmpeg & mpv
+            Y4M,
+            /// 8-bit grayscale, frame after frame with no headers
+            RawGray,
+            /// 24-bit rgb, frame after frame with no headers
+            RawRGB,
+        };
+
+        // the same shades Display uses
+        constexpr static uint8_t PIXEL_ON = 255;
+        constexpr static uint8_t PIXEL_OFF = 25;
+
+    private:
+        using Frame = std::array<uint64_t, SCREEN_HEIGHT>;
+
+        // ticks the wall clock writer may fall behind by before it gives up on them
+        constexpr static size_t MAX_LATE_TICKS = 4;
+
+        const Format format;
+        const Timing timing;
+        // each chip8 pixel becomes a scale x scale square
+        const size_t scale;
+
+        std::FILE* output = nullptr;
+        bool owns_output = false;
+
+        // EveryPresent
+        GebLib::Threading::SpscQueue<Frame> queue;
+
+        // WallClock: only the newest frame is kept, & sampled by the writer
+        std::mutex latest_lock;
+        std::condition_variable latest_changed;
+        Frame latest_frame = {};
+        bool is_closed = false;
+
+        std::atomic<size_t> frames_written = 0;
+        std::atomic<size_t> frames_dropped = 0;
+        // set if the output stops accepting writes (eg. a closed pipe). Later frames are dropped.
+        std::atomic<bool> has_failed = false;
+
+        // declared last so that it is joined before anything it touches is destroyed
+        std::jthread writer_thread;
+
+        size_t width() const {
+            return SCREEN_WIDTH * this->scale;
+        }
+
+        size_t height() const {
+            return SCREEN_HEIGHT * this->scale;
+        }
+
+        bool write(const void* data, size_t size) {
+            return std::fwrite(data, 1, size, this->output) == size;
+        }
+
+        /// @brief expands one output row per chip8 row, then repeats it for the vertical scale
+        void expand(const Frame& frame, std::vector<uint8_t>& image) const {
+            size_t channels = (this->format == Format::RawRGB) ? 3 : 1;
+            size_t row_size = this->width() * channels;
+            for (size_t y = 0; y < SCREEN_HEIGHT; y++) {
+                uint8_t* out_row = image.data() + y * this->scale * row_size;
+                uint64_t row = frame[y];
+                for (size_t x = 0; x < SCREEN_WIDTH; x++) {
+                    uint8_t shade = ((row >> (SCREEN_WIDTH - 1 - x)) & 1) ? PIXEL_ON : PIXEL_OFF;
+                    std::fill_n(out_row + x * this->scale * channels, this->scale * channels, shade);
+                }
+                for (size_t copy_i = 1; copy_i < this->scale; copy_i++)
+                    std::copy_n(out_row, row_size, out_row + copy_i * row_size);
+            }
+        }
+
+        void write_frame(const Frame& frame, std::vector<uint8_t>& image) {
+            if (this->has_failed) {
+                this->frames_dropped += 1;
+                return;
+            }
+
+            this->expand(frame, image);
+            bool ok = (this->format != Format::Y4M || this->write("FRAME\n", 6))
+                && this->write(image.data(), image.size());
+            if (ok) {
+                this->frames_written += 1;
+            } else {
+                this->has_failed = true;
+                this->frames_dropped += 1;
+            }
+        }
+
+        void write_frames() {
+            size_t channels = (this->format == Format::RawRGB) ? 3 : 1;
+            std::vector<uint8_t> image(this->width() * this->height() * channels);
+
+            while (auto frame = this->queue.wait_pop())
+                this->write_frame(frame.value(), image);
+
+            std::fflush(this->output);
+        }
+
+        void sample_frames() {
+            using Clock = std::chrono::steady_clock;
+            constexpr auto TICK = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / 60.0));
+
+            size_t channels = (this->format == Format::RawRGB) ? 3 : 1;
+            std::vector<uint8_t> image(this->width() * this->height() * channels);
+            auto next_tick = Clock::now();
+
+            while (true) {
+                Frame frame;
+                {
+                    std::unique_lock lock(this->latest_lock);
+                    if (this->latest_changed.wait_until(lock, next_tick, [this](){ return this->is_closed; }))
+                        break;
+                    frame = this->latest_frame;
+                }
+
+                this->write_frame(frame, image);
+                next_tick += TICK;
+
+                // a slow output loses ticks rather than writing a backlog of stale frames
+                auto now = Clock::now();
+                if (now - next_tick > MAX_LATE_TICKS * TICK) {
+                    size_t late_ticks = (size_t)((now - next_tick) / TICK);
+                    this->frames_dropped += late_ticks;
+                    next_tick += late_ticks * TICK;
+                }
+            }
+
+            std::fflush(this->output);
+        }
+
+    public:
+        /// @param path a file to (over)write, or "-" for stdout, which nothing else may then write to
+        /// @param queue_capacity with Timing::EveryPresent, frames that may wait for the writer before new ones are
+        /// dropped
+        VideoCapture(
+            const std::string& path, Format format, Timing timing = Timing::EveryPresent, size_t scale = 4,
+            size_t queue_capacity = 120
+        ) :
+            format(format), timing(timing), scale(std::max<size_t>(scale, 1)), queue(queue_capacity)
+        {
+            if (path == "-") {
+                this->output = stdout;
+            } else {
+                this->output = std::fopen(path.c_str(), "wb");
+                if (this->output == nullptr)
+                    throw std::runtime_error(std::format("could not open {} for video capture", path));
+                this->owns_output = true;
+            }
+
+            if (format == Format::Y4M) {
+                std::string header = std::format(
+                    "YUV4MPEG2 W{} H{} F60:1 Ip A1:1 Cmono\n", this->width(), this->height()
+                );
+                if (!this->write(header.data(), header.size()))
+                    throw std::runtime_error("failed to write the y4m header");
+            }
+
+            if (timing == Timing::WallClock)
+                this->writer_thread = std::jthread([this](){ this->sample_frames(); });
+            else
+                this->writer_thread = std::jthread([this](){ this->write_frames(); });
+        }
+
+        VideoCapture(const VideoCapture&) = delete;
+        VideoCapture& operator=(const VideoCapture&) = delete;
+
+        /// @brief writes out every queued frame before closing the output
+        ~VideoCapture() {
+            this->queue.close();
+            {
+                std::scoped_lock lock(this->latest_lock);
+                this->is_closed = true;
+            }
+            this->latest_changed.notify_all();
+            this->writer_thread.join();
+            if (this->owns_output)
+                std::fclose(this->output);
+        }
+
+        /// @brief picks a format from the file extension: .y4m, .rgb, or anything else for raw grayscale
+        static Format format_for_path(const std::string& path) {
+            if (path.ends_with(".y4m") || path == "-")
+                return Format::Y4M;
+            else if (path.ends_with(".rgb"))
+                return Format::RawRGB;
+            else
+                return Format::RawGray;
+        }
+
+        void on_present(std::span<const uint64_t, SCREEN_HEIGHT> rows) override {
+            if (this->timing == Timing::WallClock) {
+                std::scoped_lock lock(this->latest_lock);
+                std::ranges::copy(rows, this->latest_frame.begin());
+                return;
+            }
+
+            Frame frame;
+            std::ranges::copy(rows, frame.begin());
+            if (!this->queue.try_push(frame))
+                this->frames_dropped += 1;
+        }
+
+        size_t written() const {
+            return this->frames_written;
+        }
+
+        size_t dropped() const {
+            return this->frames_dropped;
+        }
+
+        bool failed() const {
+            return this->has_failed;
+        }
+    };
+}
+
+#endif
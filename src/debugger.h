@@ -0,0 +1,463 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cctype>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Chip8 {
+    /// @brief what a debugger can see of a core between two instructions
+    struct MachineState {
+        std::span<const uint8_t, 16> registers;
+        uint16_t i_register;
+        uint16_t program_counter;
+        uint8_t stack_pointer;
+        std::span<const uint8_t, 4096> memory;
+    };
+
+    /// @brief a breakpoint condition, compiled once to a tiny stack machine so that checking it is a handful of
+    /// switch cases instead of a parse.
+    ///
+    /// Grammar, loosest binding first:
+    ///   expr    := and ('||' and)*
+    ///   and     := compare ('&&' compare)*
+    ///   compare := sum (('==' | '!=' | '<' | '<=' | '>' | '>=') sum)?
+    ///   sum     := unary (('+' | '-' | '&') unary)*
+    ///   unary   := '!' unary | atom
+    ///   atom    := number | v0-vf | i | pc | sp | '[' expr ']' | '(' expr ')'
+    /// where numbers are decimal or 0x hex, and [addr] reads a byte of memory.
+    class Condition {
+    private:
+        enum class Op : uint8_t {
+            Push, Register, I, PC, SP, Load,
+            Not, Add, Sub, BitAnd,
+            Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual,
+            And, Or,
+        };
+
+        struct Instruction {
+            Op op;
+            uint16_t operand = 0;
+        };
+
+        constexpr static size_t MAX_STACK_DEPTH = 16;
+
+        std::vector<Instruction> code;
+
+        class Parser {
+        private:
+            const std::string& text;
+            size_t pos = 0;
+            std::vector<Instruction>& code;
+            size_t depth = 0;
+            size_t max_depth = 0;
+
+            void skip_space() {
+                while (this->pos < this->text.size() && std::isspace((unsigned char)this->text[this->pos]))
+                    this->pos++;
+            }
+
+            bool accept(std::string_view token) {
+                this->skip_space();
+                if (this->text.compare(this->pos, token.size(), token) != 0)
+                    return false;
+                // don't read the start of && as &, or <= as <
+                if (token.size() == 1 && this->pos + 1 < this->text.size()) {
+                    char next = this->text[this->pos + 1];
+                    if ((token == "&" && next == '&') || (token == "<" && next == '=') || (token == ">" && next == '='))
+                        return false;
+                }
+                this->pos += token.size();
+                return true;
+            }
+
+            [[noreturn]] void fail(std::string_view what) {
+                throw std::invalid_argument(std::format("condition '{}': {} at column {}", this->text, what, this->pos));
+            }
+
+            void emit(Op op, uint16_t operand = 0) {
+                this->code.push_back(Instruction{ op, operand });
+                switch (op) {
+                    case Op::Push: case Op::Register: case Op::I: case Op::PC: case Op::SP:
+                        this->depth += 1;
+                        break;
+                    case Op::Load: case Op::Not:
+                        break;
+                    default:
+                        this->depth -= 1;
+                        break;
+                }
+                this->max_depth = std::max(this->max_depth, this->depth);
+            }
+
+            void atom() {
+                this->skip_space();
+                if (this->accept("(")) {
+                    this->expr();
+                    if (!this->accept(")"))
+                        this->fail("expected ')'");
+                } else if (this->accept("[")) {
+                    this->expr();
+                    if (!this->accept("]"))
+                        this->fail("expected ']'");
+                    this->emit(Op::Load);
+                } else if (this->pos < this->text.size() && std::isdigit((unsigned char)this->text[this->pos])) {
+                    // decimal or 0x hex. A leading 0 doesn't mean octal
+                    std::string number = this->text.substr(this->pos);
+                    bool is_hex = number.size() > 1 && number[0] == '0' && std::tolower((unsigned char)number[1]) == 'x';
+                    size_t length = 0;
+                    unsigned long value;
+                    try {
+                        value = std::stoul(number, &length, is_hex ? 16 : 10);
+                    } catch (const std::exception&) {
+                        this->fail("bad number");
+                    }
+                    if (value > 0xffff)
+                        this->fail("number larger than 16 bits");
+                    this->pos += length;
+                    this->emit(Op::Push, (uint16_t)value);
+                } else {
+                    size_t start = this->pos;
+                    while (this->pos < this->text.size() && std::isalnum((unsigned char)this->text[this->pos]))
+                        this->pos++;
+                    std::string name = this->text.substr(start, this->pos - start);
+                    for (char& c : name)
+                        c = (char)std::tolower((unsigned char)c);
+
+                    if (name.size() == 2 && name[0] == 'v' && std::isxdigit((unsigned char)name[1]))
+                        this->emit(Op::Register, (uint16_t)std::stoul(name.substr(1), nullptr, 16));
+                    else if (name == "i")
+                        this->emit(Op::I);
+                    else if (name == "pc")
+                        this->emit(Op::PC);
+                    else if (name == "sp")
+                        this->emit(Op::SP);
+                    else
+                        this->fail("expected a number, register, or '('");
+                }
+            }
+
+            void unary() {
+                if (this->accept("!")) {
+                    this->unary();
+                    this->emit(Op::Not);
+                } else {
+                    this->atom();
+                }
+            }
+
+            void sum() {
+                this->unary();
+                while (true) {
+                    if (this->accept("+")) {
+                        this->unary();
+                        this->emit(Op::Add);
+                    } else if (this->accept("-")) {
+                        this->unary();
+                        this->emit(Op::Sub);
+                    } else if (this->accept("&")) {
+                        this->unary();
+                        this->emit(Op::BitAnd);
+                    } else {
+                        return;
+                    }
+                }
+            }
+
+            void compare() {
+                this->sum();
+                constexpr std::array<std::pair<std::string_view, Op>, 6> OPERATORS = {{
+                    { "==", Op::Equal }, { "!=", Op::NotEqual }, { "<=", Op::LessEqual },
+                    { ">=", Op::GreaterEqual }, { "<", Op::Less }, { ">", Op::Greater },
+                }};
+                for (auto [token, op] : OPERATORS) {
+                    if (this->accept(token)) {
+                        this->sum();
+                        this->emit(op);
+                        return;
+                    }
+                }
+            }
+
+            void conjunction() {
+                this->compare();
+                while (this->accept("&&")) {
+                    this->compare();
+                    this->emit(Op::And);
+                }
+            }
+
+            void expr() {
+                this->conjunction();
+                while (this->accept("||")) {
+                    this->conjunction();
+                    this->emit(Op::Or);
+                }
+            }
+
+        public:
+            Parser(const std::string& text, std::vector<Instruction>& code) : text(text), code(code) {}
+
+            void parse() {
+                this->expr();
+                this->skip_space();
+                if (this->pos != this->text.size())
+                    this->fail("unexpected trailing text");
+                if (this->max_depth > MAX_STACK_DEPTH)
+                    this->fail("expression too deeply nested");
+            }
+        };
+
+    public:
+        /// @brief an empty condition is always true. Throws std::invalid_argument if `text` doesn't parse.
+        explicit Condition(const std::string& text = "") {
+            bool is_blank = std::ranges::all_of(text, [](char c){ return std::isspace((unsigned char)c); });
+            if (!is_blank)
+                Parser(text, this->code).parse();
+        }
+
+        bool evaluate(const MachineState& state) const {
+            if (this->code.empty())
+                return true;
+
+            std::array<uint32_t, MAX_STACK_DEPTH> stack;
+            size_t top = 0;
+            for (const Instruction& instruction : this->code) {
+                switch (instruction.op) {
+                    case Op::Push:     stack[top++] = instruction.operand; break;
+                    case Op::Register: stack[top++] = state.registers[instruction.operand]; break;
+                    case Op::I:        stack[top++] = state.i_register; break;
+                    case Op::PC:       stack[top++] = state.program_counter; break;
+                    case Op::SP:       stack[top++] = state.stack_pointer; break;
+                    case Op::Load:     stack[top - 1] = state.memory[stack[top - 1] % state.memory.size()]; break;
+                    case Op::Not:      stack[top - 1] = !stack[top - 1]; break;
+                    default: {
+                        uint32_t b = stack[--top];
+                        uint32_t& a = stack[top - 1];
+                        switch (instruction.op) {
+                            case Op::Add:          a = a + b; break;
+                            case Op::Sub:          a = a - b; break;
+                            case Op::BitAnd:       a = a & b; break;
+                            case Op::Equal:        a = a == b; break;
+                            case Op::NotEqual:     a = a != b; break;
+                            case Op::Less:         a = a < b; break;
+                            case Op::LessEqual:    a = a <= b; break;
+                            case Op::Greater:      a = a > b; break;
+                            case Op::GreaterEqual: a = a >= b; break;
+                            case Op::And:          a = a && b; break;
+                            case Op::Or:           a = a || b; break;
+                            default: break;
+                        }
+                    }
+                }
+            }
+            return stack[0] != 0;
+        }
+    };
+
+    /// @brief why a core stopped for its debugger
+    struct DebugHit {
+        enum class Kind {
+            Breakpoint,
+            /// an instruction wrote to watched memory. `address` is the first watched byte written.
+            MemoryWrite,
+            /// a watched register changed value. `address` is the register number.
+            RegisterChange,
+        };
+
+        Kind kind;
+        uint16_t address;
+        /// the program counter of the instruction that will run next
+        uint16_t program_counter;
+    };
+
+    /// @brief breakpoints & watchpoints for a core to check as it runs. Attach with Emulator::attach_debugger().
+    ///
+    /// The common case is one bit test per instruction: breakpoints are a bitmap over every address, & conditions are
+    /// only evaluated once their bit is set. Change breakpoints only while the core is paused or between frames.
+    class Debugger {
+    private:
+        constexpr static size_t MEMORY_SIZE = 4096;
+
+        std::bitset<MEMORY_SIZE> breakpoints;
+        std::unordered_map<uint16_t, Condition> breakpoint_conditions;
+
+        std::bitset<MEMORY_SIZE> watched_memory;
+        std::unordered_map<uint16_t, Condition> memory_conditions;
+
+        uint16_t watched_registers = 0;
+        std::array<Condition, 16> register_conditions;
+        // register values as of the last check, to see which changed
+        std::array<uint8_t, 16> register_shadow = {};
+
+        // the first watched byte written by the last instruction, if any
+        std::optional<uint16_t> pending_write;
+
+        // resuming from a breakpoint must run its instruction rather than stop on it again
+        std::optional<uint16_t> ignore_breakpoint_at;
+
+        std::optional<DebugHit> hit;
+        std::function<void(const DebugHit&)> stop_handler;
+
+    public:
+        /// @param condition only stop when this is true, see Condition
+        void set_breakpoint(uint16_t address, const std::string& condition = "") {
+            address %= MEMORY_SIZE;
+            this->breakpoint_conditions.insert_or_assign(address, Condition(condition));
+            this->breakpoints.set(address);
+        }
+
+        void clear_breakpoint(uint16_t address) {
+            address %= MEMORY_SIZE;
+            this->breakpoints.reset(address);
+            this->breakpoint_conditions.erase(address);
+        }
+
+        bool has_breakpoint(uint16_t address) const {
+            return this->breakpoints.test(address % MEMORY_SIZE);
+        }
+
+        /// @brief stops after any instruction that writes to [address, address + length)
+        void watch_memory(uint16_t address, size_t length = 1, const std::string& condition = "") {
+            Condition compiled(condition);
+            for (size_t i = 0; i < length; i++) {
+                uint16_t watched = (address + i) % MEMORY_SIZE;
+                this->memory_conditions.insert_or_assign(watched, compiled);
+                this->watched_memory.set(watched);
+            }
+        }
+
+        void unwatch_memory(uint16_t address, size_t length = 1) {
+            for (size_t i = 0; i < length; i++) {
+                uint16_t watched = (address + i) % MEMORY_SIZE;
+                this->watched_memory.reset(watched);
+                this->memory_conditions.erase(watched);
+            }
+        }
+
+        /// @brief stops after any instruction that changes the value of V[reg]
+        void watch_register(uint8_t reg, const std::string& condition = "") {
+            reg %= 16;
+            this->register_conditions[reg] = Condition(condition);
+            this->watched_registers |= (1 << reg);
+        }
+
+        void unwatch_register(uint8_t reg) {
+            reg %= 16;
+            this->watched_registers &= ~(1 << reg);
+            this->register_conditions[reg] = Condition();
+        }
+
+        void clear_all() {
+            this->breakpoints.reset();
+            this->breakpoint_conditions.clear();
+            this->watched_memory.reset();
+            this->memory_conditions.clear();
+            this->watched_registers = 0;
+            this->register_conditions.fill(Condition());
+            this->pending_write.reset();
+        }
+
+        /// @brief called with the core paused whenever it stops for this debugger, from the thread running the core
+        void set_stop_handler(std::function<void(const DebugHit&)> handler) {
+            this->stop_handler = std::move(handler);
+        }
+
+        /// @brief the reason the core last stopped for this debugger
+        std::optional<DebugHit> last_hit() const {
+            return this->hit;
+        }
+
+        /// @brief call before resuming a paused core, so that a later stop for another reason (eg. halting) isn't
+        /// mistaken for this one
+        void forget_hit() {
+            this->hit.reset();
+        }
+
+        #pragma region Called by the core
+
+        /// @brief the core is about to write [address, address + length). One bit test per byte.
+        void note_write(uint16_t address, size_t length) {
+            if (this->pending_write.has_value())
+                return;
+            for (size_t i = 0; i < length; i++) {
+                uint16_t written = (address + i) % MEMORY_SIZE;
+                if (this->watched_memory.test(written)) {
+                    this->pending_write = written;
+                    return;
+                }
+            }
+        }
+
+        /// @brief the per-instruction fast path: whether check() could stop the core at `program_counter`
+        bool wants_check(uint16_t program_counter) const {
+            return this->breakpoints[program_counter % MEMORY_SIZE]
+                || this->pending_write.has_value()
+                || this->watched_registers != 0;
+        }
+
+        /// @brief called before an instruction when wants_check() says so. Reports watched writes by the previous instruction, then breakpoints
+        /// on the next one.
+        /// @returns why the core should stop before running the instruction at state.program_counter, if it should
+        std::optional<DebugHit> check(const MachineState& state) {
+            uint16_t pc = state.program_counter % MEMORY_SIZE;
+            this->hit.reset();
+
+            if (this->pending_write.has_value()) {
+                uint16_t address = this->pending_write.value();
+                this->pending_write.reset();
+                auto condition = this->memory_conditions.find(address);
+                if (condition == this->memory_conditions.end() || condition->second.evaluate(state))
+                    this->hit = DebugHit{ DebugHit::Kind::MemoryWrite, address, pc };
+            }
+
+            if (this->watched_registers != 0 && !std::ranges::equal(state.registers, this->register_shadow)) {
+                for (uint8_t reg = 0; reg < 16 && !this->hit.has_value(); reg++) {
+                    bool changed = state.registers[reg] != this->register_shadow[reg];
+                    if (changed && ((this->watched_registers >> reg) & 1) && this->register_conditions[reg].evaluate(state))
+                        this->hit = DebugHit{ DebugHit::Kind::RegisterChange, reg, pc };
+                }
+                std::ranges::copy(state.registers, this->register_shadow.begin());
+            }
+
+            if (this->ignore_breakpoint_at == pc) {
+                this->ignore_breakpoint_at.reset();
+            } else if (!this->hit.has_value() && this->breakpoints.test(pc)) {
+                auto condition = this->breakpoint_conditions.find(pc);
+                if (condition == this->breakpoint_conditions.end() || condition->second.evaluate(state))
+                    this->hit = DebugHit{ DebugHit::Kind::Breakpoint, pc, pc };
+            }
+
+            if (this->hit.has_value() && this->hit->kind == DebugHit::Kind::Breakpoint)
+                this->ignore_breakpoint_at = pc;
+            return this->hit;
+        }
+
+        /// @brief forget register values seen so far, eg. after the core was reset or its registers were edited
+        void resync(const MachineState& state) {
+            std::ranges::copy(state.registers, this->register_shadow.begin());
+            this->pending_write.reset();
+            this->ignore_breakpoint_at.reset();
+        }
+
+        void notify_stopped(const DebugHit& hit) {
+            if (this->stop_handler)
+                this->stop_handler(hit);
+        }
+
+        #pragma endregion
+    };
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace Chip8 {
+    /// @brief every instruction the interpreter understands. Shared by the executing cores & the tools that read
+    /// programs, so that they always agree on what is valid.
+    enum class Opcode : uint8_t {
+        Cls,                // 00e0
+        Ret,                // 00ee
+        Sys,                // 0nnn
+        Jp,                 // 1nnn
+        Call,               // 2nnn
+        SkipEqual,          // 3xkk
+        SkipNotEqual,       // 4xkk
+        SkipEqualReg,       // 5xy0
+        Load,               // 6xkk
+        Add,                // 7xkk
+        LoadReg,            // 8xy0
+        Or,                 // 8xy1
+        And,                // 8xy2
+        Xor,                // 8xy3
+        CarryAddReg,        // 8xy4
+        CarrySubReg,        // 8xy5
+        ShiftRight,         // 8xy6
+        SubtractReversed,   // 8xy7
+        ShiftLeft,          // 8xye
+        SkipNotEqualReg,    // 9xy0
+        LoadAddress,        // annn
+        JumpReg0,           // bnnn
+        RandomInt,          // cxkk
+        DrawSprite,         // dxyn
+        SkipIfKeyPress,     // ex9e
+        SkipIfNotKeyPress,  // exa1
+        LoadFromDelayTimer, // fx07
+        LoadFromNextKeypress, // fx0a
+        SetDelay,           // fx15
+        SetSound,           // fx18
+        IncrementIReg,      // fx1e
+        LoadSprite,         // fx29
+        LoadBcd,            // fx33
+        LoadRegToMem,       // fx55
+        LoadMemToReg,       // fx65
+        Unknown,
+    };
+
+    constexpr size_t NUM_OPCODES = static_cast<size_t>(Opcode::Unknown) + 1;
+
+    /// @brief the usual way of writing each opcode, eg. "8xy4", indexed by Opcode
+    constexpr std::array<std::string_view, NUM_OPCODES> OPCODE_PATTERNS = {
+        "00e0", "00ee", "0nnn", "1nnn", "2nnn", "3xkk", "4xkk", "5xy0", "6xkk", "7xkk",
+        "8xy0", "8xy1", "8xy2", "8xy3", "8xy4", "8xy5", "8xy6", "8xy7", "8xye", "9xy0",
+        "annn", "bnnn", "cxkk", "dxyn", "ex9e", "exa1",
+        "fx07", "fx0a", "fx15", "fx18", "fx1e", "fx29", "fx33", "fx55", "fx65", "????",
+    };
+
+    /// @brief an instruction word with its opcode & operand fields pulled apart
+    struct Instruction {
+        Opcode opcode;
+        uint16_t word;
+
+        constexpr uint8_t x() const { return (this->word >> 8) & 0x0f; }
+        constexpr uint8_t y() const { return (this->word >> 4) & 0x0f; }
+        constexpr uint8_t n() const { return this->word & 0x000f; }
+        constexpr uint8_t kk() const { return this->word & 0x00ff; }
+        constexpr uint16_t nnn() const { return this->word & 0x0fff; }
+    };
+
+    constexpr Opcode decode_opcode(uint16_t word) {
+        switch (word & 0xf000) {
+            case 0x0000:
+                if (word == 0x00e0)
+                    return Opcode::Cls;
+                else if (word == 0x00ee)
+                    return Opcode::Ret;
+                return Opcode::Sys;
+            case 0x1000: return Opcode::Jp;
+            case 0x2000: return Opcode::Call;
+            case 0x3000: return Opcode::SkipEqual;
+            case 0x4000: return Opcode::SkipNotEqual;
+            case 0x5000: return (word & 0x000f) == 0 ? Opcode::SkipEqualReg : Opcode::Unknown;
+            case 0x6000: return Opcode::Load;
+            case 0x7000: return Opcode::Add;
+            case 0x8000:
+                switch (word & 0x000f) {
+                    case 0x0: return Opcode::LoadReg;
+                    case 0x1: return Opcode::Or;
+                    case 0x2: return Opcode::And;
+                    case 0x3: return Opcode::Xor;
+                    case 0x4: return Opcode::CarryAddReg;
+                    case 0x5: return Opcode::CarrySubReg;
+                    case 0x6: return Opcode::ShiftRight;
+                    case 0x7: return Opcode::SubtractReversed;
+                    case 0xe: return Opcode::ShiftLeft;
+                    default:  return Opcode::Unknown;
+                }
+            case 0x9000: return (word & 0x000f) == 0 ? Opcode::SkipNotEqualReg : Opcode::Unknown;
+            case 0xa000: return Opcode::LoadAddress;
+            case 0xb000: return Opcode::JumpReg0;
+            case 0xc000: return Opcode::RandomInt;
+            case 0xd000: return Opcode::DrawSprite;
+            case 0xe000:
+                switch (word & 0x00ff) {
+                    case 0x9e: return Opcode::SkipIfKeyPress;
+                    case 0xa1: return Opcode::SkipIfNotKeyPress;
+                    default:   return Opcode::Unknown;
+                }
+            default:
+                switch (word & 0x00ff) {
+                    case 0x07: return Opcode::LoadFromDelayTimer;
+                    case 0x0a: return Opcode::LoadFromNextKeypress;
+                    case 0x15: return Opcode::SetDelay;
+                    case 0x18: return Opcode::SetSound;
+                    case 0x1e: return Opcode::IncrementIReg;
+                    case 0x29: return Opcode::LoadSprite;
+                    case 0x33: return Opcode::LoadBcd;
+                    case 0x55: return Opcode::LoadRegToMem;
+                    case 0x65: return Opcode::LoadMemToReg;
+                    default:   return Opcode::Unknown;
+                }
+        }
+    }
+
+    constexpr Instruction decode(uint16_t word) {
+        return Instruction{ decode_opcode(word), word };
+    }
+
+    /// @brief skips the next instruction when some condition holds
+    constexpr bool is_skip(Opcode opcode) {
+        switch (opcode) {
+            case Opcode::SkipEqual: case Opcode::SkipNotEqual: case Opcode::SkipEqualReg: case Opcode::SkipNotEqualReg:
+            case Opcode::SkipIfKeyPress: case Opcode::SkipIfNotKeyPress:
+                return true;
+            default:
+                return false;
+        }
+    }
+}
+
+#endif
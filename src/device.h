@@ -3,53 +3,118 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <format>
+#include <iostream>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_audio.h>
 
+#include "flicker_filter.h"
+#include "framebuffer.h"
+#include "latency.h"
+#include "speaker.h"
 #include "timer.h"
 
 namespace Chip8 {
-    constexpr static uint16_t SCREEN_WIDTH  = 64;
-    constexpr static uint16_t SCREEN_HEIGHT = 32;
-
     namespace SDL3 {
+        /// @brief performs init and cleanup of the device. Subsystems are started lazily by whichever part needs them.
+        class Lifetime {
+        private:
+            // SDL_InitSubSystem isn't safe to call from two threads at once
+            static std::mutex& init_lock() {
+                static std::mutex lock;
+                return lock;
+            }
+
+        public:
+            static void init_subsystem(SDL_InitFlags flags) {
+                std::scoped_lock lock(init_lock());
+                if (!SDL_InitSubSystem(flags))
+                    throw std::runtime_error(std::format("SDL_InitSubSystem error: {}\n", SDL_GetError()));
+            }
+
+            ~Lifetime() {
+                SDL_Quit();
+            }
+        };
+
+        /// @brief draws the framebuffer to a window once one is opened. Until then (& if it never is), frames still go
+        /// to the framebuffer's sinks, so execution doesn't have to wait for the window.
+        ///
+        /// By default every render_buffer() is drawn straight away, on the execution thread. When deferred (with frame
+        /// skipping or a flicker filter), render_buffer() only keeps the latest frame, & refresh() draws it from the
+        /// main thread at 60hz instead, so a slow renderer never holds up execution.
         class Display {
+        public:
+            /// @brief what happened to the frames rendered while deferred
+            struct Stats {
+                /// render_buffer() calls, ie. frames the program drew
+                size_t rendered = 0;
+                /// refreshes that drew something
+                size_t presented = 0;
+                /// frames replaced by a newer one before a refresh could draw them
+                size_t skipped = 0;
+                /// refreshes given up because the previous present ran over its budget
+                size_t refreshes_dropped = 0;
+                std::chrono::nanoseconds last_present_time = {};
+                std::chrono::nanoseconds worst_present_time = {};
+            };
+
         private:
+            using Frame = std::array<uint64_t, SCREEN_HEIGHT>;
+
+            constexpr static auto REFRESH_INTERVAL = std::chrono::microseconds(16667);
+            constexpr static uint8_t PIXEL_ON = 255;
+            constexpr static uint8_t PIXEL_OFF = 25;
+
             SDL_Window* window = nullptr;
             SDL_Renderer* renderer = nullptr;
+            // the window is opened on the main thread while the execution thread may already be drawing
+            std::mutex render_lock;
 
             // the edge size of a pixel rendered on the native display
             const float scale_factor = 4.0;
 
-        public:
-            Display() {
-                // zero init the display buffer!
-                std::ranges::fill(this->buffer, 0);
+            bool is_skipping_frames = false;
+            std::optional<FlickerFilter> flicker_filter = std::nullopt;
 
-                if (!SDL_CreateWindowAndRenderer(
-                    "Chip8 Display",
-                    (int)(SCREEN_WIDTH  * this->scale_factor),
-                    (int)(SCREEN_HEIGHT * this->scale_factor),
-                    0, &this->window, &this->renderer
-                ))
-                    throw std::runtime_error(std::format("SDL_CreateWindowAndRenderer error: {}\n", SDL_GetError()));
+            // the last frame rendered by the execution thread, for refresh() to pick up. Numbered so that refresh()
+            // can tell whether there is anything new, & how many frames it never saw.
+            std::mutex frame_lock;
+            Frame latest_frame = {};
+            size_t latest_serial = 0;
 
-                SDL_SetRenderVSync(this->renderer, SDL_RENDERER_VSYNC_ADAPTIVE);
+            // only touched by refresh()
+            size_t presented_serial = 0;
+            std::chrono::steady_clock::time_point next_refresh = {};
+            Stats present_stats;
+
+            LatencyProbe* latency_probe = nullptr;
+
+            bool is_deferred() const {
+                return this->is_skipping_frames || this->flicker_filter.has_value();
             }
 
-            void render_buffer() {
+            /// @param taken_at when `frame` was copied out of the framebuffer
+            void draw(const Frame& frame, std::chrono::steady_clock::time_point taken_at) {
                 // TODO: later, consider a more efficient way to send this data to the gpu & render it
                 for (uint16_t y = 0; y < SCREEN_HEIGHT; y++) {
                     for (uint16_t x = 0; x < SCREEN_WIDTH; x++) {
-                        bool px_active = buffer[x + y * SCREEN_WIDTH];
-                        if (px_active)
-                            SDL_SetRenderDrawColor(this->renderer, 255, 255, 255, 255);
+                        uint8_t intensity;
+                        if (this->flicker_filter.has_value())
+                            intensity = this->flicker_filter->intensity(x, y);
                         else
-                            SDL_SetRenderDrawColor(this->renderer, 25, 25, 25, 255);
+                            intensity = ((frame[y] >> (SCREEN_WIDTH - 1 - x)) & 1) ? 255 : 0;
+
+                        uint8_t shade = PIXEL_OFF + (uint8_t)((PIXEL_ON - PIXEL_OFF) * intensity / 255);
+                        SDL_SetRenderDrawColor(this->renderer, shade, shade, shade, 255);
 
                         const SDL_FRect pixel_bounds = {
                             x * this->scale_factor,
@@ -61,23 +126,161 @@ namespace Chip8 {
                 }
 
                 SDL_RenderPresent(renderer);
+                if (this->latency_probe != nullptr)
+                    this->latency_probe->on_present(taken_at);
+            }
+
+            Frame take_latest_frame() {
+                std::scoped_lock lock(this->frame_lock);
+                return this->latest_frame;
             }
 
-            std::array<bool, SCREEN_WIDTH * SCREEN_HEIGHT> buffer;
+        public:
+            /// @brief creates the window & draws whatever is already in the buffer. SDL wants this on the main thread.
+            /// Does nothing if the window is already open.
+            void open_window() {
+                std::scoped_lock lock(this->render_lock);
+                if (this->renderer != nullptr)
+                    return;
+
+                Lifetime::init_subsystem(SDL_INIT_VIDEO);
+                if (!SDL_CreateWindowAndRenderer(
+                    "Chip8 Display",
+                    (int)(SCREEN_WIDTH  * this->scale_factor),
+                    (int)(SCREEN_HEIGHT * this->scale_factor),
+                    0, &this->window, &this->renderer
+                ))
+                    throw std::runtime_error(std::format("SDL_CreateWindowAndRenderer error: {}\n", SDL_GetError()));
+
+                SDL_SetRenderVSync(this->renderer, SDL_RENDERER_VSYNC_ADAPTIVE);
+                auto taken_at = std::chrono::steady_clock::now();
+                if (this->is_deferred()) {
+                    this->draw(this->take_latest_frame(), taken_at);
+                } else {
+                    Frame frame;
+                    std::ranges::copy(this->buffer.rows(), frame.begin());
+                    this->draw(frame, taken_at);
+                }
+            }
+
+            /// @brief from now on, draw from refresh() only, skipping whatever frames were replaced in between. Only
+            /// call this before execution starts.
+            void skip_frames() {
+                this->is_skipping_frames = true;
+                std::ranges::copy(this->buffer.rows(), this->latest_frame.begin());
+            }
+
+            /// @brief from now on, blend the last few refreshes instead of drawing every frame as it is rendered.
+            /// Only call this before execution starts.
+            void reduce_flicker(FlickerFilter::Mode mode, size_t frames) {
+                this->flicker_filter.emplace(mode, frames);
+                std::ranges::copy(this->buffer.rows(), this->latest_frame.begin());
+            }
+
+            /// @param is_sprite_draw tells the latency probe, once the frame holding the draw can be picked up, so that
+            /// it is never matched to a present taken before then
+            void render_buffer(bool is_sprite_draw = false) {
+                this->buffer.present();
+
+                if (this->is_deferred()) {
+                    std::scoped_lock lock(this->frame_lock);
+                    std::ranges::copy(this->buffer.rows(), this->latest_frame.begin());
+                    this->latest_serial += 1;
+                    if (is_sprite_draw && this->latency_probe != nullptr)
+                        this->latency_probe->on_draw();
+                    return;
+                }
+
+                if (is_sprite_draw && this->latency_probe != nullptr)
+                    this->latency_probe->on_draw();
+                auto taken_at = std::chrono::steady_clock::now();
+                Frame frame;
+                std::ranges::copy(this->buffer.rows(), frame.begin());
+                std::scoped_lock lock(this->render_lock);
+                if (this->renderer != nullptr)
+                    this->draw(frame, taken_at);
+            }
+
+            /// @brief when deferred, draws the latest frame if a refresh is due. If drawing takes longer than a
+            /// refresh, the refreshes it overran are dropped rather than queued. Does nothing when not deferred. Call
+            /// it regularly from the thread that owns the window.
+            /// @param is_forced draw now even if a refresh isn't due yet, eg. once execution has stopped
+            void refresh(bool is_forced = false) {
+                if (!this->is_deferred())
+                    return;
+
+                auto now = std::chrono::steady_clock::now();
+                if (now < this->next_refresh && !is_forced)
+                    return;
+                this->next_refresh = std::max(this->next_refresh + REFRESH_INTERVAL, now);
+
+                Frame frame;
+                size_t serial;
+                std::chrono::steady_clock::time_point taken_at;
+                {
+                    std::scoped_lock lock(this->frame_lock);
+                    frame = this->latest_frame;
+                    serial = this->latest_serial;
+                    taken_at = std::chrono::steady_clock::now();
+                }
+
+                std::scoped_lock lock(this->render_lock);
+                this->present_stats.rendered = serial;
+                // a blend keeps changing as frames age, even when nothing new was drawn
+                if (serial == this->presented_serial && !this->flicker_filter.has_value())
+                    return;
+                if (serial > this->presented_serial)
+                    this->present_stats.skipped += serial - this->presented_serial - 1;
+                this->presented_serial = serial;
+
+                if (this->flicker_filter.has_value())
+                    this->flicker_filter->push(frame);
+                if (this->renderer == nullptr)
+                    return;
+
+                this->draw(frame, taken_at);
+                auto took = std::chrono::steady_clock::now() - now;
+                this->present_stats.presented += 1;
+                this->present_stats.last_present_time = took;
+                this->present_stats.worst_present_time = std::max<std::chrono::nanoseconds>(this->present_stats.worst_present_time, took);
+
+                if (took > REFRESH_INTERVAL) {
+                    size_t overrun = took / REFRESH_INTERVAL;
+                    this->present_stats.refreshes_dropped += overrun;
+                    this->next_refresh = now + (overrun + 1) * REFRESH_INTERVAL;
+                }
+            }
+
+            /// @brief reports every present to `probe`, or stops if null. Only call before execution starts.
+            void attach_latency_probe(LatencyProbe* probe) {
+                this->latency_probe = probe;
+            }
+
+            /// @brief only meaningful when deferred. Call from the thread that calls refresh().
+            Stats stats() {
+                std::scoped_lock lock(this->render_lock);
+                return this->present_stats;
+            }
+
+            Framebuffer buffer;
 
             ~Display() {
-                SDL_DestroyRenderer(this->renderer);
-                SDL_DestroyWindow(this->window);
+                if (this->renderer != nullptr)
+                    SDL_DestroyRenderer(this->renderer);
+                if (this->window != nullptr)
+                    SDL_DestroyWindow(this->window);
             }
         };
    
+        /// @brief plays the sound timer's tone. SDL's audio is initialised on the constructing (main) thread, then the
+        /// device is opened in the background, since that can take hundreds of milliseconds; if there is no device, the
+        /// speaker stays silent instead of failing.
         class Speaker {
         private:
             constexpr static SDL_AudioSpec OUTPUT_SPEC = {
                 SDL_AUDIO_U8,
                 1,
-                // TODO: increase sample rate so our sfx sounds more like a square wave!
-                400 * 64, // 48000
+                Tone::SAMPLE_RATE,
             };
 
             SDL_AudioDeviceID device_id = 0;
@@ -85,30 +288,26 @@ namespace Chip8 {
 
             Timer60hz& sound_timer;
 
+            std::atomic<bool> is_open = false;
+            std::atomic<bool> is_muted = false;
+
+            // declared last so that it is joined before anything it touches is destroyed
+            std::jthread open_thread;
+
             // SDLCALL
             static void out_stream_callback(void* userdata, SDL_AudioStream* stream, int additional_amount, int total_amount) {
                 if (additional_amount <= 0)
                     return;
 
                 Speaker* self = (Speaker*) userdata;
-                uint8_t value = self->sound_timer.value();
+                uint8_t value = self->is_muted ? 0 : self->sound_timer.value();
 
                 std::vector<uint8_t> samples(additional_amount);
-                std::ranges::fill(samples, 0xff / 2);
-
-                // 800hz sample rate, 60hz timer
-                // each timer value represents the same time-period as 6.66666... samples
-                size_t limit = std::min((size_t) (value * (OUTPUT_SPEC.freq / 60.0)), samples.size());
-                for (size_t i = 0; i < limit; i++) {
-                    // Since our sample rate is 400hz, we should expect to get a 200hz wave
-                    // that is somewhat sine/square shaped.
-                    // The actual shape depends on SDL3's built-in resampler.
-                    if (i % (64*2) < (32*2)) {
-                        samples[i] = 0x00;
-                    } else {
-                        samples[i] = 0xff;
-                    }
-                }
+                std::ranges::fill(samples, Tone::SILENCE);
+
+                size_t limit = std::min(Tone::samples_for(value), samples.size());
+                for (size_t i = 0; i < limit; i++)
+                    samples[i] = Tone::sample(i);
 
                 // TODO: next: is this still required?
                 // TODO: remember the last queued sample to decide on phase of the wave (for now, we'll just get lil blips and
@@ -118,13 +317,12 @@ namespace Chip8 {
                     throw std::runtime_error(std::format("SDL_PutAudioStreamData failed with: {}", SDL_GetError()));
             }
 
-        public:
-            Speaker(Timer60hz& sound_timer) : sound_timer(sound_timer) {
+            void open() {
                 this->device_id = SDL_OpenAudioDevice(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, nullptr);
                 if (this->device_id == 0)
                     throw std::runtime_error(std::format("SDL_OpenAudioDevice failed with: {}", SDL_GetError()));
 
-                std::cout << "Opened Audio Device: " << SDL_GetAudioDeviceName(this->device_id) << std::endl;
+                std::cerr << "Opened Audio Device: " << SDL_GetAudioDeviceName(this->device_id) << std::endl;
 
                 this->out_stream = SDL_CreateAudioStream(&Speaker::OUTPUT_SPEC, nullptr);
                 if (this->out_stream == nullptr)
@@ -136,21 +334,49 @@ namespace Chip8 {
                 // TODO: how is this implemented internally? With sleep?
                 SDL_SetAudioStreamGetCallback(this->out_stream, out_stream_callback, (void*)this);
             }
-            ~Speaker() {
+
+            void close() {
                 SDL_DestroyAudioStream(this->out_stream);
                 SDL_CloseAudioDevice(this->device_id);
+                this->out_stream = nullptr;
+                this->device_id = 0;
             }
-        };
 
-        /// @brief performs init and cleanup of the device
-        class Lifetime {
         public:
-            Lifetime() {
-                if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO))
-                    throw std::runtime_error(std::format("SDL_Init error: {}\n", SDL_GetError()));
+            Speaker(Timer60hz& sound_timer) : sound_timer(sound_timer) {
+                // SDL only initialises subsystems on the main thread
+                try {
+                    Lifetime::init_subsystem(SDL_INIT_AUDIO);
+                } catch (const std::exception& e) {
+                    std::cerr << "No audio (" << e.what() << "), continuing without sound" << std::endl;
+                    return;
+                }
+
+                this->open_thread = std::jthread([this](){
+                    try {
+                        this->open();
+                        this->is_open = true;
+                    } catch (const std::exception& e) {
+                        std::cerr << "No audio (" << e.what() << "), continuing without sound" << std::endl;
+                        this->close();
+                    }
+                });
             }
-            ~Lifetime() {
-                SDL_Quit();
+
+            /// @brief false until the device has opened in the background, & forever if there is no device
+            bool opened() const {
+                return this->is_open;
+            }
+
+            /// @brief silences the tone without touching the sound timer, eg. while fast-forwarding
+            void set_muted(bool is_muted) {
+                this->is_muted = is_muted;
+            }
+
+            ~Speaker() {
+                if (this->open_thread.joinable())
+                    this->open_thread.join();
+                this->close();
             }
         };
     }
@@ -165,11 +391,37 @@ namespace Chip8 {
         Chip8::SDL3::Speaker speaker;
         Chip8::SDL3::Display display;
 
+        /// @brief starts opening the audio device in the background. The window waits for open_window().
         Device(Timer60hz& sound_timer) : speaker(sound_timer) {}
 
+        void open_window() {
+            this->display.open_window();
+        }
+
         // TODO: maybe move the keyboard here too
     };
 
+    namespace Headless {
+        /// @brief a display buffer with no window. The embedder reads the buffer directly, and sinks see one frame at
+        /// the end of every guest frame instead of one per draw.
+        class Display {
+        public:
+            void render_buffer(bool = false) {}
+
+            Framebuffer buffer;
+        };
+    }
+
+    /// @brief a device without a window, speaker or any SDL state, so that thousands of cores can share one process
+    class HeadlessDevice {
+    public:
+        Chip8::Headless::Display display;
+
+        HeadlessDevice(FrameTimer60hz&) {}
+
+        void open_window() {}
+    };
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "disassembler.h"
+#include "geblib.h"
+#include "program_file.h"
+
+const char* USAGE = (
+    "usage: chip8-disasm [options] <.chip8/.ch8 file or directory>...\n"
+    "directories are searched recursively, & files are disassembled in parallel\n"
+    "options:\n"
+    "  --dot        print the control flow graph of each program in graphviz's DOT language\n"
+    "  --summary    print one line per program, for triage\n"
+);
+
+enum class Mode {
+    Listing,
+    Dot,
+    Summary,
+};
+
+std::string summarize(const std::filesystem::path& path, const Chip8::Disassembly& disassembly, size_t program_size) {
+    const Chip8::ProgramAnalysis& analysis = disassembly.analysis();
+    size_t code_bytes = 0;
+    for (size_t address = 0x200; address < 0x200 + program_size; address++)
+        code_bytes += analysis.code[address];
+
+    std::string reasons;
+    if (analysis.has_indirect_jumps)
+        reasons += " indirect-jumps";
+    if (analysis.may_modify_code)
+        reasons += " self-modifying";
+    if (!analysis.unknown_opcodes.empty())
+        reasons += " unknown-opcodes";
+    if (!analysis.out_of_bounds.empty())
+        reasons += " out-of-bounds";
+
+    std::string depth = analysis.max_call_depth.has_value() ? std::to_string(analysis.max_call_depth.value()) : "recursive";
+    return std::format(
+        "{}\t{}\t{}\t{}\t{}\t{}\t{}{}\n",
+        path.string(), program_size, code_bytes, program_size - code_bytes, disassembly.blocks().size(), depth,
+        disassembly.is_statically_translatable() ? "translate" : "interpret", reasons
+    );
+}
+
+std::string describe(const std::filesystem::path& path, Mode mode, std::atomic<size_t>& failures) {
+    auto program = Chip8::read_program_file(path);
+    if (!program.has_value()) {
+        failures += 1;
+        return std::format("ERROR: can't read {}\n", path.string());
+    }
+
+    Chip8::Disassembly disassembly(program.value());
+    switch (mode) {
+        case Mode::Dot:
+            return disassembly.dot(path.stem().string());
+        case Mode::Summary:
+            return summarize(path, disassembly, std::min<size_t>(program->size(), 4096 - 0x200));
+        default:
+            break;
+    }
+
+    std::string out = std::format("; {}: {} bytes\n", path.string(), program->size());
+    for (const std::string& problem : disassembly.analysis().problems())
+        out += std::format("; {}\n", problem);
+    return out + disassembly.listing();
+}
+
+int main(int argc, char *argv[]) {
+    Mode mode = Mode::Listing;
+    std::vector<std::filesystem::path> paths;
+
+    try {
+        for (int arg_i = 1; arg_i < argc; arg_i++) {
+            std::string option(argv[arg_i]);
+            if (option == "--dot") {
+                mode = Mode::Dot;
+            } else if (option == "--summary") {
+                mode = Mode::Summary;
+            } else if (option.starts_with("--")) {
+                std::cout << "ERROR: unknown option " << option << "\n" << USAGE << std::endl;
+                exit(1);
+            } else if (std::filesystem::is_directory(option)) {
+                size_t first = paths.size();
+                for (const auto& entry : std::filesystem::recursive_directory_iterator(option)) {
+                    auto extension = entry.path().extension();
+                    if (entry.is_regular_file() && (extension == ".chip8" || extension == ".ch8"))
+                        paths.push_back(entry.path());
+                }
+                // directory order isn't stable
+                std::sort(paths.begin() + first, paths.end());
+            } else {
+                paths.push_back(option);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cout << "ERROR: " << e.what() << std::endl;
+        exit(1);
+    }
+
+    if (paths.empty()) {
+        std::cout << "ERROR: expected a path to a .chip8 or .ch8 file\n" << USAGE << std::endl;
+        exit(1);
+    }
+
+    // each program is small & independent, so one task per file keeps every core busy
+    std::vector<std::string> outputs(paths.size());
+    std::atomic<size_t> failures = 0;
+    {
+        GebLib::Threading::WorkStealingPool<size_t> pool(std::thread::hardware_concurrency(), [&](size_t i){
+            outputs[i] = describe(paths[i], mode, failures);
+        });
+        for (size_t i = 0; i < paths.size(); i++)
+            pool.submit(i);
+        pool.wait_idle();
+    }
+
+    if (mode == Mode::Summary)
+        std::cout << "path\tbytes\tcode\tdata\tblocks\tcall depth\tverdict\n";
+    for (const std::string& output : outputs)
+        std::cout << output;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,306 @@
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <format>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "analysis.h"
+#include "decode.h"
+#include "font.h"
+
+namespace Chip8 {
+    /// @brief Cowgod's mnemonics, eg. "LD V0, 0x1f". Unknown words come out as "DW 0x1234".
+    inline std::string mnemonic(Instruction instruction) {
+        auto x = instruction.x();
+        auto y = instruction.y();
+        switch (instruction.opcode) {
+            case Opcode::Cls: return "CLS";
+            case Opcode::Ret: return "RET";
+            case Opcode::Sys: return std::format("SYS 0x{:03x}", instruction.nnn());
+            case Opcode::Jp: return std::format("JP 0x{:03x}", instruction.nnn());
+            case Opcode::Call: return std::format("CALL 0x{:03x}", instruction.nnn());
+            case Opcode::SkipEqual: return std::format("SE V{:x}, 0x{:02x}", x, instruction.kk());
+            case Opcode::SkipNotEqual: return std::format("SNE V{:x}, 0x{:02x}", x, instruction.kk());
+            case Opcode::SkipEqualReg: return std::format("SE V{:x}, V{:x}", x, y);
+            case Opcode::Load: return std::format("LD V{:x}, 0x{:02x}", x, instruction.kk());
+            case Opcode::Add: return std::format("ADD V{:x}, 0x{:02x}", x, instruction.kk());
+            case Opcode::LoadReg: return std::format("LD V{:x}, V{:x}", x, y);
+            case Opcode::Or: return std::format("OR V{:x}, V{:x}", x, y);
+            case Opcode::And: return std::format("AND V{:x}, V{:x}", x, y);
+            case Opcode::Xor: return std::format("XOR V{:x}, V{:x}", x, y);
+            case Opcode::CarryAddReg: return std::format("ADD V{:x}, V{:x}", x, y);
+            case Opcode::CarrySubReg: return std::format("SUB V{:x}, V{:x}", x, y);
+            case Opcode::ShiftRight: return y == 0 ? std::format("SHR V{:x}", x) : std::format("SHR V{:x}, V{:x}", x, y);
+            case Opcode::SubtractReversed: return std::format("SUBN V{:x}, V{:x}", x, y);
+            case Opcode::ShiftLeft: return y == 0 ? std::format("SHL V{:x}", x) : std::format("SHL V{:x}, V{:x}", x, y);
+            case Opcode::SkipNotEqualReg: return std::format("SNE V{:x}, V{:x}", x, y);
+            case Opcode::LoadAddress: return std::format("LD I, 0x{:03x}", instruction.nnn());
+            case Opcode::JumpReg0: return std::format("JP V0, 0x{:03x}", instruction.nnn());
+            case Opcode::RandomInt: return std::format("RND V{:x}, 0x{:02x}", x, instruction.kk());
+            case Opcode::DrawSprite: return std::format("DRW V{:x}, V{:x}, {}", x, y, instruction.n());
+            case Opcode::SkipIfKeyPress: return std::format("SKP V{:x}", x);
+            case Opcode::SkipIfNotKeyPress: return std::format("SKNP V{:x}", x);
+            case Opcode::LoadFromDelayTimer: return std::format("LD V{:x}, DT", x);
+            case Opcode::LoadFromNextKeypress: return std::format("LD V{:x}, K", x);
+            case Opcode::SetDelay: return std::format("LD DT, V{:x}", x);
+            case Opcode::SetSound: return std::format("LD ST, V{:x}", x);
+            case Opcode::IncrementIReg: return std::format("ADD I, V{:x}", x);
+            case Opcode::LoadSprite: return std::format("LD F, V{:x}", x);
+            case Opcode::LoadBcd: return std::format("LD B, V{:x}", x);
+            case Opcode::LoadRegToMem: return std::format("LD [I], V{:x}", x);
+            case Opcode::LoadMemToReg: return std::format("LD V{:x}, [I]", x);
+            case Opcode::Unknown: break;
+        }
+        return std::format("DW 0x{:04x}", instruction.word);
+    }
+
+    /// @brief a program split into code & data by following its control flow (see analyze_program()), with the code
+    /// cut into basic blocks. For reading programs, & for deciding which ones a block translator can handle.
+    class Disassembly {
+    public:
+        struct Edge {
+            enum class Kind : uint8_t {
+                /// on to the next instruction, including coming back from a call
+                Fallthrough,
+                Jump,
+                /// a skip instruction skipping
+                Skip,
+                Call,
+            };
+
+            uint16_t to;
+            Kind kind;
+        };
+
+        /// @brief the instructions [start, end), entered only at start & left only after the last one
+        struct BasicBlock {
+            uint16_t start;
+            uint16_t end;
+            std::vector<Edge> successors;
+        };
+
+        /// @brief where an address is referenced from
+        struct Reference {
+            enum class Kind : uint8_t { Jump, Skip, Call, Load } kind;
+            uint16_t from;
+        };
+
+    private:
+        constexpr static uint16_t PROGRAM_STARTING_ADDRESS = 0x200;
+        constexpr static size_t MEMORY_SIZE = 4096;
+        // bytes per DB line in listings
+        constexpr static size_t DATA_ROW_SIZE = 8;
+
+        std::array<uint8_t, MEMORY_SIZE> memory = {};
+        size_t program_size;
+        ProgramAnalysis program_analysis;
+
+        // keyed by start address
+        std::map<uint16_t, BasicBlock> basic_blocks;
+        std::map<uint16_t, std::vector<Reference>> references;
+
+        Instruction instruction_at(uint16_t address) const {
+            return decode((this->memory[address] << 8) + this->memory[address + 1]);
+        }
+
+        void reference(uint16_t to, Reference::Kind kind, uint16_t from) {
+            this->references[to].push_back(Reference{ kind, from });
+        }
+
+        /// @brief successors of the instruction at `address` if it ends a block, or nullopt if the block may carry on
+        std::optional<std::vector<Edge>> exits(uint16_t address) const {
+            Instruction instruction = this->instruction_at(address);
+            std::vector<Edge> edges;
+            auto add = [&edges](size_t to, Edge::Kind kind){
+                if (to <= MEMORY_SIZE - 2)
+                    edges.push_back(Edge{ (uint16_t)to, kind });
+            };
+
+            switch (instruction.opcode) {
+                case Opcode::Jp:
+                    add(instruction.nnn(), Edge::Kind::Jump);
+                    return edges;
+                case Opcode::Call:
+                    add(instruction.nnn(), Edge::Kind::Call);
+                    add(address + 2, Edge::Kind::Fallthrough);
+                    return edges;
+                case Opcode::Ret: case Opcode::JumpReg0: case Opcode::Unknown:
+                    return edges;
+                default:
+                    if (!is_skip(instruction.opcode))
+                        return std::nullopt;
+                    add(address + 2, Edge::Kind::Fallthrough);
+                    add(address + 4, Edge::Kind::Skip);
+                    return edges;
+            }
+        }
+
+        void find_basic_blocks() {
+            const auto& reachable = this->program_analysis.instructions;
+
+            std::bitset<MEMORY_SIZE> leaders;
+            leaders[PROGRAM_STARTING_ADDRESS] = true;
+            for (size_t address = 0; address < MEMORY_SIZE - 1; address++) {
+                if (!reachable[address])
+                    continue;
+
+                Instruction instruction = this->instruction_at(address);
+                if (instruction.opcode == Opcode::LoadAddress)
+                    this->reference(instruction.nnn(), Reference::Kind::Load, address);
+
+                auto edges = this->exits(address);
+                if (!edges.has_value())
+                    continue;
+                for (const Edge& edge : edges.value()) {
+                    leaders[edge.to] = true;
+                    if (edge.kind == Edge::Kind::Jump)
+                        this->reference(edge.to, Reference::Kind::Jump, address);
+                    else if (edge.kind == Edge::Kind::Skip)
+                        this->reference(edge.to, Reference::Kind::Skip, address);
+                    else if (edge.kind == Edge::Kind::Call)
+                        this->reference(edge.to, Reference::Kind::Call, address);
+                }
+            }
+
+            for (size_t start = 0; start < MEMORY_SIZE - 1; start++) {
+                if (!reachable[start] || !leaders[start])
+                    continue;
+
+                uint16_t address = (uint16_t)start;
+                BasicBlock block{ address, address, {} };
+                while (true) {
+                    auto edges = this->exits(address);
+                    if (edges.has_value()) {
+                        block.successors = std::move(edges.value());
+                        block.end = address + 2;
+                        break;
+                    }
+
+                    size_t next = address + 2;
+                    if (next > MEMORY_SIZE - 2) {
+                        // runs off the end of memory
+                        block.end = next;
+                        break;
+                    } else if (leaders[next]) {
+                        block.successors.push_back(Edge{ (uint16_t)next, Edge::Kind::Fallthrough });
+                        block.end = next;
+                        break;
+                    }
+                    address = next;
+                }
+                this->basic_blocks[block.start] = std::move(block);
+            }
+        }
+
+        static std::string_view kind_name(Reference::Kind kind) {
+            switch (kind) {
+                case Reference::Kind::Jump: return "jump";
+                case Reference::Kind::Skip: return "skip";
+                case Reference::Kind::Call: return "call";
+                case Reference::Kind::Load: return "load";
+            }
+            return "";
+        }
+
+        std::string reference_comment(uint16_t address) const {
+            auto found = this->references.find(address);
+            if (found == this->references.end())
+                return "";
+
+            std::string comment = " ; <-";
+            for (const Reference& reference : found->second)
+                comment += std::format(" {} 0x{:03x}", kind_name(reference.kind), reference.from);
+            return comment;
+        }
+
+    public:
+        Disassembly(std::span<const uint8_t> program) : program_size(std::min(program.size(), MEMORY_SIZE - PROGRAM_STARTING_ADDRESS)) {
+            std::ranges::copy(BUILT_IN_FONT, this->memory.begin() + 0x100);
+            std::ranges::copy(program.first(this->program_size), this->memory.begin() + PROGRAM_STARTING_ADDRESS);
+            this->program_analysis = analyze_program(this->memory, this->program_size);
+            this->find_basic_blocks();
+        }
+
+        const ProgramAnalysis& analysis() const {
+            return this->program_analysis;
+        }
+
+        const std::map<uint16_t, BasicBlock>& blocks() const {
+            return this->basic_blocks;
+        }
+
+        /// @brief true if every path through the program can be known ahead of time: no indirect jumps, no code that
+        /// writes over itself, & nothing invalid. Otherwise a translator must fall back to interpreting.
+        bool is_statically_translatable() const {
+            return !this->program_analysis.has_indirect_jumps && !this->program_analysis.may_modify_code
+                && this->program_analysis.unknown_opcodes.empty() && this->program_analysis.out_of_bounds.empty();
+        }
+
+        /// @brief one line per instruction or row of data, with block boundaries & references marked
+        std::string listing() const {
+            std::string out;
+            size_t end = PROGRAM_STARTING_ADDRESS + this->program_size;
+            for (size_t address = PROGRAM_STARTING_ADDRESS; address < end;) {
+                if (this->program_analysis.instructions[address]) {
+                    if (this->basic_blocks.contains((uint16_t)address))
+                        out += std::format("\n0x{:03x}:", address) + this->reference_comment((uint16_t)address) + "\n";
+
+                    Instruction instruction = this->instruction_at((uint16_t)address);
+                    out += std::format("    0x{:03x}  {:04x}  {}\n", address, instruction.word, mnemonic(instruction));
+                    address += 2;
+                    continue;
+                }
+
+                // data runs until the next byte that's executed
+                size_t row_end = address;
+                while (row_end < end && row_end - address < DATA_ROW_SIZE && !this->program_analysis.code[row_end])
+                    row_end++;
+                if (row_end == address) {
+                    // the second half of an instruction that starts at an odd address
+                    address++;
+                    continue;
+                }
+
+                std::string comment = this->reference_comment((uint16_t)address);
+                out += std::format("    0x{:03x}  DB", address);
+                for (size_t i = address; i < row_end; i++)
+                    out += std::format(" 0x{:02x}{}", this->memory[i], i + 1 < row_end ? "," : "");
+                out += comment.empty() ? "\n" : std::format("  {}\n", comment);
+                address = row_end;
+            }
+            return out;
+        }
+
+        /// @brief the control flow graph in graphviz's DOT language: one node per basic block, calls dashed & skips
+        /// dotted
+        std::string dot(std::string_view name) const {
+            std::string out = std::format("digraph \"{}\" {{\n    node [shape=box fontname=monospace];\n", name);
+            for (const auto& [start, block] : this->basic_blocks) {
+                std::string label;
+                for (uint16_t address = block.start; address < block.end && address < MEMORY_SIZE - 1; address += 2)
+                    label += std::format("0x{:03x}  {}\\l", address, mnemonic(this->instruction_at(address)));
+                out += std::format("    b{:03x} [label=\"{}\"];\n", start, label);
+
+                for (const Edge& edge : block.successors) {
+                    std::string_view style = "";
+                    if (edge.kind == Edge::Kind::Call)
+                        style = " [style=dashed]";
+                    else if (edge.kind == Edge::Kind::Skip)
+                        style = " [style=dotted]";
+                    out += std::format("    b{:03x} -> b{:03x}{};\n", start, edge.to, style);
+                }
+            }
+            out += "}\n";
+            return out;
+        }
+    };
+}
+
+#endif
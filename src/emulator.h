@@ -2,19 +2,90 @@
 #define EMULATOR_H
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <optional>
 #include <random>
+#include <stop_token>
 #include <string>
+#include <thread>
 
 #include "types.h"
 #include "geblib.h"
 
+#include "analysis.h"
+#include "debugger.h"
+#include "decode.h"
 #include "device.h"
+#include "execution_controls.h"
+#include "font.h"
+#include "heatmap.h"
 #include "keyboard.h"
+#include "latency.h"
+#include "platform.h"
+#include "profiler.h"
+#include "program_file.h"
+#include "speaker.h"
 #include "timer.h"
 
 namespace Chip8 {
-    template<bool DEBUG = false>
+    /// @brief what a headless core was doing when its frame ended
+    enum class FrameStatus {
+        /// the frame executed all of its instructions
+        Running,
+        /// Fx0A is waiting for a key press. The program counter still points at the Fx0A.
+        WaitingForKey,
+        /// the program is spinning on the delay timer & will not change state until it expires
+        Idle,
+        /// the program jumped to itself & will never change state again
+        Halted,
+        /// the attached debugger stopped the core before the instruction at the program counter. The timers haven't
+        /// ticked: running the next frame finishes this one from there first.
+        Breakpoint,
+    };
+
+    /// @brief why block_run() returned
+    enum class StopReason {
+        /// the program jumped to itself & will never change state again
+        Halted,
+        /// the window was closed
+        Quit,
+        /// the embedder requested a stop through the stop token
+        Stopped,
+    };
+
+    template<bool DEBUG = false, typename Platform = Platforms::SDL3>
     class Emulator {
+    public:
+        // roughly 700 instructions per second, which most programs are written against
+        constexpr static size_t DEFAULT_INSTRUCTIONS_PER_FRAME = 12;
+        constexpr static double MIN_SPEED_MULTIPLIER = 0.25;
+
+        /// @brief everything a headless core needs to carry on exactly where it was. About 4.5 KiB.
+        struct Snapshot {
+            std::array<uint8_t, 4096> memory;
+            std::array<uint64_t, SCREEN_HEIGHT> display;
+            std::array<uint16_t, 16> stack_frames;
+            std::array<uint8_t, 16> gp_registers;
+            uint16_t program_counter;
+            uint16_t i_register;
+            uint8_t stack_pointer;
+            uint8_t sound_timer;
+            uint8_t delay_timer;
+            typename Platform::Keyboard keyboard;
+            std::default_random_engine prng_engine;
+            bool is_waiting_for_key;
+            size_t frames_elapsed;
+            size_t frame_instruction;
+            uint64_t instructions_executed;
+            uint16_t idle_probe_address;
+            bool idle_probe_clean;
+            bool idle_probe_waits_for_zero;
+        };
+
     private:
         static const uint16_t BUILT_IN_CHAR_STARTING_ADDRESS = 0x100;
         static const uint16_t PROGRAM_STARTING_ADDRESS = 0x200;
@@ -22,24 +93,25 @@ namespace Chip8 {
         static const size_t INSTRUCTION_SIZE = 2;
         static const uint8_t SPRITE_WIDTH = 8;
 
-        Device device;
-        Keyboard keyboard;
+        // before the device, whose speaker reads the sound timer from its own thread as soon as it opens
+        typename Platform::Timer sound_timer;
+        typename Platform::Timer delay_timer;
 
-        Timer60hz sound_timer;
-        Timer60hz delay_timer;
+        typename Platform::Device device;
+        typename Platform::Keyboard keyboard;
 
-        std::array<uint8_t, 4096> memory;
+        std::array<uint8_t, 4096> memory = {};
 
         uint16_t program_counter = PROGRAM_STARTING_ADDRESS;
 
         // store the address the interpreter should return to after a subroutine
-        std::array<uint16_t, 16> stack_frames;
+        std::array<uint16_t, 16> stack_frames = {};
         // points at the largest unused stack frame
         // TODO: what happens if we call a 17th function?
         uint8_t stack_pointer = 0;
 
         static const size_t NUM_GP_REGISTERS = 16;
-        std::array<uint8_t, NUM_GP_REGISTERS> gp_registers;
+        std::array<uint8_t, NUM_GP_REGISTERS> gp_registers = {};
 
         uint16_t i_register = 0;
 
@@ -48,7 +120,70 @@ namespace Chip8 {
         std::default_random_engine prng_engine;
         std::uniform_int_distribution<unsigned int> random_u8_dist;
 
-        bool continue_executing_instructions = false;
+        // the execution worker's interrupt token, so that blocking instructions can give up when asked to
+        std::stop_token execution_stop_token;
+
+        // set by fx0a on headless platforms when there is no key press to consume yet
+        bool is_waiting_for_key = false;
+
+        // every instruction evaluated, including fx0a re-running while it waits. Replays count in these.
+        uint64_t executed_instructions = 0;
+        // set while replaying, so that sinks don't hear about the same events twice
+        bool is_replaying = false;
+
+        // headless cores keep virtual time: whole frames elapsed, plus how far into the current frame we are
+        size_t frames_elapsed = 0;
+        size_t frame_instruction = 0;
+        size_t frame_instructions = DEFAULT_INSTRUCTIONS_PER_FRAME;
+        // frames run speculatively past each real one, to present what the current input leads to. See set_run_ahead().
+        size_t run_ahead_frames = 0;
+
+        // interactive cores keep wall clock time
+        std::chrono::steady_clock::time_point started_at = std::chrono::steady_clock::now();
+
+        std::vector<SoundSink*> sound_sinks;
+
+        // delay loop detection: the address of the last fx07, and whether only branches have run since then
+        uint16_t idle_probe_address = 0;
+        bool idle_probe_clean = false;
+        // whether those branches only compared the timer's register against 0, so the loop can't end before it expires
+        bool idle_probe_waits_for_zero = false;
+        // true when the delay loop that ended the last frame provably runs until the timer expires, see idle_frames()
+        bool is_waiting_for_zero = false;
+
+        // what the loaded program can do, & the memory it was worked out from so that reloading the same program is free
+        ProgramAnalysis program_analysis;
+        std::array<uint8_t, 4096> analyzed_memory = {};
+        size_t analyzed_program_size = 0;
+        // call & ret skip their stack checks while set. Cleared by anything that moves the machine off the paths the
+        // analysis followed.
+        bool is_stack_proven = false;
+
+        // checked before every instruction when attached, see attach_debugger()
+        Debugger* debugger = nullptr;
+        // counts memory accesses when attached, see attach_heatmap()
+        MemoryHeatmap* heatmap = nullptr;
+        // measures a sample of instructions when attached, see attach_profiler()
+        OpcodeProfiler* profiler = nullptr;
+        // follows key events to the screen when attached, see attach_latency_probe()
+        LatencyProbe* latency_probe = nullptr;
+
+        // loaded by the worker between instructions, guarded by the controls' lock
+        std::optional<std::vector<uint8_t>> next_program;
+
+        // 0 runs as fast as the host allows
+        std::atomic<size_t> instructions_per_second = 0;
+        // scales both instructions_per_second & the timers. Infinity runs uncapped. Applied by the worker, which
+        // owns the timers, between batches.
+        std::atomic<double> speed_multiplier = 1.0;
+        double applied_speed_multiplier = 1.0;
+
+        // the persistent execution worker, see work(). Declared last so that it is joined before anything it touches is
+        // destroyed.
+        ExecutionControls controls{ [this](std::stop_token worker_stop_token){
+            if constexpr (!Platform::IS_HEADLESS)
+                this->work(worker_stop_token);
+        } };
 
         #pragma region Instructions
 
@@ -59,14 +194,14 @@ namespace Chip8 {
 
         // 00e0
         void cls() {
-            std::ranges::fill(this->device.display.buffer, false);
+            this->device.display.buffer.clear();
             this->device.display.render_buffer();
             this->program_counter += INSTRUCTION_SIZE;
         }
 
         // 00ee
         void ret() {
-            if (this->stack_pointer == 0)
+            if (!this->is_stack_proven && this->stack_pointer == 0)
                 throw std::runtime_error("cannot RET when stack is empty");
 
             if (DEBUG)
@@ -84,12 +219,14 @@ namespace Chip8 {
 
         // 2xxx
         void call(uint16_t target_address) {
-            if (this->stack_pointer > 15)
-                throw std::runtime_error("cannot CALL when stack is full (stack overflow!)");
-            else if (target_address >= this->memory.size() - 1)
-                // TODO: static analysis
-                throw std::runtime_error(std::format("call address=0x{:x} outside of working memory area", target_address));
-                
+            // analyze_loaded_program() rules both of these out for most programs
+            if (!this->is_stack_proven) {
+                if (this->stack_pointer > 15)
+                    throw std::runtime_error("cannot CALL when stack is full (stack overflow!)");
+                else if (target_address >= this->memory.size() - 1)
+                    throw std::runtime_error(std::format("call address=0x{:x} outside of working memory area", target_address));
+            }
+
             this->stack_frames[this->stack_pointer] = this->program_counter + INSTRUCTION_SIZE;
             this->stack_pointer += 1;
             this->program_counter = target_address;
@@ -229,48 +366,41 @@ namespace Chip8 {
 
         // dxyz
         void draw_sprite(u4 reg_x, u4 reg_y, u4 value) {
-            // assume no pixels are modified, unless we observe it
-            this->gp_registers[0xf] = 0;
-
             // upper left position
             uint8_t ul_xpos = this->gp_registers[reg_x];
             uint8_t ul_ypos = this->gp_registers[reg_y];
-            for (size_t row_i = 0; row_i < value; row_i++) {
-                uint8_t row = this->memory[i_register + row_i];
-                for (size_t bit_i = 0; bit_i < SPRITE_WIDTH; bit_i++) {
-                    // sprites wrap around the display
-                    auto xpos = (ul_xpos + bit_i) % SCREEN_WIDTH;
-                    auto ypos = (ul_ypos + row_i) % SCREEN_HEIGHT;
-                    
-                    bool before = this->device.display.buffer[xpos + ypos * SCREEN_WIDTH];
-                    bool after = (
-                        this->device.display.buffer[xpos + ypos * SCREEN_WIDTH] ^= ((row & (0x80 >> bit_i)) != 0)
-                    );
-                    if (before && !after)
-                        this->gp_registers[0xf] = 1;
-                }
-            }
+
+            // each row is a whole word, so the sprite is xor'd in one go & collisions fall out of the same ops
+            this->count_access(MemoryHeatmap::Stream::SpriteRead, this->i_register, value);
+            // fx1e can leave I anywhere up to 0xffff, so the rows wrap around memory
+            std::array<uint8_t, 15> sprite;
+            for (size_t row_i = 0; row_i < value; row_i++)
+                sprite[row_i] = this->memory[(this->i_register + row_i) % this->memory.size()];
+            this->gp_registers[0xf] = this->device.display.buffer.draw_sprite(
+                ul_xpos, ul_ypos, std::span<const uint8_t>(sprite.data(), value)
+            );
 
             if (DEBUG) {
                 std::cout << "NEW DISPLAY STATE" << std::endl;
                 for (size_t y = 0; y < SCREEN_HEIGHT; y++) {
                     for (size_t x = 0; x < SCREEN_WIDTH; x++) {
-                        std::cout << this->device.display.buffer[y * SCREEN_WIDTH + x];
+                        std::cout << this->device.display.buffer.pixel(x, y);
                     }
                     std::cout << std::endl;
                 }
             }
 
-            // TODO: is there a fancy way to do this & the 0xf register thingy using only a single thread (& std::transform or similar)?
-
-            this->device.display.render_buffer();
+            this->device.display.render_buffer(true);
             this->program_counter += INSTRUCTION_SIZE;
         }
 
         // ex9e
         void skip_if_key_press(u4 reg) {
             auto key = static_cast<Key>(this->gp_registers[reg] % 16);
-            if (this->keyboard.is_key_pressed(key)) {
+            bool is_pressed = this->keyboard.is_key_pressed(key);
+            if (this->latency_probe != nullptr)
+                this->latency_probe->on_key_read(key, is_pressed);
+            if (is_pressed) {
                 this->program_counter += 2 * INSTRUCTION_SIZE;
             } else {
                 this->program_counter += INSTRUCTION_SIZE;
@@ -280,7 +410,10 @@ namespace Chip8 {
         // exa1
         void skip_if_not_key_press(u4 reg) {
             auto key = static_cast<Key>(this->gp_registers[reg] % 16);
-            if (!this->keyboard.is_key_pressed(key)) {
+            bool is_pressed = this->keyboard.is_key_pressed(key);
+            if (this->latency_probe != nullptr)
+                this->latency_probe->on_key_read(key, is_pressed);
+            if (!is_pressed) {
                 this->program_counter += 2 * INSTRUCTION_SIZE;
             } else {
                 this->program_counter += INSTRUCTION_SIZE;
@@ -295,8 +428,23 @@ namespace Chip8 {
 
         // fx0a
         void load_from_next_keypress(u4 reg) {
-            auto key = this->keyboard.block_until_next_keypress();
-            this->gp_registers[reg] = key;
+            if constexpr (Platform::IS_HEADLESS) {
+                // never block a headless core; re-run this instruction next frame instead
+                auto key = this->keyboard.next_keypress();
+                if (!key.has_value()) {
+                    this->is_waiting_for_key = true;
+                    return;
+                }
+                this->gp_registers[reg] = key.value();
+            } else {
+                auto key = this->keyboard.block_until_next_keypress(this->execution_stop_token);
+                if (!key.has_value())
+                    // stopping. Leave the program counter on fx0a
+                    return;
+                if (this->latency_probe != nullptr)
+                    this->latency_probe->on_key_read(key.value(), true);
+                this->gp_registers[reg] = key.value();
+            }
             this->program_counter += INSTRUCTION_SIZE;
         }
 
@@ -309,12 +457,18 @@ namespace Chip8 {
         // fx18
         void set_sound(u4 reg) {
             this->sound_timer.set(this->gp_registers[reg]);
+            if (!this->sound_sinks.empty() && !this->is_replaying) {
+                double now = this->clock_seconds();
+                for (SoundSink* sink : this->sound_sinks)
+                    sink->on_sound_timer_set(now, this->gp_registers[reg]);
+            }
             this->program_counter += INSTRUCTION_SIZE;
         }
 
         // fx1e
         void increment_i_reg(u4 reg) {
             this->i_register += this->gp_registers[reg];
+            this->count_access(MemoryHeatmap::Stream::IWalk, this->i_register);
             this->program_counter += INSTRUCTION_SIZE;
         }
 
@@ -337,6 +491,9 @@ namespace Chip8 {
 
             // i_register should behave like a normal u16, except that it fails when trying to write or read to invalid memory locations
             // TODO: ensure these checks happen everywhere
+            if (this->debugger != nullptr)
+                this->debugger->note_write(i_register, 3);
+            this->count_access(MemoryHeatmap::Stream::Write, this->i_register, 3);
             this->memory[i_register] = this->gp_registers[reg] % 10;
             this->memory[i_register+1] = (this->gp_registers[reg] % 100 - this->gp_registers[reg] % 10) / 10;
             this->memory[i_register+2] = (this->gp_registers[reg] - this->gp_registers[reg] % 100) / 100;
@@ -346,10 +503,12 @@ namespace Chip8 {
 
         // fx55
         void load_reg_to_mem(u4 reg_final) {
-            // TODO: should I check whether the memory locations are all valid? yes
-            // TODO: how to get ++ or += 1 to work w/ u4?
-            for (u4 i = 0; i <= reg_final; i++) {
-                this->memory[i_register+i] = this->gp_registers[i];
+            if (this->debugger != nullptr)
+                this->debugger->note_write(i_register, reg_final + 1);
+            this->count_access(MemoryHeatmap::Stream::Write, this->i_register, reg_final + 1);
+            // a u4 counter would wrap back to 0 before passing VF, so count with size_t
+            for (size_t i = 0; i <= reg_final; i++) {
+                this->memory[(i_register + i) % this->memory.size()] = this->gp_registers[i];
             }
             this->program_counter += INSTRUCTION_SIZE;
         }
@@ -359,282 +518,779 @@ namespace Chip8 {
             if (reg_final > 15)
                 throw std::runtime_error("invalid register number");
 
-            // TODO: should I check whether the memory locations are all valid? yes
-            for (u4 i = 0; i <= reg_final; i++) {
-                this->gp_registers[i] = this->memory[i_register+i];
+            this->count_access(MemoryHeatmap::Stream::Read, this->i_register, reg_final + 1);
+            // a u4 counter would wrap back to 0 before passing VF, so count with size_t
+            for (size_t i = 0; i <= reg_final; i++) {
+                this->gp_registers[i] = this->memory[(i_register + i) % this->memory.size()];
             }
             this->program_counter += INSTRUCTION_SIZE;
         }
 
         #pragma endregion Instructions
 
+        void count_access(MemoryHeatmap::Stream stream, uint16_t address, size_t size = 1) {
+            // replays repeat accesses that were already counted
+            if (this->heatmap != nullptr && !this->is_replaying)
+                this->heatmap->count(stream, address, size);
+        }
+
+        uint16_t fetch() {
+            this->count_access(MemoryHeatmap::Stream::Fetch, this->program_counter, INSTRUCTION_SIZE);
+            return (this->memory[this->program_counter] << 8) + this->memory[this->program_counter + 1];
+        }
+
         /// @brief returns true if the program is in an infinite loop and will never change state. Only guaranteed to
         /// find easy examples, like jumping to the current address. 
-        bool evaluate_instruction(uint16_t instruction) {
-            using GebLib::get_nibble;
-
-            if (instruction == 0x00e0) {
-                this->cls();
-            } else if (instruction == 0x00ee) {
-                this->ret();
-            } else if ((instruction & 0xf000) == 0x0000) {
-                this->sys(instruction & 0x0fff);
-            } else if ((instruction & 0xf000) == 0x1000) {
-                uint16_t target_address = instruction & 0x0fff;
-                if (target_address == this->program_counter) {
-                    this->jp(target_address);
+        bool evaluate_instruction(uint16_t word) {
+            Instruction instruction = decode(word);
+            // replayed & speculative instructions aren't part of the real run
+            if (this->profiler == nullptr || this->is_replaying || !this->profiler->should_sample())
+                return this->execute(instruction);
+
+            auto start = this->profiler->read();
+            bool is_halting = this->execute(instruction);
+            this->profiler->record(instruction.opcode, start);
+            return is_halting;
+        }
+
+        bool execute(Instruction instruction) {
+            switch (instruction.opcode) {
+                case Opcode::Cls: this->cls(); break;
+                case Opcode::Ret: this->ret(); break;
+                case Opcode::Sys: this->sys(instruction.nnn()); break;
+                case Opcode::Jp: {
+                    bool is_halting = instruction.nnn() == this->program_counter;
+                    this->jp(instruction.nnn());
+                    return is_halting;
+                }
+                case Opcode::Call: this->call(instruction.nnn()); break;
+                case Opcode::SkipEqual: this->skip_equal(instruction.x(), instruction.kk()); break;
+                case Opcode::SkipNotEqual: this->skip_not_equal(instruction.x(), instruction.kk()); break;
+                case Opcode::SkipEqualReg: this->skip_equal_reg(instruction.x(), instruction.y()); break;
+                case Opcode::Load: this->load(instruction.x(), instruction.kk()); break;
+                case Opcode::Add: this->add(instruction.x(), instruction.kk()); break;
+                case Opcode::LoadReg: this->load_reg(instruction.x(), instruction.y()); break;
+                case Opcode::Or: this->bitwise_or(instruction.x(), instruction.y()); break;
+                case Opcode::And: this->bitwise_and(instruction.x(), instruction.y()); break;
+                case Opcode::Xor: this->bitwise_xor(instruction.x(), instruction.y()); break;
+                case Opcode::CarryAddReg: this->carry_add_reg(instruction.x(), instruction.y()); break;
+                case Opcode::CarrySubReg: this->carry_sub_reg(instruction.x(), instruction.y()); break;
+                case Opcode::ShiftRight: this->shift_right(instruction.x()); break;
+                case Opcode::SubtractReversed: this->subtract_reversed(instruction.x(), instruction.y()); break;
+                case Opcode::ShiftLeft: this->shift_left(instruction.x()); break;
+                case Opcode::SkipNotEqualReg: this->skip_not_equal_reg(instruction.x(), instruction.y()); break;
+                case Opcode::LoadAddress: this->load_address(instruction.nnn()); break;
+                case Opcode::JumpReg0: this->jump_reg0(instruction.nnn()); break;
+                case Opcode::RandomInt: this->random_int(instruction.x(), instruction.kk()); break;
+                case Opcode::DrawSprite: this->draw_sprite(instruction.x(), instruction.y(), instruction.n()); break;
+                case Opcode::SkipIfKeyPress: this->skip_if_key_press(instruction.x()); break;
+                case Opcode::SkipIfNotKeyPress: this->skip_if_not_key_press(instruction.x()); break;
+                case Opcode::LoadFromDelayTimer: this->load_from_delay_timer(instruction.x()); break;
+                case Opcode::LoadFromNextKeypress: this->load_from_next_keypress(instruction.x()); break;
+                case Opcode::SetDelay: this->set_delay(instruction.x()); break;
+                case Opcode::SetSound: this->set_sound(instruction.x()); break;
+                case Opcode::IncrementIReg: this->increment_i_reg(instruction.x()); break;
+                case Opcode::LoadSprite: this->load_sprite(instruction.x()); break;
+                case Opcode::LoadBcd: this->load_bcd(instruction.x()); break;
+                case Opcode::LoadRegToMem: this->load_reg_to_mem(instruction.x()); break;
+                case Opcode::LoadMemToReg: this->load_mem_to_reg(instruction.x()); break;
+                case Opcode::Unknown:
+                    std::cerr << std::format("Hit unknown instruction: {:x}", instruction.word) << std::endl;
+                    throw std::runtime_error("Hit unknown instruction");
+            }
+            return false;
+        }
+
+        /// @brief works out what the program just loaded can do, unless it's the one already worked out
+        void analyze_loaded_program(size_t program_size) {
+            if (program_size != this->analyzed_program_size || this->memory != this->analyzed_memory) {
+                this->program_analysis = analyze_program(this->memory, program_size);
+                this->analyzed_memory = this->memory;
+                this->analyzed_program_size = program_size;
+            }
+            // the analysis starts from power-on
+            this->is_stack_proven = this->program_analysis.is_stack_safe()
+                && this->program_counter == PROGRAM_STARTING_ADDRESS && this->stack_pointer == 0;
+        }
+
+        /// @brief returns true if the instruction can only move the program counter, based on registers
+        static bool is_pure_branch(uint16_t instruction) {
+            switch (instruction & 0xf000) {
+                case 0x1000: case 0x3000: case 0x4000: case 0xb000:
                     return true;
-                } else {
-                    this->jp(target_address);
+                case 0x5000: case 0x9000:
+                    return (instruction & 0x000f) == 0;
+                default:
                     return false;
-                }
-            } else if ((instruction & 0xf000) == 0x2000) {
-                this->call(instruction & 0x0fff);
-            } else if ((instruction & 0xf000) == 0x3000) {
-                u4 x = get_nibble(instruction, 1);
-                uint8_t y = instruction & 0x00ff;
-                this->skip_equal(x, y);
-            } else if ((instruction & 0xf000) == 0x4000) {
-                u4 x = get_nibble(instruction, 1);
-                uint8_t y = instruction & 0x00ff;
-                this->skip_not_equal(x, y);
-            } else if ((instruction & 0xf00f) == 0x5000) {
-                u4 x = get_nibble(instruction, 1);
-                u4 y = get_nibble(instruction, 2);
-                this->skip_equal_reg(x, y);
-            } else if ((instruction & 0xf000) == 0x6000) {
-                u4 x = get_nibble(instruction, 1);
-                uint8_t y = instruction & 0x00ff;
-                this->load(x, y);
-            } else if ((instruction & 0xf000) == 0x7000) {
-                u4 x = get_nibble(instruction, 1);
-                uint8_t y = instruction & 0x00ff;
-                this->add(x, y);
-            } else if ((instruction & 0xf00f) == 0x8000) {
-                u4 x = get_nibble(instruction, 1);
-                u4 y = get_nibble(instruction, 2);
-                this->load_reg(x, y);
-            } else if ((instruction & 0xf00f) == 0x8001) {
-                u4 x = get_nibble(instruction, 1);
-                u4 y = get_nibble(instruction, 2);
-                this->bitwise_or(x, y);
-            } else if ((instruction & 0xf00f) == 0x8002) {
-                u4 x = get_nibble(instruction, 1);
-                u4 y = get_nibble(instruction, 2);
-                this->bitwise_and(x, y);
-            } else if ((instruction & 0xf00f) == 0x8003) {
-                u4 x = get_nibble(instruction, 1);
-                u4 y = get_nibble(instruction, 2);
-                this->bitwise_xor(x, y);
-            } else if ((instruction & 0xf00f) == 0x8004) {
-                u4 x = get_nibble(instruction, 1);
-                u4 y = get_nibble(instruction, 2);
-                this->carry_add_reg(x, y);
-            } else if ((instruction & 0xf00f) == 0x8005) {
-                u4 x = get_nibble(instruction, 1);
-                u4 y = get_nibble(instruction, 2);
-                this->carry_sub_reg(x, y);
-            } else if ((instruction & 0xf00f) == 0x8006) {
-                u4 x = get_nibble(instruction, 1);
-                this->shift_right(x);
-            } else if ((instruction & 0xf00f) == 0x8007) {
-                u4 x = get_nibble(instruction, 1);
-                u4 y = get_nibble(instruction, 2);
-                this->subtract_reversed(x, y);
-            } else if ((instruction & 0xf00f) == 0x800e) {
-                u4 x = get_nibble(instruction, 1);
-                this->shift_left(x);
-            } else if ((instruction & 0xf00f) == 0x9000) {
-                u4 x = get_nibble(instruction, 1);
-                u4 y = get_nibble(instruction, 2);
-                this->skip_not_equal_reg(x, y);
-            } else if ((instruction & 0xf000) == 0xa000) {
-                this->load_address(instruction & 0x0fff);
-            } else if ((instruction & 0xf000) == 0xb000) {
-                this->jump_reg0(instruction & 0x0fff);
-            } else if ((instruction & 0xf000) == 0xc000) {
-                u4 x = get_nibble(instruction, 1);
-                uint8_t y = instruction & 0x00ff;
-                this->random_int(x, y);
-            } else if ((instruction & 0xf000) == 0xd000) {
-                u4 x = get_nibble(instruction, 1);
-                u4 y = get_nibble(instruction, 2);
-                u4 z = get_nibble(instruction, 3);
-                this->draw_sprite(x, y, z);
-            } else if ((instruction & 0xf0ff) == 0xe09e) {
-                u4 x = get_nibble(instruction, 1);
-                this->skip_if_key_press(x);
-            } else if ((instruction & 0xf0ff) == 0xe0a1) {
-                u4 x = get_nibble(instruction, 1);
-                this->skip_if_not_key_press(x);
-            } else if ((instruction & 0xf0ff) == 0xf007) {
-                u4 x = get_nibble(instruction, 1);
-                this->load_from_delay_timer(x);
-            } else if ((instruction & 0xf0ff) == 0xf00a) {
-                u4 x = get_nibble(instruction, 1);
-                this->load_from_next_keypress(x);
-            } else if ((instruction & 0xf0ff) == 0xf015) {
-                u4 x = get_nibble(instruction, 1);
-                this->set_delay(x);
-            } else if ((instruction & 0xf0ff) == 0xf018) {
-                u4 x = get_nibble(instruction, 1);
-                this->set_sound(x);
-            } else if ((instruction & 0xf0ff) == 0xf01e) {
-                u4 x = get_nibble(instruction, 1);
-                this->increment_i_reg(x);
-            } else if ((instruction & 0xf0ff) == 0xf029) {
-                u4 x = get_nibble(instruction, 1);
-                this->load_sprite(x);
-            } else if ((instruction & 0xf0ff) == 0xf033) {
-                u4 x = get_nibble(instruction, 1);
-                this->load_bcd(x);
-            } else if ((instruction & 0xf0ff) == 0xf055) {
-                u4 x = get_nibble(instruction, 1);
-                this->load_reg_to_mem(x);
-            } else if ((instruction & 0xf0ff) == 0xf065) {
-                u4 x = get_nibble(instruction, 1);
-                this->load_mem_to_reg(x);
+            }
+        }
+
+        /// @brief returns true if the branch takes the same way for every non-zero value of `reg`
+        static bool compares_against_zero(uint16_t instruction, u4 reg) {
+            size_t x = (instruction >> 8) & 0xf;
+            size_t y = (instruction >> 4) & 0xf;
+            switch (instruction & 0xf000) {
+                case 0x3000: case 0x4000:
+                    return x != reg || (instruction & 0x00ff) == 0;
+                case 0x5000: case 0x9000:
+                    return x != reg && y != reg;
+                case 0xb000:
+                    return reg != 0;
+                default:
+                    return true;
+            }
+        }
+
+        /// @brief returns true once the program has come back around to the same fx07 having only branched in
+        /// between, while the delay timer is still running. Such a loop cannot change state until the timer next
+        /// ticks, so the rest of the frame can be skipped. is_waiting_for_zero is also set if the branches only compared
+        /// the timer against 0, in which case nothing changes until it expires.
+        bool is_delay_loop(uint16_t instruction, uint16_t address) {
+            if ((instruction & 0xf0ff) == 0xf007) {
+                bool is_loop = this->idle_probe_clean && this->idle_probe_address == address;
+                this->is_waiting_for_zero = is_loop && this->idle_probe_waits_for_zero;
+                this->idle_probe_address = address;
+                this->idle_probe_clean = true;
+                this->idle_probe_waits_for_zero = true;
+                return is_loop && this->delay_timer.value() != 0;
+            } else if (!is_pure_branch(instruction)) {
+                this->idle_probe_clean = false;
             } else {
-                std::cerr << std::format("Hit unknown instruction: {:x}", instruction) << std::endl;
-                throw std::runtime_error("Hit unknown instruction");
+                // the register the fx07 loads the timer into
+                u4 timer_reg = this->memory[this->idle_probe_address];
+                if (!compares_against_zero(instruction, timer_reg))
+                    this->idle_probe_waits_for_zero = false;
             }
             return false;
         }
 
+        void resync_debugger() {
+            if (this->debugger != nullptr)
+                this->debugger->resync(this->machine_state());
+        }
+
+        /// @returns true if the attached debugger wants to stop before the next instruction
+        bool should_stop_for_debugger() {
+            return this->debugger != nullptr
+                && this->debugger->wants_check(this->program_counter)
+                && this->debugger->check(this->machine_state()).has_value();
+        }
+
+        void change_speed_multiplier(double multiplier) requires (!Platform::IS_HEADLESS) {
+            this->speed_multiplier = multiplier;
+            this->controls.interrupt();
+        }
+
+        /// @brief brings the timers & speaker in line with speed_multiplier. Only called by the worker.
+        void apply_speed_multiplier() requires (!Platform::IS_HEADLESS) {
+            double multiplier = this->speed_multiplier;
+            // uncapped, wall time means nothing, so the timers follow the instructions instead
+            double timer_rate = std::isinf(multiplier) ? 0.0 : multiplier;
+            this->sound_timer.set_rate(timer_rate);
+            this->delay_timer.set_rate(timer_rate);
+            // a sped up tone is just noise
+            this->device.speaker.set_muted(multiplier > 1.0);
+            this->applied_speed_multiplier = multiplier;
+        }
+
+        /// @brief while uncapped, counts the guest time `instructions` would take at the requested speed, or at the
+        /// usual headless speed if none was requested
+        void advance_uncapped_timers(uint64_t instructions) requires (!Platform::IS_HEADLESS) {
+            size_t speed = this->instructions_per_second;
+            if (speed == 0)
+                speed = DEFAULT_INSTRUCTIONS_PER_FRAME * 60;
+            auto duration = std::chrono::microseconds((int64_t)(instructions * 1'000'000 / speed));
+            this->sound_timer.advance(duration);
+            this->delay_timer.advance(duration);
+        }
+
+        /// @brief sleeps off however far execution has run ahead of the requested speed. Wakes early when interrupted.
+        void pace(std::chrono::steady_clock::time_point& next_instruction_at) {
+            double speed = (double)this->instructions_per_second * this->applied_speed_multiplier;
+            if (speed == 0 || std::isinf(speed))
+                return;
+
+            auto now = std::chrono::steady_clock::now();
+            // don't race to catch up on time spent paused or blocked on fx0a
+            if (now - next_instruction_at > std::chrono::milliseconds(50))
+                next_instruction_at = now;
+            next_instruction_at += std::chrono::nanoseconds((int64_t)(1e9 / speed));
+
+            // sleeping less than a millisecond at a time isn't accurate enough to bother
+            if (next_instruction_at - now > std::chrono::milliseconds(1))
+                this->controls.sleep_until(this->execution_stop_token, next_instruction_at);
+        }
+
+        /// @brief the body of run_frame(), without telling sinks. Skips the debugger while replaying. A frame the
+        /// debugger stopped partway through is carried on from frame_instruction, & only then are the timers ticked.
+        FrameStatus execute_frame(size_t instructions) requires Platform::IS_HEADLESS {
+            FrameStatus status = FrameStatus::Running;
+            this->is_waiting_for_key = false;
+            this->frame_instructions = std::max<size_t>(instructions, 1);
+
+            for (size_t i = this->frame_instruction; i < instructions; i++) {
+                this->frame_instruction = i;
+                if (!this->is_replaying && this->should_stop_for_debugger()) {
+                    this->debugger->notify_stopped(this->debugger->last_hit().value());
+                    return FrameStatus::Breakpoint;
+                }
+
+                uint16_t address = this->program_counter;
+                uint16_t instruction = this->fetch();
+
+                this->executed_instructions += 1;
+                if (this->evaluate_instruction(instruction)) {
+                    status = FrameStatus::Halted;
+                    break;
+                } else if (this->is_waiting_for_key) {
+                    status = FrameStatus::WaitingForKey;
+                    break;
+                } else if (this->is_delay_loop(instruction, address)) {
+                    status = FrameStatus::Idle;
+                    break;
+                }
+            }
+
+            this->advance_timers(1);
+            return status;
+        }
+
+        /// @brief the persistent execution thread. Started by the first control call that needs it & kept until the
+        /// emulator is destroyed, so that pausing or switching programs never tears down the window, audio, or threads.
+        void work(std::stop_token worker_stop_token) {
+            auto next_instruction_at = std::chrono::steady_clock::now();
+
+            auto has_next_program = [this](){ return this->next_program.has_value(); };
+            auto load_next_program = [this](){
+                this->reload(this->next_program.value());
+                this->next_program.reset();
+            };
+            while (auto batch = this->controls.next_batch(worker_stop_token, {}, has_next_program, load_next_program)) {
+                // large enough that the lock is rare, small enough that speed changes apply quickly
+                size_t batch_size = batch->is_step ? 1 : 256;
+                this->execution_stop_token = batch->interrupt_token;
+
+                if (this->speed_multiplier != this->applied_speed_multiplier)
+                    this->apply_speed_multiplier();
+                uint64_t batch_start = this->executed_instructions;
+
+                try {
+                    for (size_t i = 0; i < batch_size && !this->execution_stop_token.stop_requested(); i++) {
+                        if (DEBUG) {
+                            // TODO: make the string concats all atomic so we don't get weird ordering issues
+                            std::cout << "program_counter = " << std::format("{:x}", program_counter) << std::endl;
+                            std::cout << "i_register = " << std::format("{:x}", i_register) << std::endl;
+                            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                        }
+
+                        if (this->should_stop_for_debugger()) {
+                            this->controls.stop_for_debugger();
+                            this->debugger->notify_stopped(this->debugger->last_hit().value());
+                            break;
+                        }
+
+                        this->executed_instructions += 1;
+                        // TODO: can we increment the program_counter by 2 bytes before even entering the evaluate_instruction?
+                        // if so, is it equivalent? we'd save a lot of LoC for sure
+                        bool should_end_execution = this->evaluate_instruction(this->fetch());
+                        if (should_end_execution) {
+                            this->controls.halt();
+                            break;
+                        }
+
+                        this->pace(next_instruction_at);
+                    }
+                } catch (...) {
+                    this->controls.fault(std::current_exception());
+                }
+
+                if (std::isinf(this->applied_speed_multiplier))
+                    this->advance_uncapped_timers(this->executed_instructions - batch_start);
+            }
+        }
+
     public:
         Emulator() : device(sound_timer), prng_engine(rand_dev()), random_u8_dist(0, 255) {
             sound_timer.set(0);
             delay_timer.set(0);
 
-            using Sprite = std::array<uint8_t, 5>;
-            std::vector<Sprite> data = {
-                {0xf0, 0x90, 0x90, 0x90, 0xf0},
-                {0x20, 0x60, 0x20, 0x20, 0x70},
-                {0xf0, 0x10, 0xf0, 0x80, 0xf0},
-                {0xf0, 0x10, 0xf0, 0x10, 0xf0},
-                {0x90, 0x90, 0xf0, 0x10, 0x10},
-                {0xf0, 0x80, 0xf0, 0x10, 0xf0},
-                {0xf0, 0x80, 0xf0, 0x90, 0xf0},
-                {0xf0, 0x10, 0x20, 0x40, 0x40},
-                {0xf0, 0x90, 0xf0, 0x90, 0xf0},
-                {0xf0, 0x90, 0xf0, 0x10, 0xf0},
-                {0xf0, 0x90, 0xf0, 0x90, 0x90},
-                {0xe0, 0x90, 0xe0, 0x90, 0xe0},
-                {0xf0, 0x80, 0x80, 0x80, 0xf0},
-                {0xe0, 0x90, 0x90, 0x90, 0xe0},
-                {0xf0, 0x80, 0xf0, 0x80, 0xf0},
-                {0xf0, 0x80, 0xf0, 0x80, 0x80}
+            std::memcpy(this->memory.data() + BUILT_IN_CHAR_STARTING_ADDRESS, BUILT_IN_FONT.data(), BUILT_IN_FONT.size());
+        }
+
+        /// @brief runs a single 60hz guest frame of at most `instructions` instructions, then ticks the timers. Ends the
+        /// frame early when the core blocks on fx0a, settles into a delay loop, or halts.
+        ///
+        /// With run-ahead, sinks are then shown the frame `run_ahead_frames` further on instead, & the core is put back.
+        FrameStatus run_frame(size_t instructions = DEFAULT_INSTRUCTIONS_PER_FRAME) requires Platform::IS_HEADLESS {
+            FrameStatus status = this->execute_frame(instructions);
+            bool can_run_ahead = status == FrameStatus::Running || status == FrameStatus::Idle;
+            if (this->run_ahead_frames == 0 || !can_run_ahead) {
+                this->device.display.buffer.present();
+                return status;
+            }
+
+            // the stack proof holds for every state this program reaches, so it survives going back
+            bool was_stack_proven = this->is_stack_proven;
+            Snapshot real = this->snapshot();
+            this->is_replaying = true;
+            // attached storage keeps showing the real frame
+            this->device.display.buffer.begin_scratch();
+            try {
+                for (size_t frame_i = 0; frame_i < this->run_ahead_frames; frame_i++) {
+                    FrameStatus ahead = this->execute_frame(instructions);
+                    if (ahead != FrameStatus::Running && ahead != FrameStatus::Idle)
+                        break;
+                }
+                this->device.display.buffer.present();
+            } catch (...) {
+                // the real run will throw when it gets there. Until then, show the real frame
+                this->restore(real);
+                this->device.display.buffer.present();
+            }
+            this->is_replaying = false;
+            this->restore(real);
+            this->device.display.buffer.end_scratch();
+            this->is_stack_proven = was_stack_proven;
+            return status;
+        }
+
+        /// @brief executes exactly one instruction the way run_frame() would, but without ticking the timers, checking
+        /// the debugger, or telling sinks. For replaying a recorded run. The instruction counts towards the current
+        /// frame, so the next run_frame() only runs the rest of it.
+        /// @returns true if the program halted
+        bool step_instruction() requires Platform::IS_HEADLESS {
+            this->is_replaying = true;
+            this->is_waiting_for_key = false;
+            uint16_t address = this->program_counter;
+            uint16_t instruction = this->fetch();
+
+            this->executed_instructions += 1;
+            this->frame_instruction += 1;
+            bool has_halted;
+            try {
+                has_halted = this->evaluate_instruction(instruction);
+            } catch (...) {
+                this->is_replaying = false;
+                throw;
+            }
+            if (!has_halted && !this->is_waiting_for_key)
+                this->is_delay_loop(instruction, address);
+            this->is_replaying = false;
+            return has_halted;
+        }
+
+        uint64_t instructions_executed() const {
+            return this->executed_instructions;
+        }
+
+        Snapshot snapshot() const requires Platform::IS_HEADLESS {
+            Snapshot snapshot{
+                this->memory, {}, this->stack_frames, this->gp_registers,
+                this->program_counter, this->i_register, this->stack_pointer,
+                this->sound_timer.value(), this->delay_timer.value(),
+                this->keyboard, this->prng_engine, this->is_waiting_for_key,
+                this->frames_elapsed, this->frame_instruction, this->executed_instructions,
+                this->idle_probe_address, this->idle_probe_clean, this->idle_probe_waits_for_zero,
             };
-            for (size_t i = 0; i < data.size(); i++) {
-                std::ranges::copy(
-                    data[i],
-                    memory.begin() + BUILT_IN_CHAR_STARTING_ADDRESS + i * (Sprite{}.size() * sizeof Sprite::value_type)
-                );
+            std::ranges::copy(this->device.display.buffer.rows(), snapshot.display.begin());
+            return snapshot;
+        }
+
+        /// @brief puts the core back exactly as it was when `snapshot` was taken. Sinks & the attached display storage
+        /// are kept.
+        void restore(const Snapshot& snapshot) requires Platform::IS_HEADLESS {
+            this->memory = snapshot.memory;
+            this->device.display.buffer.load(snapshot.display);
+            this->stack_frames = snapshot.stack_frames;
+            this->gp_registers = snapshot.gp_registers;
+            this->program_counter = snapshot.program_counter;
+            this->i_register = snapshot.i_register;
+            this->stack_pointer = snapshot.stack_pointer;
+            this->sound_timer.set(snapshot.sound_timer);
+            this->delay_timer.set(snapshot.delay_timer);
+            this->keyboard = snapshot.keyboard;
+            this->prng_engine = snapshot.prng_engine;
+            this->is_waiting_for_key = snapshot.is_waiting_for_key;
+            this->frames_elapsed = snapshot.frames_elapsed;
+            this->frame_instruction = snapshot.frame_instruction;
+            this->executed_instructions = snapshot.instructions_executed;
+            this->idle_probe_address = snapshot.idle_probe_address;
+            this->idle_probe_clean = snapshot.idle_probe_clean;
+            this->idle_probe_waits_for_zero = snapshot.idle_probe_waits_for_zero;
+            this->is_waiting_for_zero = false;
+            // the snapshot may be of another program
+            this->is_stack_proven = false;
+            this->resync_debugger();
+        }
+
+        /// @brief after each run_frame(), runs `frames` more frames with the same input, presents the last of them to
+        /// the sinks, then puts the core back. Programs that read keys once per loop & draw the result a frame or two
+        /// later then respond as soon as the key changes. Sound sinks, the heatmap, the profiler & the debugger don't
+        /// see the speculative frames, & display_buffer() & attached display storage always hold the real frame. 0
+        /// turns it off.
+        void set_run_ahead(size_t frames) requires Platform::IS_HEADLESS {
+            this->run_ahead_frames = frames;
+        }
+
+        /// @brief lets `frames` frames of virtual time pass without executing any instructions
+        void advance_timers(size_t frames) requires Platform::IS_HEADLESS {
+            this->sound_timer.tick(frames);
+            this->delay_timer.tick(frames);
+            this->frames_elapsed += frames;
+            this->frame_instruction = 0;
+        }
+
+        /// @brief seconds since the emulator started. Virtual time for headless cores (exact to the instruction, &
+        /// independent of how fast the host runs them), wall clock time otherwise.
+        double clock_seconds() const {
+            if constexpr (Platform::IS_HEADLESS) {
+                double frames = this->frames_elapsed + (double)this->frame_instruction / (double)this->frame_instructions;
+                return frames / 60.0;
+            } else {
+                return std::chrono::duration<double>(std::chrono::steady_clock::now() - this->started_at).count();
             }
         }
 
-        /// @brief blocks until the emulator is done executing
-        void block_run() {
+        /// @brief `sink` sees every write to the sound timer until it is removed
+        void add_sound_sink(SoundSink& sink) {
+            this->sound_sinks.push_back(&sink);
+        }
+
+        void remove_sound_sink(SoundSink& sink) {
+            std::erase(this->sound_sinks, &sink);
+        }
+
+        /// @brief how many more frames a core that reported FrameStatus::Idle will spin in its delay loop, ie. how many
+        /// can be passed with advance_timers() instead of running them. 0 unless the loop only compares the timer
+        /// against 0, since one waiting for some other value has to see every value the timer counts down through.
+        size_t idle_frames() const requires Platform::IS_HEADLESS {
+            return this->is_waiting_for_zero ? this->delay_timer.value() : 0;
+        }
+
+        void press_key(Key key) requires Platform::IS_HEADLESS {
+            this->keyboard.press(key);
+        }
+
+        void release_key(Key key) requires Platform::IS_HEADLESS {
+            this->keyboard.release(key);
+        }
+
+        const std::array<uint8_t, 4096>& memory_view() const {
+            return this->memory;
+        }
+
+        const Framebuffer& display_buffer() const {
+            return this->device.display.buffer;
+        }
+
+        /// @brief draw into rows owned by the caller from now on. The current display is carried over.
+        /// @param write_sequence optional seqlock counter, see Framebuffer::attach()
+        void attach_display(std::span<uint64_t, SCREEN_HEIGHT> rows, std::atomic<uint64_t>* write_sequence = nullptr) {
+            this->device.display.buffer.attach(rows, write_sequence);
+        }
+
+        /// @brief `sink` sees every presented frame until it is removed, & must outlive the emulator until then
+        void add_frame_sink(FrameSink& sink) {
+            this->device.display.buffer.add_sink(sink);
+        }
+
+        void remove_frame_sink(FrameSink& sink) {
+            this->device.display.buffer.remove_sink(sink);
+        }
+
+        /// @brief what the loaded program was found to do when it was loaded
+        const ProgramAnalysis& analysis() const {
+            return this->program_analysis;
+        }
+
+        MachineState machine_state() const {
+            return MachineState{
+                this->gp_registers, this->i_register, this->program_counter, this->stack_pointer, this->memory
+            };
+        }
+
+        std::span<const uint16_t, 16> stack_view() const {
+            return this->stack_frames;
+        }
+
+        #pragma region Debug access
+        // for debuggers to edit the machine. Only call these while the core is paused.
+
+        void set_gp_register(u4 reg, uint8_t value) {
+            this->gp_registers[reg % NUM_GP_REGISTERS] = value;
+            this->resync_debugger();
+        }
+
+        void set_i_register(uint16_t value) {
+            this->i_register = value;
+            // fx55 could now write over code
+            this->is_stack_proven = false;
+        }
+
+        void set_program_counter(uint16_t value) {
+            this->program_counter = value % this->memory.size();
+            this->is_stack_proven = false;
+            this->resync_debugger();
+        }
+
+        void set_stack_pointer(uint8_t value) {
+            this->stack_pointer = std::min<uint8_t>(value, this->stack_frames.size());
+            this->is_stack_proven = false;
+        }
+
+        void set_stack_frame(size_t frame, uint16_t value) {
+            this->stack_frames.at(frame) = value;
+            this->is_stack_proven = false;
+        }
+
+        void poke(uint16_t address, std::span<const uint8_t> bytes) {
+            for (size_t i = 0; i < bytes.size(); i++)
+                this->memory[(address + i) % this->memory.size()] = bytes[i];
+            this->is_stack_proven = false;
+        }
+
+        #pragma endregion
+
+        Debugger* attached_debugger() const {
+            return this->debugger;
+        }
+
+        /// @brief checks `debugger`'s breakpoints & watchpoints before every instruction, or stops checking if null.
+        /// Costs one pointer test per instruction while detached. Only attach or detach while the core is paused.
+        void attach_debugger(Debugger* debugger) {
+            this->debugger = debugger;
+            if (debugger != nullptr)
+                debugger->resync(this->machine_state());
+        }
+
+        /// @brief counts every memory access into `heatmap`, or stops counting if null. Costs one pointer test per
+        /// access while detached. Only attach or detach while the core is paused.
+        void attach_heatmap(MemoryHeatmap* heatmap) {
+            this->heatmap = heatmap;
+        }
+
+        /// @brief measures host performance counters around a sample of instructions, charging them to each
+        /// instruction's opcode, or stops measuring if null. The counters follow the thread that executes next, so
+        /// attach before block_run() or run_frame(). Only attach or detach while the core is paused.
+        void attach_profiler(OpcodeProfiler* profiler) {
+            this->profiler = profiler;
+        }
+
+        /// @brief follows every key event from SDL_PollEvent, through the first ex9e/exa1/fx0a that reads it & the
+        /// next dxyn, to the present that shows it, recording each stage in `probe`. Stops if null. Only call this
+        /// before block_run().
+        void attach_latency_probe(LatencyProbe* probe) requires (!Platform::IS_HEADLESS) {
+            this->latency_probe = probe;
+            this->keyboard.attach_latency_probe(probe);
+            this->device.display.attach_latency_probe(probe);
+        }
+
+        /// @brief draws the display from the main thread at 60hz instead of on every draw, so that a slow renderer
+        /// only drops frames & never slows execution or the timers. Only call this before block_run().
+        void skip_frames() requires (!Platform::IS_HEADLESS) {
+            this->device.display.skip_frames();
+        }
+
+        /// @brief how many frames were drawn, presented & skipped, when presentation is deferred by skip_frames() or
+        /// reduce_flicker(). Call from the thread running block_run(), eg. after it returns.
+        SDL3::Display::Stats present_stats() requires (!Platform::IS_HEADLESS) {
+            return this->device.display.stats();
+        }
+
+        /// @brief draws a blend of the last `frames` display refreshes instead of every frame as it is drawn, to hide the
+        /// flicker of sprites that are erased & redrawn with xor. Only call this before block_run().
+        void reduce_flicker(FlickerFilter::Mode mode, size_t frames) requires (!Platform::IS_HEADLESS) {
+            this->device.display.reduce_flicker(mode, frames);
+        }
+
+        /// @brief makes cxkk reproducible
+        void seed(uint64_t seed) {
+            this->prng_engine.seed(seed);
+        }
+
+        /// @brief blocks until the program halts, the window is closed, or a stop is requested through `stop_token`,
+        /// handling input while the execution worker runs. The worker is paused (not torn down) on return, so calling
+        /// this again carries on where it left off. A pause() or step() from before the call is kept until resume().
+        /// Exceptions thrown while executing are rethrown here.
+        StopReason block_run(std::stop_token stop_token = {}) requires (!Platform::IS_HEADLESS) {
             if (DEBUG)
                 std::cout << "Running program..." << std::endl;
 
-            this->continue_executing_instructions = true;
+            this->controls.start_run();
 
-            std::jthread execution_thread([this](){
-                while (this->continue_executing_instructions) {
-                    if (DEBUG) {
-                        // TODO: make the string concats all atomic so we don't get weird ordering issues
-                        std::cout << "program_counter = " << std::format("{:x}", program_counter) << std::endl;
-                        std::cout << "i_register = " << std::format("{:x}", i_register) << std::endl;
-                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                    }
+            // the first instructions run offscreen while the window opens
+            try {
+                this->device.open_window();
+            } catch (...) {
+                this->controls.stop();
+                throw;
+            }
 
-                    // TODO: can we increment the program_counter by 2 bytes before even entering the evaluate_instruction?
-                    // if so, is it equivalent? we'd save a lot of LoC for sure
-                    bool should_end_execution = this->evaluate_instruction(
-                        (this->memory[this->program_counter] << 8)
-                        + this->memory[this->program_counter + 1]
-                    );
-                    if (should_end_execution)
-                        continue_executing_instructions = false;
+            std::stop_source stop_source;
+            std::stop_callback forward_stop(stop_token, [&stop_source](){ stop_source.request_stop(); });
+
+            while (!stop_source.stop_requested() && !this->controls.halted() && !this->controls.faulted()) {
+                bool event_queue_probably_empty = this->keyboard.poll_events(stop_source);
+                this->device.display.refresh();
+                if (auto speed = this->keyboard.take_speed_change()) {
+                    // the keyboard already knows, & fast-forward mustn't become the speed it steps from
+                    this->change_speed_multiplier(speed.value());
+                    std::cerr << "Speed: " << (std::isinf(speed.value()) ? "uncapped" : std::format("{}x", speed.value())) << std::endl;
                 }
-            });
 
-            while (this->continue_executing_instructions) {
-                bool event_queue_probably_empty = this->keyboard.poll_events();
-                
                 if (event_queue_probably_empty)
                     // In the worst case, sleep may wait up to 15ms, which is still 60hz, so we should be fine!
                     // In the best case, we get 1000/(0.5) = 2000hz, which is super
                     std::this_thread::sleep_for(std::chrono::microseconds(500));
             }
+
+            // let the last instruction finish, so that the final refresh below has everything that was drawn
+            bool has_halted;
+            try {
+                has_halted = this->controls.finish_run();
+            } catch (...) {
+                this->device.display.refresh(true);
+                throw;
+            }
+            // when deferred, whatever was drawn since the last refresh (eg. a game over screen) isn't on screen yet
+            this->device.display.refresh(true);
+
+            if (has_halted)
+                return StopReason::Halted;
+            else if (this->keyboard.quit_requested())
+                return StopReason::Quit;
+            else
+                return StopReason::Stopped;
         }
 
-        void block_until_any_key() {
-            std::cout << "Press any key to exit..." << std::endl;
-            this->keyboard.poll_until_any_keypress();
+        /// @brief stops executing after the current instruction. A blocking fx0a gives up & runs again on resume().
+        void pause() requires (!Platform::IS_HEADLESS) {
+            this->controls.pause();
         }
 
-        // treats both \r\n and \n as line breaks
-        // ignores leading whitespace
-        // ignores all lines that do not start with 0x (after leading whitespace)
-        // returns true on success, false on failure
-        bool load_program(std::string program_text) {
-            if (DEBUG)
-                std::cout << "Loading program with text: " << program_text << std::endl;
+        /// @brief starts executing, before block_run() too (offscreen until it opens the window)
+        void resume() requires (!Platform::IS_HEADLESS) {
+            this->controls.resume();
+        }
 
-            std::vector<uint8_t> bytes;
-
-            size_t next_pos = 0;
-            for (size_t current_pos = 0; current_pos < program_text.size(); current_pos = next_pos) {
-                if (DEBUG)
-                    std::cout << "current_pos = " << current_pos << std::endl;
-
-                // index of \n and \r\n can never be equal (unless they're both npos)
-                size_t cr = program_text.find("\n", current_pos);
-                size_t crlf = program_text.find("\r\n", current_pos);
-                if (cr == std::string::npos && crlf == std::string::npos){
-                    next_pos = program_text.size();
-                } else if (cr < crlf) {
-                    next_pos = cr + 1;
-                } else {
-                    next_pos = crlf + 2;
-                }
+        bool paused() requires (!Platform::IS_HEADLESS) {
+            return this->controls.paused();
+        }
 
-                std::string line = program_text.substr(current_pos, next_pos - current_pos);
-                if (DEBUG)
-                    std::cout << "line = " << line << std::endl;
-                if (std::ranges::all_of(line, isspace))
-                    continue;
+        /// @brief see ExecutionControls::run_state()
+        ExecutionControls::RunState run_state() requires (!Platform::IS_HEADLESS) {
+            return this->controls.run_state();
+        }
 
-                size_t word_start = line.find_first_not_of(" \t\r\n\v\f");
-                if (!line.substr(word_start, line.size() - word_start).starts_with("0x"))
-                    continue;
+        void restore_run_state(ExecutionControls::RunState state) requires (!Platform::IS_HEADLESS) {
+            this->controls.restore_run_state(state);
+        }
 
-                try {
-                    std::string starts_with_bytes = line.substr(word_start+2, line.size() - (word_start+2));
-                    uint16_t word = std::stoi(starts_with_bytes, nullptr, 16);
-                    bytes.push_back((word & 0xff00) >> 8);
-                    bytes.push_back(word & 0x00ff);
-                } catch (std::invalid_argument const&) {
-                    return false;
-                } catch (std::out_of_range const&) {
-                    return false;
-                }
+        /// @brief waits for the worker to come to rest: paused, with no steps or program switch left to do
+        /// @returns false if it was still going after `timeout`
+        bool wait_until_stopped(std::chrono::milliseconds timeout) requires (!Platform::IS_HEADLESS) {
+            return this->controls.wait_until_stopped(timeout, [this](){ return !this->next_program.has_value(); });
+        }
+
+        /// @brief pauses, then executes `instructions` more instructions
+        void step(size_t instructions = 1) requires (!Platform::IS_HEADLESS) {
+            this->controls.step(instructions);
+        }
+
+        /// @param instructions_per_second 0 runs as fast as the host allows. Scaled by the speed multiplier.
+        void set_speed(size_t instructions_per_second) requires (!Platform::IS_HEADLESS) {
+            this->instructions_per_second = instructions_per_second;
+            this->controls.interrupt();
+        }
+
+        /// @brief speeds up or slows down the whole machine: instructions (if paced by set_speed()) & the 60hz timers
+        /// together, so programs behave the same, just faster or slower. The speaker is muted above 1x.
+        /// @param multiplier from MIN_SPEED_MULTIPLIER, or infinity to run uncapped, when the timers follow the
+        /// instructions executed instead of the wall clock
+        void set_speed_multiplier(double multiplier) requires (!Platform::IS_HEADLESS) {
+            multiplier = std::max(multiplier, MIN_SPEED_MULTIPLIER);
+            // so that the hotkeys step from here, & letting go of tab comes back here
+            this->keyboard.select_speed(multiplier);
+            this->change_speed_multiplier(multiplier);
+        }
+
+        double get_speed_multiplier() const requires (!Platform::IS_HEADLESS) {
+            return this->speed_multiplier;
+        }
+
+        /// @brief restarts the machine with another program between instructions, keeping the window, audio & the
+        /// worker thread. Keeps running if it was running.
+        /// @returns false, changing nothing, if the program doesn't fit in memory
+        bool switch_program(std::vector<uint8_t> bytes) requires (!Platform::IS_HEADLESS) {
+            if (bytes.size() > this->memory.size() - PROGRAM_STARTING_ADDRESS)
+                return false;
+
+            this->controls.hand_over([this, &bytes](){ this->next_program = std::move(bytes); });
+            return true;
+        }
+
+        /// @returns false if the window was closed instead
+        bool block_until_any_key(std::stop_token stop_token = {}) requires (!Platform::IS_HEADLESS) {
+            this->device.open_window();
+            std::cerr << "Press any key to exit..." << std::endl;
+            // a deferred display only draws when refreshed, & a flicker filter keeps fading out while we wait
+            return this->keyboard.poll_until_any_keypress(stop_token, [this](){ this->device.display.refresh(); });
+        }
+
+        /// @brief puts the machine back in its power-on state in place: memory from 0x200 on, registers, the stack,
+        /// timers & the display are cleared. The devices, font, rng & attached display storage are kept, & the clock
+        /// keeps running so sinks see one timeline. Use switch_program() instead while block_run() is executing.
+        void reset() {
+            std::fill(this->memory.begin() + PROGRAM_STARTING_ADDRESS, this->memory.end(), 0);
+            this->program_counter = PROGRAM_STARTING_ADDRESS;
+            this->stack_frames.fill(0);
+            this->stack_pointer = 0;
+            this->gp_registers.fill(0);
+            this->i_register = 0;
+            this->sound_timer.set(0);
+            this->delay_timer.set(0);
+            this->idle_probe_clean = false;
+            this->is_stack_proven = false;
+
+            if constexpr (Platform::IS_HEADLESS) {
+                this->keyboard.reset();
+                this->is_waiting_for_key = false;
             }
 
+            this->device.display.buffer.clear();
+            this->device.display.render_buffer();
+        }
+
+        /// @brief reset() & load `bytes`, without touching any devices
+        /// @returns false, changing nothing, if the program doesn't fit in memory
+        bool reload(const std::vector<uint8_t>& bytes) {
+            if (bytes.size() > this->memory.size() - PROGRAM_STARTING_ADDRESS)
+                return false;
+
+            this->reset();
             return this->load_program_bytes(bytes);
         }
 
-        bool load_program_bytes(std::vector<uint8_t> bytes) {
+        /// @brief loads a program in the .chip8 text format, see parse_program_text()
+        /// @returns true on success, false on failure
+        bool load_program(std::string program_text) {
+            if (DEBUG)
+                std::cout << "Loading program with text: " << program_text << std::endl;
+
+            auto bytes = parse_program_text(program_text);
+            return bytes.has_value() && this->load_program_bytes(bytes.value());
+        }
+
+        bool load_program_bytes(const std::vector<uint8_t>& bytes) {
             if (bytes.size() > this->memory.size() - PROGRAM_STARTING_ADDRESS)
                 return false;
 
-            for (size_t i = 0; i < bytes.size(); i++) {
-                this->memory[PROGRAM_STARTING_ADDRESS + i] = bytes[i];
-                if (DEBUG)
+            std::ranges::copy(bytes, this->memory.begin() + PROGRAM_STARTING_ADDRESS);
+            if (DEBUG) {
+                for (size_t i = 0; i < bytes.size(); i++)
                     std::cout << (size_t)this->memory[PROGRAM_STARTING_ADDRESS + i] << " @ " << (PROGRAM_STARTING_ADDRESS + i) << std::endl;
             }
+            this->analyze_loaded_program(bytes.size());
             return true;
         }
     };
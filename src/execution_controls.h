@@ -0,0 +1,313 @@
+#ifndef EXECUTION_CONTROLS_H
+#define EXECUTION_CONTROLS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+namespace Chip8 {
+    /// @brief the pause/resume/step controls for a machine that executes on its own worker thread, shared by the
+    /// interactive emulator & HeadlessSession.
+    ///
+    /// The worker runs `work` & is started by the first control that needs it, then kept until the controls are
+    /// destroyed. Its loop takes batches with next_batch() & reports why it stopped early with stop_for_debugger(),
+    /// halt() or fault(). Anything else the owner hands the worker goes through hand_over(), so that it is guarded by
+    /// the same lock.
+    class ExecutionControls {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /// @brief what next_batch() gave the worker to do
+        struct Batch {
+            /// one instruction while paused, rather than running freely
+            bool is_step;
+            /// stopped when the worker should drop what it's doing (eg. a blocking fx0a) & take its next batch
+            std::stop_token interrupt_token;
+        };
+
+        /// @brief how the machine was being run, see run_state()
+        struct RunState {
+            bool is_paused;
+            bool is_held;
+        };
+
+    private:
+        std::function<void(std::stop_token worker_stop_token)> work;
+
+        std::mutex control_lock;
+        std::condition_variable_any control_changed;
+        bool is_paused = true;
+        // set by pause() & step(), cleared by resume(), so that start_run() keeps a pause made by a controller (eg. a
+        // debugger that connected first) instead of running over it
+        bool is_held = false;
+        // instructions left to single-step while paused
+        size_t steps_pending = 0;
+        // true while the worker has taken a batch & is executing it
+        bool is_executing = false;
+        std::exception_ptr execution_error = nullptr;
+        // stopped (& replaced) whenever the worker should drop what it's doing & look at its controls again
+        std::stop_source interrupt_source;
+
+        std::atomic<bool> has_halted = false;
+        std::atomic<bool> has_faulted = false;
+
+        // declared last so that it is joined before anything it touches is destroyed
+        std::jthread worker;
+
+        /// @brief needs control_lock
+        void start_worker() {
+            if (!this->worker.joinable())
+                this->worker = std::jthread([this](std::stop_token worker_stop_token){ this->work(worker_stop_token); });
+        }
+
+        /// @brief needs control_lock
+        void interrupt_locked() {
+            this->interrupt_source.request_stop();
+            this->interrupt_source = std::stop_source();
+            this->control_changed.notify_all();
+        }
+
+        /// @brief needs control_lock
+        void stop_executing() {
+            this->is_paused = true;
+            this->steps_pending = 0;
+            this->interrupt_locked();
+        }
+
+        /// @brief needs control_lock
+        void start_executing() {
+            this->start_worker();
+            this->is_paused = false;
+            this->has_halted = false;
+            this->control_changed.notify_all();
+        }
+
+    public:
+        /// @param work the worker's loop. It should return once next_batch() does.
+        explicit ExecutionControls(std::function<void(std::stop_token worker_stop_token)> work) :
+            work(std::move(work))
+        {}
+
+        ExecutionControls(const ExecutionControls&) = delete;
+        ExecutionControls& operator=(const ExecutionControls&) = delete;
+
+        ~ExecutionControls() {
+            if (this->worker.joinable()) {
+                this->worker.request_stop();
+                std::scoped_lock lock(this->control_lock);
+                this->interrupt_locked();
+            }
+        }
+
+        #pragma region Controls
+
+        /// @brief stops executing after the current instruction, until resume()
+        void pause() {
+            std::scoped_lock lock(this->control_lock);
+            this->is_held = true;
+            this->stop_executing();
+        }
+
+        /// @brief starts executing
+        void resume() {
+            std::scoped_lock lock(this->control_lock);
+            this->is_held = false;
+            this->start_executing();
+        }
+
+        bool paused() {
+            std::scoped_lock lock(this->control_lock);
+            return this->is_paused;
+        }
+
+        /// @brief pauses, then executes `instructions` more instructions
+        void step(size_t instructions = 1) {
+            std::scoped_lock lock(this->control_lock);
+            this->start_worker();
+            this->is_held = true;
+            if (!this->is_paused) {
+                this->is_paused = true;
+                this->interrupt_locked();
+            }
+            this->steps_pending += instructions;
+            this->has_halted = false;
+            this->control_changed.notify_all();
+        }
+
+        /// @brief waits for the worker to come to rest: paused, with no steps left to do & `is_idle` true
+        /// @param is_idle called with the lock held, for work the owner handed over
+        /// @returns false if it was still going after `timeout`
+        bool wait_until_stopped(std::chrono::milliseconds timeout, std::function<bool()> is_idle = {}) {
+            std::unique_lock lock(this->control_lock);
+            return this->control_changed.wait_for(lock, timeout, [this, &is_idle](){
+                return this->is_paused && this->steps_pending == 0 && !this->is_executing && (!is_idle || is_idle());
+            });
+        }
+
+        /// @brief whether the machine is running, & whether a controller is holding it paused. For a controller that
+        /// pauses the machine for a while (eg. a debugger) to leave it as it found it with restore_run_state().
+        RunState run_state() {
+            std::scoped_lock lock(this->control_lock);
+            return RunState{ this->is_paused, this->is_held };
+        }
+
+        void restore_run_state(RunState state) {
+            std::scoped_lock lock(this->control_lock);
+            this->is_held = state.is_held;
+            if (state.is_paused)
+                this->stop_executing();
+            else
+                this->start_executing();
+        }
+
+        /// @brief makes the worker drop what it's doing & look at its controls again
+        void interrupt() {
+            std::scoped_lock lock(this->control_lock);
+            this->interrupt_locked();
+        }
+
+        /// @brief runs `hand_over` with the lock held, to give the worker something the owner keeps (eg. a program to
+        /// switch to), then wakes the worker to pick it up. The machine no longer counts as halted.
+        void hand_over(const std::function<void()>& hand_over) {
+            std::scoped_lock lock(this->control_lock);
+            this->start_worker();
+            hand_over();
+            this->has_halted = false;
+            this->interrupt_locked();
+        }
+
+        #pragma endregion
+
+        #pragma region Running
+        // for an owner's block_run()
+
+        /// @brief starts executing, unless a controller is holding the machine paused
+        void start_run() {
+            std::scoped_lock lock(this->control_lock);
+            if (this->is_held)
+                this->start_worker();
+            else
+                this->start_executing();
+        }
+
+        /// @brief blocks until the program halts or faults, or a stop is requested through `stop_token`
+        void wait_until_done(std::stop_token stop_token) {
+            std::unique_lock lock(this->control_lock);
+            this->control_changed.wait(lock, stop_token, [this](){ return this->has_halted || this->has_faulted; });
+        }
+
+        /// @brief stops executing without holding the machine paused, eg. when a run is given up
+        void stop() {
+            std::scoped_lock lock(this->control_lock);
+            this->stop_executing();
+        }
+
+        /// @brief stops executing & waits for the last instruction to finish. Exceptions thrown while executing are
+        /// rethrown here.
+        /// @returns true if the program halted
+        bool finish_run() {
+            std::exception_ptr error = nullptr;
+            {
+                std::unique_lock lock(this->control_lock);
+                this->stop_executing();
+                this->control_changed.wait(lock, [this](){ return !this->is_executing; });
+                std::swap(error, this->execution_error);
+                this->has_faulted = false;
+            }
+            if (error)
+                std::rethrow_exception(error);
+            return this->has_halted;
+        }
+
+        bool halted() const {
+            return this->has_halted;
+        }
+
+        bool faulted() const {
+            return this->has_faulted;
+        }
+
+        #pragma endregion
+
+        #pragma region Called by the worker
+
+        /// @brief marks the last batch finished & waits for the next one. Free runs aren't handed out before
+        /// `not_before`, though a pause still cuts that wait short.
+        /// @param has_other_work called with the lock held. When true, `do_other_work` is called, also with the lock
+        /// held, to take whatever was given to hand_over() before anything else.
+        /// @returns nullopt once the worker should return
+        std::optional<Batch> next_batch(
+            std::stop_token worker_stop_token,
+            Clock::time_point not_before = {},
+            std::function<bool()> has_other_work = {},
+            std::function<void()> do_other_work = {}
+        ) {
+            std::unique_lock lock(this->control_lock);
+            while (true) {
+                this->is_executing = false;
+                this->control_changed.notify_all();
+                this->control_changed.wait_until(lock, worker_stop_token, not_before, [this](){ return this->is_paused; });
+                this->control_changed.wait(lock, worker_stop_token, [this, &has_other_work](){
+                    return !this->is_paused || this->steps_pending > 0 || (has_other_work && has_other_work());
+                });
+                if (worker_stop_token.stop_requested())
+                    return std::nullopt;
+
+                if (has_other_work && has_other_work()) {
+                    do_other_work();
+                    continue;
+                }
+
+                bool is_step = this->is_paused;
+                if (is_step)
+                    this->steps_pending -= 1;
+                this->is_executing = true;
+                return Batch{ is_step, this->interrupt_source.get_token() };
+            }
+        }
+
+        /// @brief sleeps until `until`, waking early if `interrupt_token` is stopped
+        void sleep_until(std::stop_token interrupt_token, Clock::time_point until) {
+            std::unique_lock lock(this->control_lock);
+            this->control_changed.wait_until(lock, interrupt_token, until, [](){ return false; });
+        }
+
+        /// @brief the attached debugger stopped the machine
+        void stop_for_debugger() {
+            std::scoped_lock lock(this->control_lock);
+            this->is_paused = true;
+            this->steps_pending = 0;
+            this->control_changed.notify_all();
+        }
+
+        /// @brief the program jumped to itself & will never change state again
+        void halt() {
+            std::scoped_lock lock(this->control_lock);
+            this->is_paused = true;
+            this->steps_pending = 0;
+            this->has_halted = true;
+            this->control_changed.notify_all();
+        }
+
+        /// @brief `error` was thrown while executing. It is rethrown by finish_run().
+        void fault(std::exception_ptr error) {
+            std::scoped_lock lock(this->control_lock);
+            this->execution_error = error;
+            this->is_paused = true;
+            this->steps_pending = 0;
+            this->has_faulted = true;
+            this->control_changed.notify_all();
+        }
+
+        #pragma endregion
+    };
+}
+
+#endif
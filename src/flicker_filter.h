@@ -0,0 +1,92 @@
+#ifndef FLICKER_FILTER_H
+#define FLICKER_FILTER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+
+#include "framebuffer.h"
+
+namespace Chip8 {
+    /// @brief hides the flicker of sprites that are erased & redrawn with xor, by blending the last few frames that
+    /// were actually shown. Meant to be fed once per display refresh, not once per draw.
+    ///
+    /// Every push() sorts the pixels of the recent frames into planes by how many refreshes ago each was last lit,
+    /// using whole-row word operations, so the cost doesn't depend on what is on screen.
+    class FlickerFilter {
+    public:
+        enum class Mode {
+            /// a pixel lit in any of the recent frames is fully lit
+            Or,
+            /// a pixel fades out over the recent frames after it was last lit
+            Decay,
+        };
+
+        constexpr static size_t MAX_FRAMES = 8;
+
+    private:
+        using Frame = std::array<uint64_t, SCREEN_HEIGHT>;
+
+        const Mode mode;
+        const size_t frames;
+
+        // a ring of the last `frames` frames, newest at `newest`
+        std::array<Frame, MAX_FRAMES> history = {};
+        size_t newest = 0;
+
+        // planes[age] holds the pixels last lit `age` refreshes ago. Planes never overlap.
+        std::array<Frame, MAX_FRAMES> planes = {};
+
+    public:
+        /// @param frames how many refreshes to blend, from 1 (no filtering) to MAX_FRAMES
+        FlickerFilter(Mode mode = Mode::Decay, size_t frames = 3) :
+            mode(mode), frames(std::clamp<size_t>(frames, 1, MAX_FRAMES)) {}
+
+        void push(std::span<const uint64_t, SCREEN_HEIGHT> rows) {
+            this->newest = (this->newest + 1) % this->frames;
+            std::ranges::copy(rows, this->history[this->newest].begin());
+
+            Frame seen = {};
+            for (size_t age = 0; age < this->frames; age++) {
+                const Frame& frame = this->history[(this->newest + this->frames - age) % this->frames];
+                for (size_t y = 0; y < SCREEN_HEIGHT; y++) {
+                    this->planes[age][y] = frame[y] & ~seen[y];
+                    seen[y] |= frame[y];
+                }
+            }
+        }
+
+        /// @brief forgets every frame, eg. after a reset
+        void clear() {
+            for (Frame& frame : this->history)
+                frame.fill(0);
+            for (Frame& plane : this->planes)
+                plane.fill(0);
+        }
+
+        /// @brief every pixel lit in any of the blended frames
+        Frame lit() const {
+            Frame lit = {};
+            for (size_t age = 0; age < this->frames; age++)
+                for (size_t y = 0; y < SCREEN_HEIGHT; y++)
+                    lit[y] |= this->planes[age][y];
+            return lit;
+        }
+
+        /// @returns the brightness of a pixel, from 0 (off) to 255 (lit in the newest frame)
+        uint8_t intensity(size_t x, size_t y) const {
+            uint64_t bit = 1ull << (SCREEN_WIDTH - 1 - x);
+            for (size_t age = 0; age < this->frames; age++) {
+                if ((this->planes[age][y] & bit) == 0)
+                    continue;
+                if (this->mode == Mode::Or)
+                    return 255;
+                return (uint8_t)(255 * (this->frames - age) / this->frames);
+            }
+            return 0;
+        }
+    };
+}
+
+#endif
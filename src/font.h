@@ -0,0 +1,31 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <array>
+#include <cstdint>
+
+namespace Chip8 {
+    constexpr static size_t BUILT_IN_CHAR_SIZE = 5;
+
+    /// @brief the hex digit sprites 0-f, each 5 rows tall, stored back to back
+    constexpr static std::array<uint8_t, 16 * BUILT_IN_CHAR_SIZE> BUILT_IN_FONT = {
+        0xf0, 0x90, 0x90, 0x90, 0xf0,
+        0x20, 0x60, 0x20, 0x20, 0x70,
+        0xf0, 0x10, 0xf0, 0x80, 0xf0,
+        0xf0, 0x10, 0xf0, 0x10, 0xf0,
+        0x90, 0x90, 0xf0, 0x10, 0x10,
+        0xf0, 0x80, 0xf0, 0x10, 0xf0,
+        0xf0, 0x80, 0xf0, 0x90, 0xf0,
+        0xf0, 0x10, 0x20, 0x40, 0x40,
+        0xf0, 0x90, 0xf0, 0x90, 0xf0,
+        0xf0, 0x90, 0xf0, 0x10, 0xf0,
+        0xf0, 0x90, 0xf0, 0x90, 0x90,
+        0xe0, 0x90, 0xe0, 0x90, 0xe0,
+        0xf0, 0x80, 0x80, 0x80, 0xf0,
+        0xe0, 0x90, 0x90, 0x90, 0xe0,
+        0xf0, 0x80, 0xf0, 0x80, 0xf0,
+        0xf0, 0x80, 0xf0, 0x80, 0x80,
+    };
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace Chip8 {
+    constexpr static uint16_t SCREEN_WIDTH  = 64;
+    constexpr static uint16_t SCREEN_HEIGHT = 32;
+
+    /// @brief receives every presented frame. Called on the presenting thread, so implementations must not block.
+    class FrameSink {
+    public:
+        virtual ~FrameSink() = default;
+        virtual void on_present(std::span<const uint64_t, SCREEN_HEIGHT> rows) = 0;
+    };
+
+    /// @brief the 64x32 monochrome display, packed as one 64-bit word per row with pixel x at bit (63 - x).
+    ///
+    /// Rows are stored in the framebuffer itself by default, but can be attached to storage owned by someone else
+    /// (eg. a batch of framebuffers laid out back to back) so that readers never need a copy. Readers in another
+    /// thread or process can also be given a seqlock counter, which is bumped around every write.
+    class Framebuffer {
+    private:
+        std::array<uint64_t, SCREEN_HEIGHT> own_rows;
+        std::span<uint64_t, SCREEN_HEIGHT> _rows;
+
+        std::atomic<uint64_t>* write_sequence = nullptr;
+
+        // the attached storage & seqlock, set aside while own_rows stands in for them. See begin_scratch()
+        uint64_t* set_aside_rows = nullptr;
+        std::atomic<uint64_t>* set_aside_sequence = nullptr;
+
+        std::vector<FrameSink*> sinks;
+
+        void begin_write() {
+            if (this->write_sequence == nullptr)
+                return;
+            this->write_sequence->store(this->write_sequence->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        void end_write() {
+            if (this->write_sequence == nullptr)
+                return;
+            this->write_sequence->store(this->write_sequence->load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+    public:
+        Framebuffer() : _rows(own_rows) {
+            this->clear();
+        }
+
+        // a copy would keep pointing at the original's rows
+        Framebuffer(const Framebuffer&) = delete;
+        Framebuffer& operator=(const Framebuffer&) = delete;
+
+        /// @brief moves the current contents into `storage`, then draws there from now on
+        /// @param write_sequence if set, made odd during each write & even again after it, for seqlock readers
+        void attach(std::span<uint64_t, SCREEN_HEIGHT> storage, std::atomic<uint64_t>* write_sequence = nullptr) {
+            this->write_sequence = write_sequence;
+            this->begin_write();
+            std::ranges::copy(this->_rows, storage.begin());
+            this->_rows = storage;
+            this->end_write();
+        }
+
+        /// @brief until end_scratch(), draws into the framebuffer's own rows (starting from the current frame) instead
+        /// of attached storage, so that readers of that storage & its seqlock never see frames that will be thrown away
+        void begin_scratch() {
+            if (this->_rows.data() == this->own_rows.data())
+                return;
+
+            this->set_aside_rows = this->_rows.data();
+            this->set_aside_sequence = this->write_sequence;
+            std::ranges::copy(this->_rows, this->own_rows.begin());
+            this->_rows = std::span<uint64_t, SCREEN_HEIGHT>(this->own_rows);
+            this->write_sequence = nullptr;
+        }
+
+        /// @brief draws into attached storage again, which still holds the frame from before begin_scratch()
+        void end_scratch() {
+            if (this->set_aside_rows == nullptr)
+                return;
+
+            this->_rows = std::span<uint64_t, SCREEN_HEIGHT>(this->set_aside_rows, SCREEN_HEIGHT);
+            this->write_sequence = this->set_aside_sequence;
+            this->set_aside_rows = nullptr;
+            this->set_aside_sequence = nullptr;
+        }
+
+        void clear() {
+            this->begin_write();
+            std::ranges::fill(this->_rows, 0);
+            this->end_write();
+        }
+
+        /// @brief replaces the whole display, eg. when restoring a snapshot
+        void load(std::span<const uint64_t, SCREEN_HEIGHT> rows) {
+            this->begin_write();
+            std::ranges::copy(rows, this->_rows.begin());
+            this->end_write();
+        }
+
+        /// @brief xors the sprite onto the display, wrapping around both edges. One byte per sprite row.
+        /// @returns true if any pixel was turned off
+        bool draw_sprite(uint8_t x, uint8_t y, std::span<const uint8_t> sprite) {
+            this->begin_write();
+            uint64_t turned_off = 0;
+            for (size_t row_i = 0; row_i < sprite.size(); row_i++) {
+                uint64_t bits = std::rotr((uint64_t)sprite[row_i] << 56, x % SCREEN_WIDTH);
+                uint64_t& row = this->_rows[(y + row_i) % SCREEN_HEIGHT];
+                turned_off |= row & bits;
+                row ^= bits;
+            }
+            this->end_write();
+            return turned_off != 0;
+        }
+
+        bool pixel(size_t x, size_t y) const {
+            return (this->_rows[y] >> (SCREEN_WIDTH - 1 - x)) & 1;
+        }
+
+        std::span<const uint64_t, SCREEN_HEIGHT> rows() const {
+            return this->_rows;
+        }
+
+        /// @brief the sink must outlive this framebuffer, or be removed first
+        void add_sink(FrameSink& sink) {
+            this->sinks.push_back(&sink);
+        }
+
+        void remove_sink(FrameSink& sink) {
+            std::erase(this->sinks, &sink);
+        }
+
+        /// @brief hands the current frame to every sink. Called by the display whenever it presents.
+        void present() const {
+            for (FrameSink* sink : this->sinks)
+                sink->on_present(this->_rows);
+        }
+    };
+}
+
+#endif
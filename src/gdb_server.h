@@ -0,0 +1,486 @@
+#ifndef GDB_SERVER_H
+#define GDB_SERVER_H
+
+// BSD sockets. There's no Winsock version here yet.
+#ifndef _WIN32
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <format>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "debugger.h"
+
+namespace Chip8 {
+    /// @brief a GDB remote serial protocol stub on a loopback TCP port, driving an interactive emulator through its
+    /// pause/resume/step controls & a Debugger.
+    ///
+    /// Packets are handled on the server's own thread, so a session that is attached but running executes at full
+    /// speed. One client is served at a time. The core is paused when a client connects, & put back to running or
+    /// paused, as it was, when it detaches.
+    ///
+    /// Cores that record their history (see HeadlessSession) can also be stepped & continued backwards, with gdb's
+    /// reverse-stepi & reverse-continue.
+    ///
+    /// The register layout comes from the target description (qXfer:features:read): V0-VF (8 bits), I & PC (16 bits),
+    /// SP (8 bits), then the 16 stack frames S0-SF (16 bits), all little endian.
+    template<typename Core>
+    class GdbServer {
+    private:
+        constexpr static size_t NUM_REGISTERS = 16 + 3 + 16;
+        constexpr static size_t MAX_PACKET_SIZE = 0x1000;
+        // how often a running core is checked for having stopped, & the socket for an interrupt
+        constexpr static auto POLL_INTERVAL = std::chrono::milliseconds(10);
+        constexpr static bool CAN_REVERSE = requires(Core& core, Debugger& debugger) {
+            core.reverse_step(1);
+            core.reverse_continue(debugger);
+        };
+
+        constexpr static const char* TARGET_XML =
+            "<?xml version=\"1.0\"?>"
+            "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+            "<target version=\"1.0\">"
+            "<feature name=\"org.chip8.core\">"
+            "<reg name=\"v0\" bitsize=\"8\"/><reg name=\"v1\" bitsize=\"8\"/><reg name=\"v2\" bitsize=\"8\"/>"
+            "<reg name=\"v3\" bitsize=\"8\"/><reg name=\"v4\" bitsize=\"8\"/><reg name=\"v5\" bitsize=\"8\"/>"
+            "<reg name=\"v6\" bitsize=\"8\"/><reg name=\"v7\" bitsize=\"8\"/><reg name=\"v8\" bitsize=\"8\"/>"
+            "<reg name=\"v9\" bitsize=\"8\"/><reg name=\"va\" bitsize=\"8\"/><reg name=\"vb\" bitsize=\"8\"/>"
+            "<reg name=\"vc\" bitsize=\"8\"/><reg name=\"vd\" bitsize=\"8\"/><reg name=\"ve\" bitsize=\"8\"/>"
+            "<reg name=\"vf\" bitsize=\"8\"/>"
+            "<reg name=\"i\" bitsize=\"16\" type=\"data_ptr\"/>"
+            "<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>"
+            "<reg name=\"sp\" bitsize=\"8\"/>"
+            "<reg name=\"s0\" bitsize=\"16\"/><reg name=\"s1\" bitsize=\"16\"/><reg name=\"s2\" bitsize=\"16\"/>"
+            "<reg name=\"s3\" bitsize=\"16\"/><reg name=\"s4\" bitsize=\"16\"/><reg name=\"s5\" bitsize=\"16\"/>"
+            "<reg name=\"s6\" bitsize=\"16\"/><reg name=\"s7\" bitsize=\"16\"/><reg name=\"s8\" bitsize=\"16\"/>"
+            "<reg name=\"s9\" bitsize=\"16\"/><reg name=\"sa\" bitsize=\"16\"/><reg name=\"sb\" bitsize=\"16\"/>"
+            "<reg name=\"sc\" bitsize=\"16\"/><reg name=\"sd\" bitsize=\"16\"/><reg name=\"se\" bitsize=\"16\"/>"
+            "<reg name=\"sf\" bitsize=\"16\"/>"
+            "</feature>"
+            "</target>";
+
+        Core& core;
+        Debugger debugger;
+
+        int listen_fd = -1;
+        uint16_t bound_port = 0;
+
+        int client_fd = -1;
+        std::string received;
+        bool is_ack_mode = true;
+
+        // declared last so that it is joined before anything it touches is destroyed
+        std::jthread server_thread;
+
+        #pragma region Encoding
+
+        static std::string to_hex(const uint8_t* bytes, size_t size) {
+            std::string out;
+            out.reserve(size * 2);
+            for (size_t i = 0; i < size; i++)
+                out += std::format("{:02x}", bytes[i]);
+            return out;
+        }
+
+        static std::vector<uint8_t> from_hex(std::string_view hex) {
+            std::vector<uint8_t> bytes;
+            for (size_t i = 0; i + 1 < hex.size(); i += 2)
+                bytes.push_back((uint8_t)std::stoul(std::string(hex.substr(i, 2)), nullptr, 16));
+            return bytes;
+        }
+
+        static size_t register_size(size_t reg) {
+            return (reg == 16 || reg == 17 || reg >= 19) ? 2 : 1;
+        }
+
+        std::string read_register(size_t reg) const {
+            MachineState state = this->core.machine_state();
+            uint16_t value;
+            if (reg < 16)
+                value = state.registers[reg];
+            else if (reg == 16)
+                value = state.i_register;
+            else if (reg == 17)
+                value = state.program_counter;
+            else if (reg == 18)
+                value = state.stack_pointer;
+            else
+                value = this->core.stack_view()[reg - 19];
+
+            std::array<uint8_t, 2> bytes = { (uint8_t)(value & 0xff), (uint8_t)(value >> 8) };
+            return to_hex(bytes.data(), register_size(reg));
+        }
+
+        void write_register(size_t reg, const std::vector<uint8_t>& bytes) {
+            uint16_t value = bytes.at(0) | (bytes.size() > 1 ? bytes[1] << 8 : 0);
+            if (reg < 16)
+                this->core.set_gp_register(reg, (uint8_t)value);
+            else if (reg == 16)
+                this->core.set_i_register(value);
+            else if (reg == 17)
+                this->core.set_program_counter(value);
+            else if (reg == 18)
+                this->core.set_stack_pointer((uint8_t)value);
+            else
+                this->core.set_stack_frame(reg - 19, value);
+        }
+
+        #pragma endregion
+
+        #pragma region Transport
+
+        void send_packet(std::string_view data) {
+            uint8_t checksum = 0;
+            for (char c : data)
+                checksum += (uint8_t)c;
+            std::string packet = std::format("${}#{:02x}", data, checksum);
+
+            size_t sent = 0;
+            while (sent < packet.size()) {
+                ssize_t result = ::send(this->client_fd, packet.data() + sent, packet.size() - sent, MSG_NOSIGNAL);
+                if (result <= 0)
+                    return;
+                sent += result;
+            }
+        }
+
+        /// @returns false once the client disconnected or the server is stopping
+        bool receive_some(std::stop_token stop_token, std::chrono::milliseconds timeout) {
+            pollfd client = { this->client_fd, POLLIN, 0 };
+            if (stop_token.stop_requested())
+                return false;
+            if (poll(&client, 1, (int)timeout.count()) <= 0)
+                return true;
+
+            std::array<char, 1024> buffer;
+            ssize_t size = ::recv(this->client_fd, buffer.data(), buffer.size(), 0);
+            if (size <= 0)
+                return false;
+            this->received.append(buffer.data(), size);
+            return true;
+        }
+
+        /// @brief takes an interrupt (^C) out of the received bytes, if the client sent one
+        bool take_interrupt() {
+            size_t pos = this->received.find('\x03');
+            if (pos == std::string::npos)
+                return false;
+            this->received.erase(pos, 1);
+            return true;
+        }
+
+        /// @returns the next packet's payload, "\x03" for an interrupt, or nullopt once the client is gone
+        std::optional<std::string> read_packet(std::stop_token stop_token) {
+            while (true) {
+                // acks are only informational on a reliable loopback socket
+                size_t start = this->received.find_first_not_of("+-");
+                this->received.erase(0, std::min(start, this->received.size()));
+
+                if (!this->received.empty() && this->received[0] == '\x03') {
+                    this->received.erase(0, 1);
+                    return "\x03";
+                }
+
+                size_t dollar = this->received.find('$');
+                size_t hash = this->received.find('#', dollar);
+                if (dollar != std::string::npos && hash != std::string::npos && hash + 2 < this->received.size()) {
+                    std::string payload = this->received.substr(dollar + 1, hash - dollar - 1);
+                    uint8_t expected = (uint8_t)std::stoul(this->received.substr(hash + 1, 2), nullptr, 16);
+                    this->received.erase(0, hash + 3);
+
+                    uint8_t checksum = 0;
+                    for (char c : payload)
+                        checksum += (uint8_t)c;
+                    if (this->is_ack_mode)
+                        ::send(this->client_fd, checksum == expected ? "+" : "-", 1, MSG_NOSIGNAL);
+                    if (checksum == expected)
+                        return payload;
+                    continue;
+                }
+
+                if (!this->receive_some(stop_token, std::chrono::milliseconds(50)))
+                    return std::nullopt;
+            }
+        }
+
+        #pragma endregion
+
+        void stop_core() {
+            this->core.pause();
+            while (!this->core.wait_until_stopped(POLL_INTERVAL)) {}
+        }
+
+        static std::string hit_reply(const std::optional<DebugHit>& hit) {
+            if (hit.has_value() && hit->kind == DebugHit::Kind::MemoryWrite)
+                return std::format("T05watch:{:x};", hit->address);
+            else if (hit.has_value() && hit->kind == DebugHit::Kind::Breakpoint)
+                return "T05swbreak:;";
+            return "S05";
+        }
+
+        std::string stop_reply(bool was_interrupted) {
+            if (was_interrupted)
+                return "S02";
+            return hit_reply(this->debugger.last_hit());
+        }
+
+        /// @brief runs the core until it stops on its own or the client interrupts it, serving no other packets
+        /// @returns the stop reply, or nullopt if the client went away
+        std::optional<std::string> run_until_stopped(std::stop_token stop_token) {
+            while (!this->core.wait_until_stopped(POLL_INTERVAL)) {
+                if (this->take_interrupt()) {
+                    this->stop_core();
+                    return this->stop_reply(true);
+                }
+                if (!this->receive_some(stop_token, std::chrono::milliseconds(0)))
+                    return std::nullopt;
+            }
+            return this->stop_reply(false);
+        }
+
+        /// @returns false if the client should be disconnected
+        bool handle_packet(const std::string& packet, std::stop_token stop_token) {
+            auto reply = [this](std::string_view data){ this->send_packet(data); };
+
+            if (packet == "\x03") {
+                this->stop_core();
+                reply(this->stop_reply(true));
+            } else if (packet.starts_with("qSupported")) {
+                reply(std::format(
+                    "PacketSize={:x};qXfer:features:read+;QStartNoAckMode+;swbreak+{}",
+                    MAX_PACKET_SIZE, CAN_REVERSE ? ";ReverseStep+;ReverseContinue+" : ""
+                ));
+            } else if (packet == "QStartNoAckMode") {
+                reply("OK");
+                this->is_ack_mode = false;
+            } else if (packet.starts_with("qXfer:features:read:target.xml:")) {
+                size_t offset, length;
+                if (std::sscanf(packet.c_str() + 31, "%zx,%zx", &offset, &length) != 2) {
+                    reply("E01");
+                    return true;
+                }
+                std::string_view xml(TARGET_XML);
+                if (offset >= xml.size())
+                    reply("l");
+                else
+                    reply(std::string(offset + length >= xml.size() ? "l" : "m") + std::string(xml.substr(offset, length)));
+            } else if (packet == "qAttached") {
+                reply("1");
+            } else if (packet == "qC") {
+                reply("QC1");
+            } else if (packet == "qfThreadInfo") {
+                reply("m1");
+            } else if (packet == "qsThreadInfo") {
+                reply("l");
+            } else if (packet.starts_with("H") || packet.starts_with("T")) {
+                reply("OK");
+            } else if (packet == "?") {
+                reply(this->stop_reply(false));
+            } else if (packet == "g") {
+                std::string out;
+                for (size_t reg = 0; reg < NUM_REGISTERS; reg++)
+                    out += this->read_register(reg);
+                reply(out);
+            } else if (packet.starts_with("G")) {
+                std::vector<uint8_t> bytes = from_hex(std::string_view(packet).substr(1));
+                size_t pos = 0;
+                for (size_t reg = 0; reg < NUM_REGISTERS && pos + register_size(reg) <= bytes.size(); reg++) {
+                    this->write_register(reg, std::vector<uint8_t>(bytes.begin() + pos, bytes.begin() + pos + register_size(reg)));
+                    pos += register_size(reg);
+                }
+                reply("OK");
+            } else if (packet.starts_with("p")) {
+                size_t reg = std::stoul(packet.substr(1), nullptr, 16);
+                reply(reg < NUM_REGISTERS ? this->read_register(reg) : "E01");
+            } else if (packet.starts_with("P")) {
+                size_t equals = packet.find('=');
+                size_t reg = std::stoul(packet.substr(1, equals - 1), nullptr, 16);
+                if (equals == std::string::npos || reg >= NUM_REGISTERS) {
+                    reply("E01");
+                } else {
+                    this->write_register(reg, from_hex(std::string_view(packet).substr(equals + 1)));
+                    reply("OK");
+                }
+            } else if (packet.starts_with("m")) {
+                size_t address, length;
+                if (std::sscanf(packet.c_str() + 1, "%zx,%zx", &address, &length) != 2 || address >= 4096) {
+                    reply("E01");
+                    return true;
+                }
+                length = std::min({ length, 4096 - address, MAX_PACKET_SIZE / 2 });
+                reply(to_hex(this->core.memory_view().data() + address, length));
+            } else if (packet.starts_with("M")) {
+                size_t address, length;
+                size_t colon = packet.find(':');
+                if (colon == std::string::npos || std::sscanf(packet.c_str() + 1, "%zx,%zx", &address, &length) != 2) {
+                    reply("E01");
+                    return true;
+                }
+                this->core.poke(address, from_hex(std::string_view(packet).substr(colon + 1)));
+                reply("OK");
+            } else if (packet.starts_with("Z") || packet.starts_with("z")) {
+                char type;
+                size_t address, kind;
+                if (std::sscanf(packet.c_str() + 1, "%c,%zx,%zx", &type, &address, &kind) != 3) {
+                    reply("E01");
+                    return true;
+                }
+                bool is_insert = packet[0] == 'Z';
+                if (type == '0' || type == '1') {
+                    if (is_insert)
+                        this->debugger.set_breakpoint(address);
+                    else
+                        this->debugger.clear_breakpoint(address);
+                } else if (type == '2') {
+                    if (is_insert)
+                        this->debugger.watch_memory(address, kind);
+                    else
+                        this->debugger.unwatch_memory(address, kind);
+                } else {
+                    // read & access watchpoints aren't supported
+                    reply("");
+                    return true;
+                }
+                reply("OK");
+            } else if (packet.starts_with("c") || packet.starts_with("s")) {
+                if (packet.size() > 1)
+                    this->core.set_program_counter(std::stoul(packet.substr(1), nullptr, 16));
+
+                this->debugger.forget_hit();
+                if (packet[0] == 'c')
+                    this->core.resume();
+                else
+                    this->core.step(1);
+
+                auto stop = this->run_until_stopped(stop_token);
+                if (!stop.has_value())
+                    return false;
+                reply(stop.value());
+            } else if (packet == "bs" || packet == "bc") {
+                if constexpr (CAN_REVERSE) {
+                    // replaylog tells gdb that the recording ran out, rather than that something stopped the core
+                    this->debugger.forget_hit();
+                    if (packet == "bs") {
+                        reply(this->core.reverse_step(1) ? "S05" : "T05replaylog:begin;");
+                    } else {
+                        auto hit = this->core.reverse_continue(this->debugger);
+                        reply(hit.has_value() ? hit_reply(hit) : "T05replaylog:begin;");
+                    }
+                } else {
+                    reply("");
+                }
+            } else if (packet.starts_with("D")) {
+                reply("OK");
+                return false;
+            } else if (packet == "k") {
+                return false;
+            } else {
+                // unsupported, including vCont & vMustReplyEmpty
+                reply("");
+            }
+            return true;
+        }
+
+        void serve_client(std::stop_token stop_token) {
+            // a core that had halted, hadn't been started, or was paused by the embedder stays that way after
+            auto run_state = this->core.run_state();
+            this->stop_core();
+            this->core.attach_debugger(&this->debugger);
+
+            this->received.clear();
+            this->is_ack_mode = true;
+            while (auto packet = this->read_packet(stop_token)) {
+                bool keep_going;
+                try {
+                    keep_going = this->handle_packet(packet.value(), stop_token);
+                } catch (const std::exception& e) {
+                    // a malformed packet shouldn't take the server down
+                    this->send_packet("E02");
+                    keep_going = true;
+                }
+                if (!keep_going)
+                    break;
+            }
+
+            this->stop_core();
+            this->core.attach_debugger(nullptr);
+            this->debugger.clear_all();
+            if (!stop_token.stop_requested())
+                this->core.restore_run_state(run_state);
+        }
+
+        void serve(std::stop_token stop_token) {
+            while (!stop_token.stop_requested()) {
+                pollfd listener = { this->listen_fd, POLLIN, 0 };
+                if (poll(&listener, 1, 100) <= 0)
+                    continue;
+
+                this->client_fd = accept(this->listen_fd, nullptr, nullptr);
+                if (this->client_fd == -1)
+                    continue;
+
+                std::cerr << "Debugger connected" << std::endl;
+                this->serve_client(stop_token);
+                close(this->client_fd);
+                this->client_fd = -1;
+                std::cerr << "Debugger disconnected" << std::endl;
+            }
+        }
+
+    public:
+        /// @param port 0 picks a free port, see port()
+        GdbServer(Core& core, uint16_t port) : core(core) {
+            this->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (this->listen_fd == -1)
+                throw std::runtime_error(std::format("socket failed with errno={}", errno));
+
+            int reuse = 1;
+            setsockopt(this->listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+            sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = htons(port);
+            if (bind(this->listen_fd, (sockaddr*)&address, sizeof(address)) == -1 || listen(this->listen_fd, 1) == -1) {
+                close(this->listen_fd);
+                throw std::runtime_error(std::format("could not listen on 127.0.0.1:{}, errno={}", port, errno));
+            }
+
+            socklen_t address_size = sizeof(address);
+            getsockname(this->listen_fd, (sockaddr*)&address, &address_size);
+            this->bound_port = ntohs(address.sin_port);
+
+            this->server_thread = std::jthread([this](std::stop_token stop_token){ this->serve(stop_token); });
+        }
+
+        GdbServer(const GdbServer&) = delete;
+        GdbServer& operator=(const GdbServer&) = delete;
+
+        ~GdbServer() {
+            this->server_thread.request_stop();
+            this->server_thread.join();
+            close(this->listen_fd);
+        }
+
+        uint16_t port() const {
+            return this->bound_port;
+        }
+    };
+}
+
+#endif
+
+#endif
@@ -2,8 +2,18 @@
 #define GEB_LIB_H
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <optional>
+#include <stdexcept>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include "types.h"
 
 namespace GebLib {
     // indices are MSB to LSB of 0x0123 (left to right)
@@ -24,15 +34,23 @@ namespace GebLib {
             std::optional<T> message = std::nullopt;
 
             std::mutex channel_lock;
-            std::condition_variable wait_for_response;
+            std::condition_variable_any wait_for_response;
 
         public:
             ChannelCoordinator() {}
 
-            T request() {
+            /// @returns nullopt if a stop was requested before a response arrived
+            std::optional<T> request(std::stop_token stop_token = {}) {
                 std::unique_lock lock(this->channel_lock);
                 this->is_request_pending = true;
-                this->wait_for_response.wait(lock, [this]{ return this->message.has_value(); });
+                bool has_response = this->wait_for_response.wait(
+                    lock, stop_token, [this]{ return this->message.has_value(); }
+                );
+                if (!has_response) {
+                    // withdraw the request so a late response isn't handed to the next one
+                    this->is_request_pending = false;
+                    return std::nullopt;
+                }
 
                 // hold this lock until the end of this function in case another request is made in between & we skip a response!
                 T response = this->message.value();
@@ -50,6 +68,182 @@ namespace GebLib {
                 }
             }
         };
+
+        /// @brief a bounded single-producer single-consumer queue. Pushing never blocks or locks: when the queue is
+        /// full the item is refused, so a realtime producer can drop work instead of waiting on a slow consumer.
+        template <typename T>
+        class SpscQueue {
+        private:
+            std::vector<T> slots;
+
+            // head is only written by the producer & tail only by the consumer. Both only ever increase.
+            std::atomic<size_t> head = 0;
+            std::atomic<size_t> tail = 0;
+
+            // bumped on every push & on close, so the consumer can sleep on it
+            std::atomic<uint32_t> wake_counter = 0;
+            std::atomic<bool> is_closed = false;
+
+        public:
+            SpscQueue(size_t capacity) : slots(std::max<size_t>(capacity, 1)) {}
+
+            /// @returns false if the queue was full & the item was dropped
+            bool try_push(const T& item) {
+                size_t head = this->head.load(std::memory_order_relaxed);
+                if (head - this->tail.load(std::memory_order_acquire) == this->slots.size())
+                    return false;
+
+                this->slots[head % this->slots.size()] = item;
+                this->head.store(head + 1, std::memory_order_release);
+
+                this->wake_counter.fetch_add(1, std::memory_order_release);
+                this->wake_counter.notify_one();
+                return true;
+            }
+
+            std::optional<T> try_pop() {
+                size_t tail = this->tail.load(std::memory_order_relaxed);
+                if (tail == this->head.load(std::memory_order_acquire))
+                    return std::nullopt;
+
+                T item = std::move(this->slots[tail % this->slots.size()]);
+                this->tail.store(tail + 1, std::memory_order_release);
+                return item;
+            }
+
+            /// @brief blocks until an item arrives
+            /// @returns nullopt once the queue is closed & drained
+            std::optional<T> wait_pop() {
+                while (true) {
+                    uint32_t seen = this->wake_counter.load(std::memory_order_acquire);
+                    if (auto item = this->try_pop())
+                        return item;
+                    if (this->is_closed)
+                        return std::nullopt;
+                    this->wake_counter.wait(seen, std::memory_order_acquire);
+                }
+            }
+
+            /// @brief wakes the consumer, which drains what's left & then sees nullopt
+            void close() {
+                this->is_closed = true;
+                this->wake_counter.fetch_add(1, std::memory_order_release);
+                this->wake_counter.notify_all();
+            }
+        };
+
+        /// @brief a fixed set of worker threads, each with its own deque of tasks. Workers pop their newest task
+        /// first (it's the one most likely to be in cache) and steal the oldest task of another worker when empty.
+        /// Tasks submitted from inside a task stay on the submitting worker's deque.
+        template <typename Task>
+        class WorkStealingPool {
+        private:
+            struct Worker {
+                std::mutex lock;
+                std::deque<Task> tasks;
+            };
+
+            std::function<void(Task)> run_task;
+            std::vector<std::unique_ptr<Worker>> workers;
+
+            // for spreading tasks submitted from outside the pool
+            std::atomic<size_t> next_worker = 0;
+
+            // tasks waiting in any deque (only changed under that deque's lock), and tasks either waiting or running
+            std::atomic<size_t> queued = 0;
+            std::atomic<size_t> outstanding = 0;
+
+            std::mutex sleep_lock;
+            std::condition_variable_any wake_workers;
+            std::condition_variable all_done;
+
+            inline static thread_local WorkStealingPool* current_pool = nullptr;
+            inline static thread_local size_t current_worker = 0;
+
+            // declared last so that the workers are joined before anything they touch is destroyed
+            std::vector<std::jthread> threads;
+
+            std::optional<Task> pop_or_steal(size_t worker_i) {
+                for (size_t offset = 0; offset < this->workers.size(); offset++) {
+                    Worker& victim = *this->workers[(worker_i + offset) % this->workers.size()];
+                    std::lock_guard lock(victim.lock);
+                    if (victim.tasks.empty())
+                        continue;
+
+                    Task task;
+                    if (offset == 0) {
+                        task = std::move(victim.tasks.back());
+                        victim.tasks.pop_back();
+                    } else {
+                        task = std::move(victim.tasks.front());
+                        victim.tasks.pop_front();
+                    }
+                    this->queued -= 1;
+                    return task;
+                }
+                return std::nullopt;
+            }
+
+            void work(std::stop_token stop_token, size_t worker_i) {
+                current_pool = this;
+                current_worker = worker_i;
+
+                while (!stop_token.stop_requested()) {
+                    std::optional<Task> task = this->pop_or_steal(worker_i);
+                    if (!task.has_value()) {
+                        std::unique_lock lock(this->sleep_lock);
+                        this->wake_workers.wait(lock, stop_token, [this]{ return this->queued > 0; });
+                        continue;
+                    }
+
+                    this->run_task(std::move(task.value()));
+
+                    if (this->outstanding.fetch_sub(1) == 1) {
+                        std::lock_guard lock(this->sleep_lock);
+                        this->all_done.notify_all();
+                    }
+                }
+            }
+
+        public:
+            WorkStealingPool(size_t num_workers, std::function<void(Task)> run_task) : run_task(std::move(run_task)) {
+                num_workers = std::max<size_t>(num_workers, 1);
+                for (size_t i = 0; i < num_workers; i++)
+                    this->workers.push_back(std::make_unique<Worker>());
+                for (size_t i = 0; i < num_workers; i++)
+                    this->threads.emplace_back([this, i](std::stop_token stop_token){ this->work(stop_token, i); });
+            }
+
+            void submit(Task task) {
+                this->outstanding += 1;
+
+                size_t worker_i = (current_pool == this)
+                    ? current_worker
+                    : this->next_worker.fetch_add(1) % this->workers.size();
+                {
+                    // count it under the same lock as the push, so the pop that decrements can never come first
+                    std::lock_guard lock(this->workers[worker_i]->lock);
+                    this->workers[worker_i]->tasks.push_back(std::move(task));
+                    this->queued += 1;
+                }
+                {
+                    // a worker checks the count under the sleep lock, so taking it here means the worker is either
+                    // past its check & will see the task, or already waiting & will get our notify
+                    std::lock_guard lock(this->sleep_lock);
+                }
+                this->wake_workers.notify_one();
+            }
+
+            /// @brief blocks until every submitted task (and every task they submitted) has finished
+            void wait_idle() {
+                std::unique_lock lock(this->sleep_lock);
+                this->all_done.wait(lock, [this]{ return this->outstanding == 0; });
+            }
+
+            size_t size() const {
+                return this->workers.size();
+            }
+        };
     }
 }
 
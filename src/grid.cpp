@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_main.h> // redefines main for portability reasons
+
+#include "grid_view.h"
+#include "program_file.h"
+#include "scheduler.h"
+
+const char* USAGE = (
+    "usage: chip8-grid [options] <.chip8/.ch8 file or directory>...\n"
+    "runs every program at once, tiled in one window. Click a tile to send it keys\n"
+    "options:\n"
+    "  --columns <n>    tiles per row. Defaults to a roughly square grid\n"
+    "  --scale <n>      window pixels per chip8 pixel. Defaults to 2\n"
+    "  --workers <n>    threads executing programs. Defaults to one per core\n"
+    "  --run-ahead <n>  show each program <n> frames ahead of itself, to hide its input lag\n"
+);
+
+/// @brief holds the last frame a core presented, which is what gets shown. With run-ahead, that is a frame the core
+/// hasn't really reached yet.
+class PresentedFrame : public Chip8::FrameSink {
+public:
+    std::array<uint64_t, Chip8::SCREEN_HEIGHT> rows = {};
+
+    void on_present(std::span<const uint64_t, Chip8::SCREEN_HEIGHT> rows) override {
+        std::ranges::copy(rows, this->rows.begin());
+    }
+};
+
+// guest frames to run at once after a stall, beyond which the grid gives up catching up
+constexpr size_t MAX_CATCH_UP_FRAMES = 4;
+
+Chip8::SDL3::GridView::Shade shade_for(Chip8::Scheduler::SessionState state) {
+    switch (state) {
+        case Chip8::Scheduler::SessionState::Halted:
+            return Chip8::SDL3::GridView::Shade::Stopped;
+        case Chip8::Scheduler::SessionState::Faulted:
+            return Chip8::SDL3::GridView::Shade::Faulted;
+        default:
+            return Chip8::SDL3::GridView::Shade::Live;
+    }
+}
+
+/// @returns false once the window is closed
+bool handle_events(Chip8::SDL3::GridView& view, Chip8::Scheduler& scheduler) {
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+        if (event.type == SDL_EVENT_QUIT) {
+            return false;
+        } else if (event.type == SDL_EVENT_MOUSE_BUTTON_DOWN) {
+            auto tile = view.tile_at(event.button.x, event.button.y);
+            // release whatever the old tile was holding, or it would be stuck down forever
+            if (view.focused().has_value() && view.focused() != tile)
+                for (size_t key_i = 0; key_i < 16; key_i++)
+                    scheduler.release_key(view.focused().value(), static_cast<Chip8::Key>(key_i));
+            view.focus(tile);
+        } else if ((event.type == SDL_EVENT_KEY_DOWN || event.type == SDL_EVENT_KEY_UP) && !event.key.repeat) {
+            auto key = Chip8::key_for(event.key.key);
+            if (!key.has_value() || !view.focused().has_value())
+                continue;
+
+            if (event.type == SDL_EVENT_KEY_DOWN)
+                scheduler.press_key(view.focused().value(), key.value());
+            else
+                scheduler.release_key(view.focused().value(), key.value());
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    size_t columns = 0;
+    float scale = 2.0;
+    size_t workers = std::thread::hardware_concurrency();
+    size_t run_ahead = 0;
+    std::vector<std::filesystem::path> paths;
+
+    try {
+        for (int arg_i = 1; arg_i < argc; arg_i++) {
+            std::string option(argv[arg_i]);
+            bool has_value = arg_i + 1 < argc;
+            if (option == "--columns" && has_value) {
+                columns = std::stoul(argv[++arg_i]);
+            } else if (option == "--scale" && has_value) {
+                scale = std::stof(argv[++arg_i]);
+            } else if (option == "--workers" && has_value) {
+                workers = std::max<size_t>(std::stoul(argv[++arg_i]), 1);
+            } else if (option == "--run-ahead" && has_value) {
+                run_ahead = std::stoul(argv[++arg_i]);
+            } else if (option.starts_with("--")) {
+                std::cout << "ERROR: unknown option " << option << "\n" << USAGE << std::endl;
+                exit(1);
+            } else if (std::filesystem::is_directory(option)) {
+                size_t first = paths.size();
+                for (const auto& entry : std::filesystem::recursive_directory_iterator(option)) {
+                    auto extension = entry.path().extension();
+                    if (entry.is_regular_file() && (extension == ".chip8" || extension == ".ch8"))
+                        paths.push_back(entry.path());
+                }
+                // directory order isn't stable
+                std::sort(paths.begin() + first, paths.end());
+            } else {
+                paths.push_back(option);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cout << "ERROR: " << e.what() << std::endl;
+        exit(1);
+    }
+
+    if (paths.empty()) {
+        std::cout << "ERROR: expected a path to a .chip8 or .ch8 file\n" << USAGE << std::endl;
+        exit(1);
+    }
+
+    try {
+        Chip8::Scheduler scheduler(workers);
+        scheduler.set_run_ahead(run_ahead);
+        // sessions only present while run_frames() is running, so these are safe to read in between
+        std::vector<PresentedFrame> presented(paths.size());
+        for (const auto& path : paths) {
+            auto program = Chip8::read_program_file(path);
+            if (!program.has_value()) {
+                std::cout << "ERROR: can't read " << path.string() << std::endl;
+                exit(1);
+            }
+            auto id = scheduler.add_session(program.value());
+            scheduler.core(id).add_frame_sink(presented[id]);
+        }
+
+        Chip8::SDL3::GridView view(scheduler.num_sessions(), columns, scale);
+
+        // guest frames are due at 60hz of wall time. Each refresh runs whatever is due, then presents the whole grid once.
+        using Clock = std::chrono::steady_clock;
+        constexpr auto FRAME_DURATION = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / 60.0));
+        auto start = Clock::now();
+        size_t frames_run = 0;
+
+        while (handle_events(view, scheduler)) {
+            size_t frames_due = (size_t)((Clock::now() - start) / FRAME_DURATION);
+            if (frames_due > frames_run + MAX_CATCH_UP_FRAMES)
+                frames_run = frames_due - MAX_CATCH_UP_FRAMES;
+            scheduler.run_frames(frames_due - frames_run);
+            frames_run = frames_due;
+
+            for (Chip8::Scheduler::SessionId id = 0; id < scheduler.num_sessions(); id++)
+                view.update_tile(id, presented[id].rows, shade_for(scheduler.state(id)));
+            view.present();
+
+            std::this_thread::sleep_until(start + (frames_run + 1) * FRAME_DURATION);
+        }
+
+        for (Chip8::Scheduler::SessionId id = 0; id < scheduler.num_sessions(); id++)
+            if (scheduler.state(id) == Chip8::Scheduler::SessionState::Faulted)
+                std::cerr << "ERROR: " << paths[id].string() << ": " << scheduler.fault(id) << std::endl;
+        return 0;
+    } catch (const std::exception& e) {
+        std::cout << "ERROR: " << e.what() << std::endl;
+        exit(1);
+    }
+}
@@ -0,0 +1,208 @@
+#ifndef GRID_VIEW_H
+#define GRID_VIEW_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include <SDL3/SDL.h>
+
+#include "device.h"
+#include "framebuffer.h"
+
+namespace Chip8 {
+    namespace SDL3 {
+        /// @brief shows many displays side by side in one window. Every tile lives in one texture atlas, which is
+        /// uploaded & drawn once per present(), so any number of cores share a single renderer & vsync.
+        ///
+        /// Only use it from the thread that created it, which SDL wants to be the main thread.
+        class GridView {
+        public:
+            /// @brief how a tile is tinted
+            enum class Shade {
+                Live,
+                /// dimmed, eg. for a halted program
+                Stopped,
+                /// reddened, eg. for a core that threw
+                Faulted,
+            };
+
+        private:
+            using Frame = std::array<uint64_t, SCREEN_HEIGHT>;
+
+            // texels between tiles in the atlas
+            constexpr static size_t TILE_GAP = 1;
+            constexpr static size_t TILE_WIDTH = SCREEN_WIDTH + TILE_GAP;
+            constexpr static size_t TILE_HEIGHT = SCREEN_HEIGHT + TILE_GAP;
+
+            // ARGB. The same shades Display uses for live tiles
+            constexpr static uint32_t BACKGROUND = 0xff000000;
+            constexpr static std::array<uint32_t, 3> PIXEL_ON = { 0xffffffff, 0xff808080, 0xffff6060 };
+            constexpr static std::array<uint32_t, 3> PIXEL_OFF = { 0xff191919, 0xff101010, 0xff300c0c };
+
+            struct Tile {
+                Frame shown = {};
+                Shade shade = Shade::Live;
+            };
+
+            Lifetime lifetime;
+
+            const size_t columns;
+            const size_t rows;
+            // the edge size of a chip8 pixel in the window
+            const float scale_factor;
+
+            SDL_Window* window = nullptr;
+            SDL_Renderer* renderer = nullptr;
+            SDL_Texture* atlas = nullptr;
+
+            std::vector<uint32_t> atlas_pixels;
+            std::vector<Tile> tiles;
+            bool is_dirty = true;
+
+            std::optional<size_t> focused_tile = std::nullopt;
+
+            size_t atlas_width() const {
+                return this->columns * TILE_WIDTH;
+            }
+
+            size_t atlas_height() const {
+                return this->rows * TILE_HEIGHT;
+            }
+
+            void expand_tile(size_t tile_i) {
+                const Tile& tile = this->tiles[tile_i];
+                uint32_t on = PIXEL_ON[static_cast<size_t>(tile.shade)];
+                uint32_t off = PIXEL_OFF[static_cast<size_t>(tile.shade)];
+
+                size_t left = (tile_i % this->columns) * TILE_WIDTH;
+                size_t top = (tile_i / this->columns) * TILE_HEIGHT;
+                for (size_t y = 0; y < SCREEN_HEIGHT; y++) {
+                    uint32_t* out = this->atlas_pixels.data() + (top + y) * this->atlas_width() + left;
+                    uint64_t row = tile.shown[y];
+                    for (size_t x = 0; x < SCREEN_WIDTH; x++)
+                        out[x] = ((row >> (SCREEN_WIDTH - 1 - x)) & 1) ? on : off;
+                }
+            }
+
+            SDL_FRect tile_bounds(size_t tile_i) const {
+                return {
+                    (float)((tile_i % this->columns) * TILE_WIDTH) * this->scale_factor,
+                    (float)((tile_i / this->columns) * TILE_HEIGHT) * this->scale_factor,
+                    SCREEN_WIDTH * this->scale_factor,
+                    SCREEN_HEIGHT * this->scale_factor,
+                };
+            }
+
+        public:
+            /// @param columns tiles per row, or 0 for a roughly square grid
+            GridView(size_t num_tiles, size_t columns = 0, float scale_factor = 2.0) :
+                columns(std::max<size_t>((columns != 0) ? columns : (size_t)std::ceil(std::sqrt((double)num_tiles)), 1)),
+                rows(std::max<size_t>((num_tiles + this->columns - 1) / this->columns, 1)),
+                scale_factor(scale_factor),
+                atlas_pixels(this->atlas_width() * this->atlas_height(), BACKGROUND),
+                tiles(num_tiles)
+            {
+                Lifetime::init_subsystem(SDL_INIT_VIDEO);
+                if (!SDL_CreateWindowAndRenderer(
+                    "Chip8 Grid",
+                    (int)(this->atlas_width() * this->scale_factor),
+                    (int)(this->atlas_height() * this->scale_factor),
+                    0, &this->window, &this->renderer
+                ))
+                    throw std::runtime_error(std::format("SDL_CreateWindowAndRenderer error: {}\n", SDL_GetError()));
+
+                SDL_SetRenderVSync(this->renderer, SDL_RENDERER_VSYNC_ADAPTIVE);
+
+                this->atlas = SDL_CreateTexture(
+                    this->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                    (int)this->atlas_width(), (int)this->atlas_height()
+                );
+                if (this->atlas == nullptr)
+                    throw std::runtime_error(std::format("SDL_CreateTexture error: {}\n", SDL_GetError()));
+                SDL_SetTextureScaleMode(this->atlas, SDL_SCALEMODE_NEAREST);
+
+                for (size_t tile_i = 0; tile_i < this->tiles.size(); tile_i++)
+                    this->expand_tile(tile_i);
+            }
+
+            GridView(const GridView&) = delete;
+            GridView& operator=(const GridView&) = delete;
+
+            ~GridView() {
+                if (this->atlas != nullptr)
+                    SDL_DestroyTexture(this->atlas);
+                if (this->renderer != nullptr)
+                    SDL_DestroyRenderer(this->renderer);
+                if (this->window != nullptr)
+                    SDL_DestroyWindow(this->window);
+            }
+
+            size_t num_tiles() const {
+                return this->tiles.size();
+            }
+
+            /// @brief copies a display into its tile. Nothing is drawn until present(), & unchanged tiles cost a compare.
+            void update_tile(size_t tile_i, std::span<const uint64_t, SCREEN_HEIGHT> rows, Shade shade = Shade::Live) {
+                Tile& tile = this->tiles.at(tile_i);
+                if (std::ranges::equal(rows, tile.shown) && tile.shade == shade)
+                    return;
+
+                std::ranges::copy(rows, tile.shown.begin());
+                tile.shade = shade;
+                this->expand_tile(tile_i);
+                this->is_dirty = true;
+            }
+
+            /// @brief uploads the atlas if any tile changed & draws it, with one present for the whole grid
+            void present() {
+                if (this->is_dirty) {
+                    SDL_UpdateTexture(this->atlas, nullptr, this->atlas_pixels.data(), (int)(this->atlas_width() * sizeof(uint32_t)));
+                    this->is_dirty = false;
+                }
+
+                SDL_SetRenderDrawColor(this->renderer, 0, 0, 0, 255);
+                SDL_RenderClear(this->renderer);
+                SDL_RenderTexture(this->renderer, this->atlas, nullptr, nullptr);
+
+                if (this->focused_tile.has_value()) {
+                    SDL_FRect bounds = this->tile_bounds(this->focused_tile.value());
+                    SDL_SetRenderDrawColor(this->renderer, 80, 160, 255, 255);
+                    SDL_RenderRect(this->renderer, &bounds);
+                }
+
+                SDL_RenderPresent(this->renderer);
+            }
+
+            /// @brief the tile under a point in window coordinates, eg. from a mouse event
+            std::optional<size_t> tile_at(float x, float y) const {
+                if (x < 0 || y < 0)
+                    return std::nullopt;
+
+                size_t column = (size_t)(x / this->scale_factor) / TILE_WIDTH;
+                size_t row = (size_t)(y / this->scale_factor) / TILE_HEIGHT;
+                size_t tile_i = row * this->columns + column;
+                if (column >= this->columns || tile_i >= this->tiles.size())
+                    return std::nullopt;
+                return tile_i;
+            }
+
+            /// @brief outlines a tile, eg. the one receiving input. nullopt clears the outline.
+            void focus(std::optional<size_t> tile_i) {
+                this->focused_tile = tile_i;
+            }
+
+            std::optional<size_t> focused() const {
+                return this->focused_tile;
+            }
+        };
+    }
+}
+
+#endif
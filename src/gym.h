@@ -0,0 +1,147 @@
+#ifndef GYM_H
+#define GYM_H
+
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "framebuffer.h"
+#include "scheduler.h"
+
+namespace Chip8 {
+    /// @brief what a memory probe reads out of a core after each step
+    struct ProbeResult {
+        float reward = 0.0f;
+        bool done = false;
+    };
+
+    /// @brief reads game state (eg. a score in memory) out of a core's 4 KiB of memory
+    using MemoryProbe = std::function<ProbeResult(const std::array<uint8_t, 4096>& memory)>;
+
+    /// @brief a batch of headless emulators running the same program, stepped together like a vectorized
+    /// reinforcement learning environment.
+    ///
+    /// Every lane draws straight into one contiguous buffer of packed bitplanes (SCREEN_HEIGHT rows of 64 bits per
+    /// lane, lane after lane), so observations are never copied.
+    class BatchEnv {
+    public:
+        struct StepResult {
+            /// num_lanes() * SCREEN_HEIGHT rows, with pixel x of a row at bit (63 - x)
+            std::span<const uint64_t> framebuffers;
+            std::span<const float> rewards;
+            /// non-zero once a lane halted, faulted or its probe reported done. Sticky until the lane is reset.
+            std::span<const uint8_t> done;
+        };
+
+    private:
+        std::vector<uint8_t> program_bytes;
+        MemoryProbe probe;
+        const size_t frames_per_step;
+
+        Scheduler scheduler;
+
+        std::vector<uint64_t> framebuffers;
+        std::vector<float> rewards;
+        std::vector<uint8_t> done;
+        // the action applied last step, so that only changed keys are pressed or released
+        std::vector<uint16_t> keys_down;
+
+        std::span<uint64_t, SCREEN_HEIGHT> lane_rows(size_t lane) {
+            return std::span<uint64_t, SCREEN_HEIGHT>(this->framebuffers.data() + lane * SCREEN_HEIGHT, SCREEN_HEIGHT);
+        }
+
+        void apply_action(size_t lane, uint16_t keys_down) {
+            uint16_t changed = keys_down ^ this->keys_down[lane];
+            for (size_t key_i = 0; key_i < 16; key_i++) {
+                if (!((changed >> key_i) & 1))
+                    continue;
+
+                if ((keys_down >> key_i) & 1)
+                    this->scheduler.press_key(lane, static_cast<Key>(key_i));
+                else
+                    this->scheduler.release_key(lane, static_cast<Key>(key_i));
+            }
+            this->keys_down[lane] = keys_down;
+        }
+
+    public:
+        /// @param frames_per_step guest frames to run for each action
+        BatchEnv(
+            std::vector<uint8_t> program_bytes,
+            size_t num_lanes,
+            MemoryProbe probe = [](const auto&){ return ProbeResult{}; },
+            size_t frames_per_step = 4,
+            size_t num_workers = std::thread::hardware_concurrency()
+        ) :
+            program_bytes(std::move(program_bytes)),
+            probe(std::move(probe)),
+            frames_per_step(frames_per_step),
+            scheduler(num_workers),
+            framebuffers(num_lanes * SCREEN_HEIGHT, 0),
+            rewards(num_lanes, 0.0f),
+            done(num_lanes, 0),
+            keys_down(num_lanes, 0)
+        {
+            for (size_t lane = 0; lane < num_lanes; lane++) {
+                this->scheduler.add_session(this->program_bytes);
+                this->scheduler.core(lane).attach_display(this->lane_rows(lane));
+            }
+        }
+
+        size_t num_lanes() const {
+            return this->done.size();
+        }
+
+        /// @brief restarts a single lane from the beginning of the program, with all keys up
+        void reset_lane(size_t lane, uint64_t seed) {
+            // resets in place, so the lane keeps drawing into its slice of the framebuffers (now cleared)
+            this->scheduler.reset_session(lane, this->program_bytes);
+            this->scheduler.core(lane).seed(seed);
+
+            this->rewards[lane] = 0.0f;
+            this->done[lane] = 0;
+            this->keys_down[lane] = 0;
+        }
+
+        /// @brief restarts every lane, seeding each lane's rng from `seeds`
+        /// @returns the first observation of each lane
+        std::span<const uint64_t> reset(std::span<const uint64_t> seeds) {
+            if (seeds.size() != this->num_lanes())
+                throw std::invalid_argument("reset needs exactly one seed per lane");
+
+            for (size_t lane = 0; lane < this->num_lanes(); lane++)
+                this->reset_lane(lane, seeds[lane]);
+            return this->framebuffers;
+        }
+
+        /// @brief holds down the keys in each lane's action (one bit per key) for frames_per_step frames
+        StepResult step(std::span<const uint16_t> actions) {
+            if (actions.size() != this->num_lanes())
+                throw std::invalid_argument("step needs exactly one action per lane");
+
+            for (size_t lane = 0; lane < this->num_lanes(); lane++)
+                this->apply_action(lane, actions[lane]);
+
+            this->scheduler.run_frames(this->frames_per_step);
+
+            for (size_t lane = 0; lane < this->num_lanes(); lane++) {
+                if (this->done[lane]) {
+                    this->rewards[lane] = 0.0f;
+                    continue;
+                }
+
+                ProbeResult result = this->probe(this->scheduler.core(lane).memory_view());
+                auto state = this->scheduler.state(lane);
+                this->rewards[lane] = result.reward;
+                this->done[lane] = result.done
+                    || state == Scheduler::SessionState::Halted
+                    || state == Scheduler::SessionState::Faulted;
+            }
+
+            return StepResult{ this->framebuffers, this->rewards, this->done };
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,269 @@
+#ifndef HEADLESS_SESSION_H
+#define HEADLESS_SESSION_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "debugger.h"
+#include "emulator.h"
+#include "execution_controls.h"
+#include "time_travel.h"
+
+namespace Chip8 {
+    /// @brief runs a headless core at 60 frames per second on its own thread, behind the same pause/resume/step
+    /// controls as the interactive emulator, for machines without a display (eg. over ssh).
+    ///
+    /// The whole run is recorded with TimeTravel, so a debugger can also go backwards with reverse_step() &
+    /// reverse_continue(). Like the interactive emulator, only inspect or edit the core while it is paused.
+    class HeadlessSession {
+    public:
+        using Core = Emulator<false, Platforms::Headless>;
+
+    private:
+        struct KeyChange {
+            Key key;
+            bool is_down;
+        };
+
+        Core headless_core;
+        TimeTravel<Core> time_travel;
+
+        // recorded by the worker between frames, so that the log stays in order
+        std::mutex keys_lock;
+        std::vector<KeyChange> pending_keys;
+
+        // Infinity runs uncapped
+        std::atomic<double> speed_multiplier = 1.0;
+
+        // the worker, see work(). Declared last so that it is joined before anything it touches is destroyed.
+        ExecutionControls controls{ [this](std::stop_token worker_stop_token){ this->work(worker_stop_token); } };
+
+        /// @brief the edits a debugger makes aren't inputs the recording can replay, so history starts again after them
+        void rebase() {
+            this->time_travel.rebase();
+        }
+
+        /// @brief executes one paused instruction, stopping first instead if the attached debugger would, the way the
+        /// interactive emulator single-steps
+        /// @returns true if the program halted
+        bool step_or_stop() {
+            Debugger* debugger = this->headless_core.attached_debugger();
+            MachineState state = this->headless_core.machine_state();
+            if (debugger != nullptr && debugger->wants_check(state.program_counter)) {
+                auto hit = debugger->check(state);
+                if (hit.has_value()) {
+                    this->controls.stop_for_debugger();
+                    debugger->notify_stopped(hit.value());
+                    return false;
+                }
+            }
+            return this->time_travel.step_instruction();
+        }
+
+        void work(std::stop_token worker_stop_token) {
+            using Clock = std::chrono::steady_clock;
+            auto next_frame_at = Clock::now();
+
+            while (auto batch = this->controls.next_batch(worker_stop_token, next_frame_at)) {
+                std::vector<KeyChange> keys;
+                {
+                    std::scoped_lock lock(this->keys_lock);
+                    std::swap(keys, this->pending_keys);
+                }
+
+                try {
+                    for (const KeyChange& change : keys) {
+                        if (change.is_down)
+                            this->time_travel.press_key(change.key);
+                        else
+                            this->time_travel.release_key(change.key);
+                    }
+
+                    if (batch->is_step) {
+                        if (this->step_or_stop())
+                            this->controls.halt();
+                    } else {
+                        FrameStatus status = this->time_travel.run_frame();
+                        if (status == FrameStatus::Breakpoint)
+                            this->controls.stop_for_debugger();
+                        else if (status == FrameStatus::Halted)
+                            this->controls.halt();
+                    }
+                } catch (...) {
+                    this->controls.fault(std::current_exception());
+                    continue;
+                }
+
+                double speed = this->speed_multiplier;
+                auto now = Clock::now();
+                if (std::isinf(speed))
+                    next_frame_at = now;
+                else if (!batch->is_step)
+                    next_frame_at = std::max(next_frame_at + std::chrono::nanoseconds((int64_t)(1e9 / (60.0 * speed))), now);
+            }
+        }
+
+    public:
+        HeadlessSession() : time_travel(headless_core) {}
+
+        HeadlessSession(const HeadlessSession&) = delete;
+        HeadlessSession& operator=(const HeadlessSession&) = delete;
+
+        /// @brief for attaching sinks, a heatmap, a profiler or display storage. Only use it before block_run() or
+        /// while paused.
+        Core& core() {
+            return this->headless_core;
+        }
+
+        /// @brief loads a program in the .chip8 text format & starts recording from there. Call before block_run().
+        /// @returns true on success, false on failure
+        bool load_program(std::string program_text) {
+            if (!this->headless_core.load_program(std::move(program_text)))
+                return false;
+            this->rebase();
+            return true;
+        }
+
+        const ProgramAnalysis& analysis() const {
+            return this->headless_core.analysis();
+        }
+
+        /// @brief blocks until the program halts or a stop is requested through `stop_token`, executing on the worker
+        /// thread. A pause() or step() from before the call is kept until resume(). The worker is paused on return.
+        /// Exceptions thrown while executing are rethrown here.
+        StopReason block_run(std::stop_token stop_token = {}) {
+            this->controls.start_run();
+            this->controls.wait_until_done(stop_token);
+            return this->controls.finish_run() ? StopReason::Halted : StopReason::Stopped;
+        }
+
+        /// @brief runs 60 frames per second times `multiplier`, or as fast as the host allows for infinity
+        void set_speed_multiplier(double multiplier) {
+            this->speed_multiplier = std::max(multiplier, Core::MIN_SPEED_MULTIPLIER);
+        }
+
+        /// @brief the key goes down at the start of the next frame. Safe to call from any thread.
+        void press_key(Key key) {
+            std::scoped_lock lock(this->keys_lock);
+            this->pending_keys.push_back(KeyChange{ key, true });
+        }
+
+        void release_key(Key key) {
+            std::scoped_lock lock(this->keys_lock);
+            this->pending_keys.push_back(KeyChange{ key, false });
+        }
+
+        #pragma region Controls
+
+        void pause() {
+            this->controls.pause();
+        }
+
+        void resume() {
+            this->controls.resume();
+        }
+
+        bool paused() {
+            return this->controls.paused();
+        }
+
+        /// @brief see ExecutionControls::run_state()
+        ExecutionControls::RunState run_state() {
+            return this->controls.run_state();
+        }
+
+        void restore_run_state(ExecutionControls::RunState state) {
+            this->controls.restore_run_state(state);
+        }
+
+        /// @brief waits for the worker to come to rest: paused, with no steps left to do
+        /// @returns false if it was still going after `timeout`
+        bool wait_until_stopped(std::chrono::milliseconds timeout) {
+            return this->controls.wait_until_stopped(timeout);
+        }
+
+        /// @brief pauses, then executes `instructions` more instructions without ticking the timers
+        void step(size_t instructions = 1) {
+            this->controls.step(instructions);
+        }
+
+        /// @brief goes back `instructions` instructions. Only call while paused.
+        /// @returns false, without moving, if that would go back past the start of the recording
+        bool reverse_step(uint64_t instructions = 1) {
+            return this->time_travel.reverse_step(instructions);
+        }
+
+        /// @brief goes back to the last point where `debugger` would have stopped, or the start of the recording. Only
+        /// call while paused.
+        /// @returns why the debugger would have stopped there
+        std::optional<DebugHit> reverse_continue(Debugger& debugger) {
+            return this->time_travel.reverse_continue(debugger);
+        }
+
+        #pragma endregion
+
+        #pragma region Debug access
+        // the same as the core's. Only call these while paused.
+
+        MachineState machine_state() const {
+            return this->headless_core.machine_state();
+        }
+
+        std::span<const uint16_t, 16> stack_view() const {
+            return this->headless_core.stack_view();
+        }
+
+        const std::array<uint8_t, 4096>& memory_view() const {
+            return this->headless_core.memory_view();
+        }
+
+        void attach_debugger(Debugger* debugger) {
+            this->headless_core.attach_debugger(debugger);
+        }
+
+        void set_gp_register(u4 reg, uint8_t value) {
+            this->headless_core.set_gp_register(reg, value);
+            this->rebase();
+        }
+
+        void set_i_register(uint16_t value) {
+            this->headless_core.set_i_register(value);
+            this->rebase();
+        }
+
+        void set_program_counter(uint16_t value) {
+            this->headless_core.set_program_counter(value);
+            this->rebase();
+        }
+
+        void set_stack_pointer(uint8_t value) {
+            this->headless_core.set_stack_pointer(value);
+            this->rebase();
+        }
+
+        void set_stack_frame(size_t frame, uint16_t value) {
+            this->headless_core.set_stack_frame(frame, value);
+            this->rebase();
+        }
+
+        void poke(uint16_t address, std::span<const uint8_t> bytes) {
+            this->headless_core.poke(address, bytes);
+            this->rebase();
+        }
+
+        #pragma endregion
+    };
+}
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <format>
+#include <limits>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Chip8 {
+    /// @brief counts how often a core touches each byte of memory, one flat counter array per kind of access. Attach
+    /// with Emulator::attach_heatmap(), & only read or export while the core is paused or stopped.
+    class MemoryHeatmap {
+    public:
+        enum class Stream : uint8_t {
+            /// instruction fetches, 2 bytes each
+            Fetch,
+            /// dxyn sprite rows
+            SpriteRead,
+            /// fx65
+            Read,
+            /// fx33 & fx55
+            Write,
+            /// where fx1e leaves I, for finding tables that programs step through
+            IWalk,
+        };
+
+        constexpr static size_t NUM_STREAMS = 5;
+        constexpr static size_t MEMORY_SIZE = 4096;
+        constexpr static std::array<std::string_view, NUM_STREAMS> STREAM_NAMES = {
+            "fetch", "sprite_read", "read", "write", "i_walk",
+        };
+
+    private:
+        // addresses per image row, so each stream is a 64x64 grid of cells
+        constexpr static size_t IMAGE_COLUMNS = 64;
+        constexpr static size_t IMAGE_ROWS = MEMORY_SIZE / IMAGE_COLUMNS;
+        // pixels between the stream panels
+        constexpr static size_t IMAGE_GAP = 1;
+
+        std::array<std::array<uint32_t, MEMORY_SIZE>, NUM_STREAMS> counts = {};
+
+        /// @brief black through red & yellow to white as `heat` goes from 0 to 1
+        static std::array<uint8_t, 3> shade(double heat) {
+            auto channel = [heat](double start){
+                return (uint8_t)std::clamp((heat - start) * 3.0 * 255.0, 0.0, 255.0);
+            };
+            return { channel(0.0), channel(1.0 / 3.0), channel(2.0 / 3.0) };
+        }
+
+        static bool write_file(const std::string& path, std::string_view contents) {
+            std::FILE* file = std::fopen(path.c_str(), "wb");
+            if (file == nullptr)
+                return false;
+            bool ok = std::fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+            return (std::fclose(file) == 0) && ok;
+        }
+
+    public:
+        /// @brief counts `size` bytes from `address`, wrapping around the end of memory. Saturates instead of
+        /// overflowing, which an uncapped core can reach in under a minute on a hot loop.
+        void count(Stream stream, uint16_t address, size_t size = 1) {
+            auto& counters = this->counts[static_cast<size_t>(stream)];
+            for (size_t i = 0; i < size; i++) {
+                uint32_t& counter = counters[(address + i) % MEMORY_SIZE];
+                counter += counter != std::numeric_limits<uint32_t>::max();
+            }
+        }
+
+        std::span<const uint32_t, MEMORY_SIZE> stream(Stream stream) const {
+            return this->counts[static_cast<size_t>(stream)];
+        }
+
+        void clear() {
+            for (auto& counters : this->counts)
+                counters.fill(0);
+        }
+
+        /// @brief one row per address that was touched at all, with a column per stream
+        std::string to_csv() const {
+            std::string csv = "address";
+            for (std::string_view name : STREAM_NAMES)
+                csv += std::format(",{}", name);
+            csv += "\n";
+
+            for (size_t address = 0; address < MEMORY_SIZE; address++) {
+                bool touched = std::ranges::any_of(this->counts, [address](const auto& counters){ return counters[address] != 0; });
+                if (!touched)
+                    continue;
+
+                csv += std::format("0x{:03x}", address);
+                for (const auto& counters : this->counts)
+                    csv += std::format(",{}", counters[address]);
+                csv += "\n";
+            }
+            return csv;
+        }
+
+        /// @brief a binary PPM with one panel per stream, left to right in Stream order. Each panel has a cell per
+        /// address, 64 to a row, so 0x200 starts the ninth row. Shades are log scaled per panel, so that rarely
+        /// touched data still shows up next to the hottest loop.
+        /// @param scale pixels per cell side
+        std::string to_ppm(size_t scale = 4) const {
+            scale = std::max<size_t>(scale, 1);
+            size_t panel_width = IMAGE_COLUMNS * scale;
+            size_t width = NUM_STREAMS * panel_width + (NUM_STREAMS - 1) * IMAGE_GAP;
+            size_t height = IMAGE_ROWS * scale;
+
+            std::string header = std::format("P6\n{} {}\n255\n", width, height);
+            std::string image(header.size() + width * height * 3, '\0');
+            std::ranges::copy(header, image.begin());
+            uint8_t* pixels = (uint8_t*)image.data() + header.size();
+
+            for (size_t stream_i = 0; stream_i < NUM_STREAMS; stream_i++) {
+                const auto& counters = this->counts[stream_i];
+                double max_heat = std::log1p((double)std::ranges::max(counters));
+
+                for (size_t address = 0; address < MEMORY_SIZE; address++) {
+                    double heat = (max_heat > 0.0) ? std::log1p((double)counters[address]) / max_heat : 0.0;
+                    auto rgb = shade(heat);
+
+                    size_t left = stream_i * (panel_width + IMAGE_GAP) + (address % IMAGE_COLUMNS) * scale;
+                    size_t top = (address / IMAGE_COLUMNS) * scale;
+                    for (size_t y = top; y < top + scale; y++)
+                        for (size_t x = left; x < left + scale; x++)
+                            std::ranges::copy(rgb, pixels + (y * width + x) * 3);
+                }
+            }
+            return image;
+        }
+
+        bool write_csv(const std::string& path) const {
+            return write_file(path, this->to_csv());
+        }
+
+        bool write_ppm(const std::string& path, size_t scale = 4) const {
+            return write_file(path, this->to_ppm(scale));
+        }
+    };
+}
+
+#endif
@@ -1,11 +1,16 @@
 #ifndef KEYBOARD_H
 #define KEYBOARD_H
 
+#include <array>
 #include <atomic>
+#include <functional>
+#include <limits>
+#include <optional>
 #include <stop_token>
 
 #include <SDL3/SDL.h>
 
+#include "latency.h"
 #include "types.h"
 #include "geblib.h"
 
@@ -19,7 +24,22 @@ namespace Chip8 {
         KD, KE, KF
     };
 
+    /// @brief the hex keypad is mapped onto the keys 0-9 & a-f
+    inline std::optional<Key> key_for(SDL_Keycode key) {
+        // https://wiki.libsdl.org/SDL3/SDL_Keycode
+        if (key >= SDLK_0 && key <= SDLK_9)
+            return static_cast<Key>(0x0 + (key - SDLK_0));
+        else if (key >= SDLK_A && key <= SDLK_F)
+            return static_cast<Key>(0xa + (key - SDLK_A));
+        return std::nullopt;
+    }
+
     class Keyboard {
+    public:
+        constexpr static std::array<double, 7> SPEED_STEPS = {
+            0.25, 0.5, 1.0, 2.0, 4.0, 8.0, std::numeric_limits<double>::infinity(),
+        };
+
     private:
         // never need to update more than 1 key at once
         // true means down
@@ -27,37 +47,78 @@ namespace Chip8 {
         
         GebLib::Threading::ChannelCoordinator<Key> key_channel;
 
+        std::atomic<bool> has_quit = false;
+
+        LatencyProbe* latency_probe = nullptr;
+
+        // speed hotkeys: - & = step through SPEED_STEPS from the selected speed, & tab runs uncapped while held
+        std::atomic<double> selected_speed = 1.0;
+        std::atomic<bool> is_fast_forward_held = false;
+        std::atomic<bool> has_speed_changed = false;
+
+        /// @returns true if the key was a speed hotkey
+        bool handle_speed_key(SDL_Keycode key, bool is_down) {
+            if (key == SDLK_TAB) {
+                this->is_fast_forward_held = is_down;
+            } else if (key == SDLK_MINUS || key == SDLK_EQUALS) {
+                if (!is_down)
+                    return true;
+                // the nearest step down or up, so that a speed between steps (eg. --speed 3) goes to its neighbours
+                double speed = this->selected_speed;
+                double next = speed;
+                for (double step : SPEED_STEPS) {
+                    if (key == SDLK_MINUS && step < speed) {
+                        next = step;
+                    } else if (key == SDLK_EQUALS && step > speed) {
+                        next = step;
+                        break;
+                    }
+                }
+                this->selected_speed = next;
+            } else {
+                return false;
+            }
+
+            this->has_speed_changed = true;
+            return true;
+        }
+
     public:
+        /// @brief requests a stop on `stop_source` when the window is closed, instead of exiting, so that the caller
+        /// can shut down cleanly.
         /// @returns whether the event loop is probably empty. The suggestion guarantees when 
         /// false that all events in the queue cannot be older than a few operations or a single (probably) context
         /// switch. Thus, if false, it's safe to sleep a little.
-        bool poll_events(size_t max_events=64) {
+        bool poll_events(std::stop_source& stop_source, size_t max_events=64) {
             SDL_Event event;
             size_t i;
             for (i = 0; i < max_events && SDL_PollEvent(&event); i++) {
                 if (event.type == SDL_EVENT_QUIT) {
-                    std::cout << "Got SDL exit event. Exiting...\n";
-                    exit(1);
+                    std::cerr << "Got SDL exit event. Stopping...\n";
+                    this->has_quit = true;
+                    stop_source.request_stop();
+                    return true;
                 } else if (
                     (event.type == SDL_EVENT_KEY_DOWN || event.type == SDL_EVENT_KEY_UP)
                     && !event.key.repeat
                 ) {
-                    // https://wiki.libsdl.org/SDL3/SDL_Keycode
-                    size_t key_i;
-                    auto key = event.key.key;
-                    if (key >= SDLK_0 && key <= SDLK_9) {
-                        key_i = 0x0 + (key - SDLK_0);
-                    } else if (key >= SDLK_A && key <= SDLK_F) {
-                        key_i = 0xa + (key - SDLK_A);
-                    } else {
+                    if (this->handle_speed_key(event.key.key, event.type == SDL_EVENT_KEY_DOWN))
+                        continue;
+
+                    auto key = key_for(event.key.key);
+                    if (!key.has_value())
                         // invalid keydown doesn't lock mutex
                         continue;
-                    }
+                    size_t key_i = static_cast<size_t>(key.value());
+
+                    // stamped before the core can see the key
+                    if (this->latency_probe != nullptr)
+                        this->latency_probe->on_key_event((uint8_t)key_i, event.type == SDL_EVENT_KEY_DOWN);
 
                     if (event.type == SDL_EVENT_KEY_DOWN)
                         key_channel.send_if_requested(static_cast<Key>(key_i));
 
-                    std::cout << "GOT INPUT. key = " << key_i << " key_down = " << (event.type == SDL_EVENT_KEY_DOWN) << std::endl; 
+                    std::cerr << "GOT INPUT. key = " << key_i << " key_down = " << (event.type == SDL_EVENT_KEY_DOWN) << std::endl; 
                     this->keyboard_state[key_i] = (event.type == SDL_EVENT_KEY_DOWN);
                 }
             }
@@ -65,29 +126,105 @@ namespace Chip8 {
             return i < max_events;
         }
 
-        void poll_until_any_keypress() {
+        /// @param between_polls called while waiting, eg. to keep the display refreshing
+        /// @returns true on a keypress, or false if the window was closed or a stop was requested
+        bool poll_until_any_keypress(std::stop_token stop_token = {}, std::function<void()> between_polls = {}) {
             SDL_Event event;
-            while (true) {
+            while (!stop_token.stop_requested()) {
                 while (SDL_PollEvent(&event)) {
                     if (event.type == SDL_EVENT_QUIT) {
-                        std::cout << "Got SDL exit event. Exiting...\n";
-                        exit(1);
+                        std::cerr << "Got SDL exit event. Stopping...\n";
+                        this->has_quit = true;
+                        return false;
                     } else if (event.type == SDL_EVENT_KEY_DOWN) {
-                        return;
+                        return true;
                     }
                 }
 
+                if (between_polls)
+                    between_polls();
                 std::this_thread::sleep_for(std::chrono::microseconds(500));
             }
+            return false;
+        }
+
+        /// @brief stamps every key event in `probe` as it is polled, or stops if null. Only call before polling starts.
+        void attach_latency_probe(LatencyProbe* probe) {
+            this->latency_probe = probe;
+        }
+
+        /// @returns the speed picked with the hotkeys, if it changed since the last call
+        std::optional<double> take_speed_change() {
+            if (!this->has_speed_changed.exchange(false))
+                return std::nullopt;
+            return this->is_fast_forward_held ? SPEED_STEPS.back() : this->selected_speed.load();
+        }
+
+        /// @brief steps the hotkeys from `speed` (& goes back to it when tab is let go) after the speed was set some
+        /// other way, eg. with --speed
+        void select_speed(double speed) {
+            this->selected_speed = speed;
+        }
+
+        /// @brief true once the window has been closed
+        bool quit_requested() const {
+            return this->has_quit;
         }
 
         bool is_key_pressed(Key key) const {
             return keyboard_state[static_cast<size_t>(key)];
         }
 
-        Key block_until_next_keypress() {
+        /// @returns nullopt if a stop was requested while waiting
+        std::optional<Key> block_until_next_keypress(std::stop_token stop_token = {}) {
             // blocks the next keyboard event from starting, or waits until it is done
-            return this->key_channel.request();
+            return this->key_channel.request(stop_token);
+        }
+    };
+
+    /// @brief key state for headless cores. Keys are set by the embedder instead of being polled from SDL, and
+    /// Fx0A never blocks: the core reports that it is waiting, and picks up the next press() on a later frame.
+    class Keypad {
+    private:
+        std::array<bool, 16> keyboard_state = {};
+
+        bool is_waiting = false;
+        std::optional<Key> next_press = std::nullopt;
+
+    public:
+        void press(Key key) {
+            this->keyboard_state[static_cast<size_t>(key)] = true;
+            if (this->is_waiting && !this->next_press.has_value())
+                this->next_press = key;
+        }
+
+        void release(Key key) {
+            this->keyboard_state[static_cast<size_t>(key)] = false;
+        }
+
+        bool is_key_pressed(Key key) const {
+            return this->keyboard_state[static_cast<size_t>(key)];
+        }
+
+        /// @brief releases every key & forgets any wait in progress
+        void reset() {
+            this->keyboard_state.fill(false);
+            this->is_waiting = false;
+            this->next_press = std::nullopt;
+        }
+
+        /// @returns the first key pressed since the caller started waiting, or nullopt (and starts waiting) if there
+        /// hasn't been one yet. Keys pressed before the wait began are not reported, matching Keyboard.
+        std::optional<Key> next_keypress() {
+            if (!this->next_press.has_value()) {
+                this->is_waiting = true;
+                return std::nullopt;
+            }
+
+            Key key = this->next_press.value();
+            this->next_press = std::nullopt;
+            this->is_waiting = false;
+            return key;
         }
     };
 
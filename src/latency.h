@@ -0,0 +1,192 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <format>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Chip8 {
+    /// @brief measures input-to-photon latency. Each key event is followed through four points: when it was polled
+    /// from SDL, the first ex9e/exa1/fx0a that saw the key in its new state, the first dxyn after that, & the present
+    /// that put the dxyn's frame on screen. See Emulator::attach_latency_probe().
+    ///
+    /// Events are only counted once they reach the screen. Ones that no instruction reads (eg. a key the program
+    /// ignores), that are read but superseded by a newer event of the same key before any draw, or that aren't drawn &
+    /// presented within EXPIRY, are counted as expired instead. Safe to call from the input, execution & presenting
+    /// threads at once.
+    class LatencyProbe {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        enum Stage : size_t {
+            /// polled to read by an instruction
+            PollToRead,
+            /// read to the next draw
+            ReadToDraw,
+            /// draw to the present that showed it
+            DrawToPresent,
+            /// polled to presented
+            EndToEnd,
+        };
+
+        constexpr static size_t NUM_STAGES = 4;
+        constexpr static std::array<std::string_view, NUM_STAGES> STAGE_NAMES = {
+            "poll->read", "read->draw", "draw->present", "end-to-end",
+        };
+
+        constexpr static auto EXPIRY = std::chrono::seconds(2);
+
+    private:
+        struct Event {
+            uint8_t key;
+            bool is_down;
+            Clock::time_point polled_at;
+            std::optional<Clock::time_point> read_at = std::nullopt;
+            std::optional<Clock::time_point> drawn_at = std::nullopt;
+        };
+
+        std::mutex lock;
+        // oldest first
+        std::deque<Event> in_flight;
+        std::array<std::vector<Clock::duration>, NUM_STAGES> samples;
+        size_t expired_events = 0;
+
+        void expire(Clock::time_point now) {
+            while (!this->in_flight.empty() && now - this->in_flight.front().polled_at > EXPIRY) {
+                this->in_flight.pop_front();
+                this->expired_events += 1;
+            }
+        }
+
+        static Clock::duration nth_percentile(const std::vector<Clock::duration>& sorted, double p) {
+            if (sorted.empty())
+                return {};
+            size_t i = std::min(sorted.size() - 1, (size_t)(p * (double)sorted.size()));
+            return sorted[i];
+        }
+
+        static double ms(Clock::duration duration) {
+            return std::chrono::duration<double, std::milli>(duration).count();
+        }
+
+    public:
+        /// @brief a key event was just polled. Call before the key reaches the core.
+        void on_key_event(uint8_t key, bool is_down) {
+            std::scoped_lock lock(this->lock);
+            auto now = Clock::now();
+            this->expire(now);
+            this->in_flight.push_back(Event{ key, is_down, now });
+        }
+
+        /// @brief an instruction just saw `key` down or up. Only observes the events that left it in that state.
+        void on_key_read(uint8_t key, bool is_down) {
+            std::scoped_lock lock(this->lock);
+            auto now = Clock::now();
+            bool is_newly_read = false;
+            for (Event& event : this->in_flight) {
+                if (!event.read_at.has_value() && event.key == key && event.is_down == is_down) {
+                    event.read_at = now;
+                    is_newly_read = true;
+                }
+            }
+            if (!is_newly_read)
+                return;
+
+            // an older event of this key that was read but never drawn didn't change the screen (eg. a release the
+            // program ignores). Without this it would be charged to the draw of the newer one.
+            this->expired_events += std::erase_if(this->in_flight, [&](const Event& event){
+                return event.key == key && event.read_at.has_value() && event.read_at.value() != now
+                    && !event.drawn_at.has_value();
+            });
+        }
+
+        /// @brief dxyn just drew
+        void on_draw() {
+            std::scoped_lock lock(this->lock);
+            auto now = Clock::now();
+            for (Event& event : this->in_flight)
+                if (event.read_at.has_value() && !event.drawn_at.has_value())
+                    event.drawn_at = now;
+        }
+
+        /// @brief a frame just reached the screen
+        /// @param frame_taken_at when the presented frame was copied from the framebuffer. Draws after it aren't in it.
+        void on_present(Clock::time_point frame_taken_at) {
+            std::scoped_lock lock(this->lock);
+            auto now = Clock::now();
+            std::erase_if(this->in_flight, [&](const Event& event){
+                if (!event.drawn_at.has_value() || event.drawn_at.value() > frame_taken_at)
+                    return false;
+
+                this->samples[PollToRead].push_back(event.read_at.value() - event.polled_at);
+                this->samples[ReadToDraw].push_back(event.drawn_at.value() - event.read_at.value());
+                this->samples[DrawToPresent].push_back(now - event.drawn_at.value());
+                this->samples[EndToEnd].push_back(now - event.polled_at);
+                return true;
+            });
+        }
+
+        size_t sample_count() {
+            std::scoped_lock lock(this->lock);
+            return this->samples[EndToEnd].size();
+        }
+
+        size_t expired() {
+            std::scoped_lock lock(this->lock);
+            return this->expired_events;
+        }
+
+        /// @returns the `p`th percentile (0 to 1) of a stage, or 0 without samples
+        Clock::duration percentile(Stage stage, double p) {
+            std::scoped_lock lock(this->lock);
+            std::vector<Clock::duration> sorted = this->samples[stage];
+            std::ranges::sort(sorted);
+            return nth_percentile(sorted, p);
+        }
+
+        void clear() {
+            std::scoped_lock lock(this->lock);
+            this->in_flight.clear();
+            for (auto& stage_samples : this->samples)
+                stage_samples.clear();
+            this->expired_events = 0;
+        }
+
+        /// @brief a table of latency percentiles per stage, in milliseconds
+        std::string report() {
+            std::scoped_lock lock(this->lock);
+            std::string table = std::format(
+                "{:<15}{:>8}{:>10}{:>10}{:>10}{:>10}{:>10}\n", "stage", "samples", "p50", "p90", "p99", "max", "mean"
+            );
+            for (size_t stage = 0; stage < NUM_STAGES; stage++) {
+                std::vector<Clock::duration> sorted = this->samples[stage];
+                std::ranges::sort(sorted);
+                Clock::duration total = {};
+                for (Clock::duration sample : sorted)
+                    total += sample;
+                double mean = sorted.empty() ? 0.0 : ms(total) / (double)sorted.size();
+
+                table += std::format(
+                    "{:<15}{:>8}{:>10.2f}{:>10.2f}{:>10.2f}{:>10.2f}{:>10.2f}\n",
+                    STAGE_NAMES[stage], sorted.size(), ms(nth_percentile(sorted, 0.5)), ms(nth_percentile(sorted, 0.9)),
+                    ms(nth_percentile(sorted, 0.99)), ms(nth_percentile(sorted, 1.0)), mean
+                );
+            }
+            table += std::format(
+                "milliseconds. {} key events never reached the screen, {} still in flight\n",
+                this->expired_events, this->in_flight.size()
+            );
+            return table;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,592 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <type_traits>
+#include <vector>
+
+#include "types.h"
+#include "geblib.h"
+
+#include "analysis.h"
+#include "font.h"
+#include "framebuffer.h"
+#include "keyboard.h"
+
+namespace Chip8 {
+    /// @brief runs LANES copies of the same program in lock-step. All machine state, including memory & the
+    /// displays, is stored as fixed structure-of-arrays (eg. memory[address][lane]), so one decoded instruction is
+    /// applied to every lane sharing its program counter with a single loop over the lanes. The loops select with
+    /// byte-mask blends instead of branching on the mask, so the compiler turns them into vector code (AVX2 in
+    /// chip8-bench, see CMakeLists.txt).
+    ///
+    /// Lanes only differ by their input & rng seed, so they mostly stay together. When they diverge, the group of
+    /// lanes at the lowest program counter runs first, which tends to pull loops back into step. Instruction
+    /// semantics match the handlers in Emulator.
+    template<size_t LANES>
+    class LockstepEngine {
+    public:
+        enum class LaneState : uint8_t {
+            Running,
+            /// parked on fx0a until press_key()
+            WaitingForKey,
+            /// jumped to itself
+            Halted,
+            /// hit an unknown instruction, or a stack or memory error
+            Faulted,
+        };
+
+    private:
+        static const uint16_t BUILT_IN_CHAR_STARTING_ADDRESS = 0x100;
+        static const uint16_t PROGRAM_STARTING_ADDRESS = 0x200;
+        static const uint16_t ADDRESS_MASK = 0x0fff;
+
+        static const size_t INSTRUCTION_SIZE = 2;
+
+        // 0xff for lanes executing the current instruction, 0x00 otherwise. Blending with a byte mask instead of
+        // branching keeps the lane loops vectorizable.
+        using Mask = std::array<uint8_t, LANES>;
+
+        template<typename T>
+        using Lanes = std::array<T, LANES>;
+
+        using Memory = std::array<uint8_t, 4096>;
+        using Rows = std::array<uint64_t, SCREEN_HEIGHT>;
+
+        std::array<Lanes<uint8_t>, 16> gp_registers;
+        Lanes<uint16_t> i_register;
+        Lanes<uint16_t> program_counter;
+
+        std::array<Lanes<uint16_t>, 16> stack_frames;
+        Lanes<uint8_t> stack_pointer;
+
+        Lanes<uint8_t> delay_timer;
+        Lanes<uint8_t> sound_timer;
+
+        // LaneState values, kept as bytes so they blend like everything else
+        Lanes<uint8_t> lane_state;
+        // instructions each lane may still execute in this frame
+        Lanes<uint16_t> budget;
+
+        // held keys as a bitmask (32 bits wide, since AVX2 only shifts 32 & 64 bit lanes by per-lane amounts), and the
+        // register fx0a will write to while waiting
+        Lanes<uint32_t> keys_down;
+        Lanes<uint8_t> waiting_register;
+
+        // xorshift32, one stream per lane
+        Lanes<uint32_t> prng_state;
+
+        // lanes can diverge on self-modifying code & addresses, so every lane has its own memory & display. Lanes
+        // read the same address side by side, eg. when fetching.
+        std::array<Lanes<uint8_t>, 4096> memory;
+        std::array<Lanes<uint64_t>, SCREEN_HEIGHT> display;
+
+        // the loaded program can't misuse the stack, so call & ret don't check each lane. See analyze_program().
+        bool is_stack_proven = false;
+
+        size_t groups_executed = 0;
+        size_t lane_instructions_executed = 0;
+
+        /// @returns `value` where `mask` is 0xff, & `otherwise` where it is 0x00
+        template<std::unsigned_integral T>
+        static T blend(uint8_t mask, std::type_identity_t<T> value, T otherwise) {
+            T wide_mask = (T)(0 - (T)(mask & 1));
+            return (T)((value & wide_mask) | (otherwise & (T)~wide_mask));
+        }
+
+        static uint8_t state_byte(LaneState state) {
+            return static_cast<uint8_t>(state);
+        }
+
+        uint16_t fetch(size_t lane, uint16_t address) const {
+            return (this->memory[address & ADDRESS_MASK][lane] << 8) + this->memory[(address + 1) & ADDRESS_MASK][lane];
+        }
+
+        void advance(const Mask& mask) {
+            for (size_t l = 0; l < LANES; l++)
+                this->program_counter[l] += mask[l] & INSTRUCTION_SIZE;
+        }
+
+        /// @brief skip the next instruction in lanes where `taken` is non-zero
+        void skip_if(const Mask& mask, const Lanes<uint8_t>& taken) {
+            for (size_t l = 0; l < LANES; l++)
+                this->program_counter[l] += mask[l] & (INSTRUCTION_SIZE << (taken[l] != 0));
+        }
+
+        void fault(const Mask& mask) {
+            for (size_t l = 0; l < LANES; l++)
+                this->lane_state[l] = blend(mask[l], state_byte(LaneState::Faulted), this->lane_state[l]);
+        }
+
+        // a lane's stack pointer picks one of 16 frames. Every frame is visited & blended in, instead of indexing by
+        // the stack pointer, so these vectorize without gathers or scatters.
+
+        /// @returns stack_frames[stack_pointer] of every lane
+        Lanes<uint16_t> top_frames() const {
+            Lanes<uint16_t> top = {};
+            for (size_t frame_i = 0; frame_i < this->stack_frames.size(); frame_i++) {
+                for (size_t l = 0; l < LANES; l++) {
+                    uint8_t is_top = (uint8_t)(0 - (uint8_t)((this->stack_pointer[l] & 0x0f) == frame_i));
+                    top[l] = blend(is_top, this->stack_frames[frame_i][l], top[l]);
+                }
+            }
+            return top;
+        }
+
+        /// @brief writes stack_frames[stack_pointer] of the lanes in `mask`
+        void push_frames(const Mask& mask, const Lanes<uint16_t>& values) {
+            for (size_t frame_i = 0; frame_i < this->stack_frames.size(); frame_i++) {
+                for (size_t l = 0; l < LANES; l++) {
+                    uint8_t is_top = mask[l] & (uint8_t)(0 - (uint8_t)((this->stack_pointer[l] & 0x0f) == frame_i));
+                    this->stack_frames[frame_i][l] = blend(is_top, values[l], this->stack_frames[frame_i][l]);
+                }
+            }
+        }
+
+        static uint32_t xorshift(uint32_t x) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            return x;
+        }
+
+        void execute(uint16_t instruction, const Mask& mask) {
+            using GebLib::get_nibble;
+
+            uint16_t address = instruction & 0x0fff;
+            uint8_t byte = instruction & 0x00ff;
+            size_t x = get_nibble(instruction, 1);
+            size_t y = get_nibble(instruction, 2);
+            size_t n = get_nibble(instruction, 3);
+
+            auto& vx = this->gp_registers[x];
+            auto& vy = this->gp_registers[y];
+            auto& vf = this->gp_registers[0xf];
+            Lanes<uint8_t> taken;
+
+            switch (instruction & 0xf000) {
+            case 0x0000:
+                if (instruction == 0x00e0) {
+                    for (auto& row : this->display)
+                        for (size_t l = 0; l < LANES; l++)
+                            row[l] = blend(mask[l], 0, row[l]);
+                    this->advance(mask);
+                } else if (instruction == 0x00ee) {
+                    Mask ok = mask;
+                    if (!this->is_stack_proven) {
+                        for (size_t l = 0; l < LANES; l++) {
+                            uint8_t underflow = mask[l] & (uint8_t)(0 - (uint8_t)(this->stack_pointer[l] == 0));
+                            ok[l] = mask[l] & ~underflow;
+                            this->lane_state[l] = blend(underflow, state_byte(LaneState::Faulted), this->lane_state[l]);
+                        }
+                    }
+                    for (size_t l = 0; l < LANES; l++)
+                        this->stack_pointer[l] -= ok[l] & 1;
+                    Lanes<uint16_t> return_to = this->top_frames();
+                    for (size_t l = 0; l < LANES; l++)
+                        this->program_counter[l] = blend(ok[l], return_to[l], this->program_counter[l]);
+                } else {
+                    // sys
+                    this->advance(mask);
+                }
+                break;
+            case 0x1000:
+                for (size_t l = 0; l < LANES; l++) {
+                    uint8_t halted = mask[l] & (uint8_t)(0 - (uint8_t)(this->program_counter[l] == address));
+                    this->lane_state[l] = blend(halted, state_byte(LaneState::Halted), this->lane_state[l]);
+                    this->program_counter[l] = blend(mask[l], address, this->program_counter[l]);
+                }
+                break;
+            case 0x2000:
+                {
+                    Mask ok = mask;
+                    if (!this->is_stack_proven) {
+                        for (size_t l = 0; l < LANES; l++) {
+                            bool is_bad = (this->stack_pointer[l] > 15) | (address >= this->memory.size() - 1);
+                            uint8_t bad = mask[l] & (uint8_t)(0 - (uint8_t)is_bad);
+                            ok[l] = mask[l] & ~bad;
+                            this->lane_state[l] = blend(bad, state_byte(LaneState::Faulted), this->lane_state[l]);
+                        }
+                    }
+                    Lanes<uint16_t> return_to;
+                    for (size_t l = 0; l < LANES; l++)
+                        return_to[l] = this->program_counter[l] + INSTRUCTION_SIZE;
+                    this->push_frames(ok, return_to);
+                    for (size_t l = 0; l < LANES; l++) {
+                        this->stack_pointer[l] += ok[l] & 1;
+                        this->program_counter[l] = blend(ok[l], address, this->program_counter[l]);
+                    }
+                }
+                break;
+            case 0x3000:
+                for (size_t l = 0; l < LANES; l++)
+                    taken[l] = vx[l] == byte;
+                this->skip_if(mask, taken);
+                break;
+            case 0x4000:
+                for (size_t l = 0; l < LANES; l++)
+                    taken[l] = vx[l] != byte;
+                this->skip_if(mask, taken);
+                break;
+            case 0x5000:
+                if (n != 0)
+                    return this->fault(mask);
+                for (size_t l = 0; l < LANES; l++)
+                    taken[l] = vx[l] == vy[l];
+                this->skip_if(mask, taken);
+                break;
+            case 0x6000:
+                for (size_t l = 0; l < LANES; l++)
+                    vx[l] = blend(mask[l], byte, vx[l]);
+                this->advance(mask);
+                break;
+            case 0x7000:
+                for (size_t l = 0; l < LANES; l++)
+                    vx[l] = blend(mask[l], (uint8_t)(vx[l] + byte), vx[l]);
+                this->advance(mask);
+                break;
+            case 0x8000:
+                // registers may alias (eg. x == 0xf), so each lane updates them in the same order as Emulator
+                switch (n) {
+                case 0x0:
+                    for (size_t l = 0; l < LANES; l++)
+                        vx[l] = blend(mask[l], vy[l], vx[l]);
+                    break;
+                case 0x1:
+                    for (size_t l = 0; l < LANES; l++)
+                        vx[l] = blend(mask[l], vx[l] | vy[l], vx[l]);
+                    break;
+                case 0x2:
+                    for (size_t l = 0; l < LANES; l++)
+                        vx[l] = blend(mask[l], vx[l] & vy[l], vx[l]);
+                    break;
+                case 0x3:
+                    for (size_t l = 0; l < LANES; l++)
+                        vx[l] = blend(mask[l], vx[l] ^ vy[l], vx[l]);
+                    break;
+                case 0x4:
+                    for (size_t l = 0; l < LANES; l++) {
+                        vx[l] = blend(mask[l], (uint8_t)(vx[l] + vy[l]), vx[l]);
+                        vf[l] = blend(mask[l], (uint8_t)(((uint16_t)vx[l] + (uint16_t)vy[l]) > 0xff), vf[l]);
+                    }
+                    break;
+                case 0x5:
+                    for (size_t l = 0; l < LANES; l++) {
+                        vf[l] = blend(mask[l], (uint8_t)(vx[l] >= vy[l]), vf[l]);
+                        vx[l] = blend(mask[l], (uint8_t)(vx[l] - vy[l]), vx[l]);
+                    }
+                    break;
+                case 0x6:
+                    for (size_t l = 0; l < LANES; l++) {
+                        vx[l] = blend(mask[l], (uint8_t)(vx[l] >> 1), vx[l]);
+                        vf[l] = blend(mask[l], (uint8_t)(vx[l] & 0x01), vf[l]);
+                    }
+                    break;
+                case 0x7:
+                    for (size_t l = 0; l < LANES; l++) {
+                        vf[l] = blend(mask[l], (uint8_t)(vy[l] >= vx[l]), vf[l]);
+                        vx[l] = blend(mask[l], (uint8_t)(vy[l] - vx[l]), vx[l]);
+                    }
+                    break;
+                case 0xe:
+                    for (size_t l = 0; l < LANES; l++) {
+                        vf[l] = blend(mask[l], (uint8_t)((vx[l] & 0x80) != 0), vf[l]);
+                        vx[l] = blend(mask[l], (uint8_t)(vx[l] << 1), vx[l]);
+                    }
+                    break;
+                default:
+                    return this->fault(mask);
+                }
+                this->advance(mask);
+                break;
+            case 0x9000:
+                if (n != 0)
+                    return this->fault(mask);
+                for (size_t l = 0; l < LANES; l++)
+                    taken[l] = vx[l] != vy[l];
+                this->skip_if(mask, taken);
+                break;
+            case 0xa000:
+                for (size_t l = 0; l < LANES; l++)
+                    this->i_register[l] = blend(mask[l], address, this->i_register[l]);
+                this->advance(mask);
+                break;
+            case 0xb000:
+                for (size_t l = 0; l < LANES; l++) {
+                    uint16_t target = (uint16_t)this->gp_registers[0][l] + address;
+                    this->program_counter[l] = blend(mask[l], target, this->program_counter[l]);
+                }
+                break;
+            case 0xc000:
+                for (size_t l = 0; l < LANES; l++) {
+                    uint32_t next = xorshift(this->prng_state[l]);
+                    this->prng_state[l] = blend(mask[l], next, this->prng_state[l]);
+                    vx[l] = blend(mask[l], (uint8_t)((next >> 24) & byte), vx[l]);
+                }
+                this->advance(mask);
+                break;
+            case 0xd000:
+                {
+                    // lanes read their own sprite address & write their own rows, which AVX2 can't gather or scatter
+                    // bytes for, so this stays a scalar (but branch-free) loop. So do fx33, fx55 & fx65.
+                    // vx & vy are read before vf is written, in case one of them is vf
+                    Lanes<uint8_t> collided = {};
+                    for (size_t row_i = 0; row_i < n; row_i++) {
+                        for (size_t l = 0; l < LANES; l++) {
+                            uint8_t sprite_row = this->memory[(this->i_register[l] + row_i) & ADDRESS_MASK][l];
+                            // pixel 0 is the most significant bit, & sprites wrap around the display
+                            uint64_t bits = std::rotr((uint64_t)sprite_row << 56, vx[l] % SCREEN_WIDTH);
+                            uint64_t& row = this->display[(vy[l] + row_i) % SCREEN_HEIGHT][l];
+                            collided[l] |= (row & bits) != 0;
+                            row = blend(mask[l], row ^ bits, row);
+                        }
+                    }
+                    for (size_t l = 0; l < LANES; l++)
+                        vf[l] = blend(mask[l], collided[l], vf[l]);
+                }
+                this->advance(mask);
+                break;
+            case 0xe000:
+                if (byte == 0x9e) {
+                    for (size_t l = 0; l < LANES; l++)
+                        taken[l] = (this->keys_down[l] >> (vx[l] & 0x0f)) & 1;
+                } else if (byte == 0xa1) {
+                    for (size_t l = 0; l < LANES; l++)
+                        taken[l] = ~(this->keys_down[l] >> (vx[l] & 0x0f)) & 1;
+                } else {
+                    return this->fault(mask);
+                }
+                this->skip_if(mask, taken);
+                break;
+            case 0xf000:
+                switch (byte) {
+                case 0x07:
+                    for (size_t l = 0; l < LANES; l++)
+                        vx[l] = blend(mask[l], this->delay_timer[l], vx[l]);
+                    break;
+                case 0x0a:
+                    for (size_t l = 0; l < LANES; l++) {
+                        this->lane_state[l] = blend(mask[l], state_byte(LaneState::WaitingForKey), this->lane_state[l]);
+                        this->waiting_register[l] = blend(mask[l], (uint8_t)x, this->waiting_register[l]);
+                    }
+                    // the program counter moves past fx0a once press_key() is called
+                    return;
+                case 0x15:
+                    for (size_t l = 0; l < LANES; l++)
+                        this->delay_timer[l] = blend(mask[l], vx[l], this->delay_timer[l]);
+                    break;
+                case 0x18:
+                    for (size_t l = 0; l < LANES; l++)
+                        this->sound_timer[l] = blend(mask[l], vx[l], this->sound_timer[l]);
+                    break;
+                case 0x1e:
+                    for (size_t l = 0; l < LANES; l++)
+                        this->i_register[l] = blend(mask[l], (uint16_t)(this->i_register[l] + vx[l]), this->i_register[l]);
+                    break;
+                case 0x29:
+                    for (size_t l = 0; l < LANES; l++) {
+                        uint16_t glyph = BUILT_IN_CHAR_STARTING_ADDRESS + BUILT_IN_CHAR_SIZE * (vx[l] % 16);
+                        this->i_register[l] = blend(mask[l], glyph, this->i_register[l]);
+                    }
+                    break;
+                case 0x33:
+                    for (size_t l = 0; l < LANES; l++) {
+                        uint16_t i = this->i_register[l];
+                        uint8_t bad = mask[l] & (uint8_t)(0 - (uint8_t)(i >= this->memory.size() - 2));
+                        uint8_t ok = mask[l] & ~bad;
+                        this->lane_state[l] = blend(bad, state_byte(LaneState::Faulted), this->lane_state[l]);
+                        std::array<uint8_t, 3> digits = {
+                            (uint8_t)(vx[l] % 10), (uint8_t)((vx[l] % 100 - vx[l] % 10) / 10), (uint8_t)((vx[l] - vx[l] % 100) / 100),
+                        };
+                        for (size_t digit_i = 0; digit_i < digits.size(); digit_i++) {
+                            uint8_t& cell = this->memory[(i + digit_i) & ADDRESS_MASK][l];
+                            cell = blend(ok, digits[digit_i], cell);
+                        }
+                    }
+                    break;
+                case 0x55:
+                    for (size_t reg = 0; reg <= x; reg++) {
+                        for (size_t l = 0; l < LANES; l++) {
+                            uint8_t& cell = this->memory[(this->i_register[l] + reg) & ADDRESS_MASK][l];
+                            cell = blend(mask[l], this->gp_registers[reg][l], cell);
+                        }
+                    }
+                    break;
+                case 0x65:
+                    for (size_t reg = 0; reg <= x; reg++) {
+                        for (size_t l = 0; l < LANES; l++) {
+                            uint8_t cell = this->memory[(this->i_register[l] + reg) & ADDRESS_MASK][l];
+                            this->gp_registers[reg][l] = blend(mask[l], cell, this->gp_registers[reg][l]);
+                        }
+                    }
+                    break;
+                default:
+                    return this->fault(mask);
+                }
+                // faulted lanes keep their program counter at the faulting instruction
+                for (size_t l = 0; l < LANES; l++)
+                    this->program_counter[l] += (mask[l] & INSTRUCTION_SIZE) * (this->lane_state[l] == state_byte(LaneState::Running));
+                break;
+            }
+        }
+
+        /// @brief executes one instruction for the group of runnable lanes at the lowest program counter
+        /// @returns false if no lane can run
+        bool step() {
+            // runnable lanes bid their program counter, the rest bid past the end of the address space
+            constexpr uint32_t NO_BID = 0x10000;
+            Lanes<uint32_t> bid;
+            for (size_t l = 0; l < LANES; l++) {
+                bool is_runnable = (this->lane_state[l] == state_byte(LaneState::Running)) & (this->budget[l] > 0);
+                bid[l] = blend((uint8_t)(0 - (uint8_t)is_runnable), this->program_counter[l], NO_BID);
+            }
+            uint32_t leader_pc = NO_BID;
+            for (size_t l = 0; l < LANES; l++)
+                leader_pc = std::min(leader_pc, bid[l]);
+            if (leader_pc == NO_BID)
+                return false;
+
+            size_t leader = std::ranges::find(bid, leader_pc) - bid.begin();
+            // lanes may have rewritten their own code, so the instruction word must match too
+            uint16_t instruction = this->fetch(leader, (uint16_t)leader_pc);
+            const auto& high_bytes = this->memory[leader_pc & ADDRESS_MASK];
+            const auto& low_bytes = this->memory[(leader_pc + 1) & ADDRESS_MASK];
+            Mask mask;
+            size_t group_size = 0;
+            for (size_t l = 0; l < LANES; l++) {
+                uint16_t word = (uint16_t)((high_bytes[l] << 8) | low_bytes[l]);
+                mask[l] = (uint8_t)(0 - (uint8_t)(bid[l] == leader_pc && word == instruction));
+                group_size += mask[l] & 1;
+            }
+
+            this->execute(instruction, mask);
+
+            for (size_t l = 0; l < LANES; l++)
+                this->budget[l] -= mask[l] & 1;
+            this->groups_executed += 1;
+            this->lane_instructions_executed += group_size;
+            return true;
+        }
+
+    public:
+        constexpr static size_t DEFAULT_INSTRUCTIONS_PER_FRAME = 12;
+
+        /// @brief about (4 KiB + 256 B) per lane, so prefer the heap for wide engines
+        LockstepEngine() {
+            for (auto& cells : this->memory)
+                cells.fill(0);
+            for (auto& rows : this->display)
+                rows.fill(0);
+            for (auto& registers : this->gp_registers)
+                registers.fill(0);
+            for (auto& frames : this->stack_frames)
+                frames.fill(0);
+            this->i_register.fill(0);
+            this->program_counter.fill(PROGRAM_STARTING_ADDRESS);
+            this->stack_pointer.fill(0);
+            this->delay_timer.fill(0);
+            this->sound_timer.fill(0);
+            this->lane_state.fill(state_byte(LaneState::Running));
+            this->budget.fill(0);
+            this->keys_down.fill(0);
+            this->waiting_register.fill(0);
+
+            for (size_t l = 0; l < LANES; l++)
+                this->seed(l, (uint32_t)(l + 1) * 0x9e3779b9);
+            for (size_t i = 0; i < BUILT_IN_FONT.size(); i++)
+                this->memory[BUILT_IN_CHAR_STARTING_ADDRESS + i].fill(BUILT_IN_FONT[i]);
+        }
+
+        /// @brief loads the same program into every lane
+        bool load_program_bytes(const std::vector<uint8_t>& bytes) {
+            if (bytes.size() > this->memory.size() - PROGRAM_STARTING_ADDRESS)
+                return false;
+
+            for (size_t i = 0; i < bytes.size(); i++)
+                this->memory[PROGRAM_STARTING_ADDRESS + i].fill(bytes[i]);
+
+            // lanes only start apart once they've run
+            bool is_power_on = std::ranges::all_of(this->program_counter, [](uint16_t pc){ return pc == PROGRAM_STARTING_ADDRESS; })
+                && std::ranges::all_of(this->stack_pointer, [](uint8_t sp){ return sp == 0; });
+            this->is_stack_proven = is_power_on && analyze_program(this->memory_of(0), bytes.size()).is_stack_safe();
+            return true;
+        }
+
+        void seed(size_t lane, uint32_t seed) {
+            // xorshift has a fixed point at zero
+            this->prng_state.at(lane) = (seed == 0) ? 1 : seed;
+        }
+
+        /// @brief sets every key of a lane at once, one bit per key
+        void set_keys(size_t lane, uint16_t keys_down) {
+            this->keys_down.at(lane) = keys_down;
+        }
+
+        void press_key(size_t lane, Key key) {
+            this->keys_down.at(lane) |= 1 << key;
+            if (this->lane_state[lane] == state_byte(LaneState::WaitingForKey)) {
+                this->gp_registers[this->waiting_register[lane]][lane] = key;
+                this->program_counter[lane] += INSTRUCTION_SIZE;
+                this->lane_state[lane] = state_byte(LaneState::Running);
+            }
+        }
+
+        void release_key(size_t lane, Key key) {
+            this->keys_down.at(lane) &= ~(1 << key);
+        }
+
+        /// @brief gives every running lane `instructions` instructions, executes until they are spent (or every lane
+        /// stops), then ticks the timers of all lanes
+        void run_frame(size_t instructions = DEFAULT_INSTRUCTIONS_PER_FRAME) {
+            for (size_t l = 0; l < LANES; l++)
+                this->budget[l] = (uint16_t)instructions;
+
+            while (this->step()) {}
+
+            for (size_t l = 0; l < LANES; l++) {
+                this->delay_timer[l] -= this->delay_timer[l] != 0;
+                this->sound_timer[l] -= this->sound_timer[l] != 0;
+            }
+        }
+
+        LaneState state(size_t lane) const {
+            return static_cast<LaneState>(this->lane_state.at(lane));
+        }
+
+        uint8_t gp_register(size_t lane, u4 reg) const {
+            return this->gp_registers[reg].at(lane);
+        }
+
+        uint16_t program_counter_of(size_t lane) const {
+            return this->program_counter.at(lane);
+        }
+
+        /// @brief a copy of one lane's memory, gathered out of the shared arrays
+        Memory memory_of(size_t lane) const {
+            Memory lane_memory;
+            for (size_t address = 0; address < lane_memory.size(); address++)
+                lane_memory[address] = this->memory[address].at(lane);
+            return lane_memory;
+        }
+
+        /// @brief a copy of the lane's display, with pixel x at bit (63 - x)
+        Rows display_rows(size_t lane) const {
+            Rows rows;
+            for (size_t y = 0; y < SCREEN_HEIGHT; y++)
+                rows[y] = this->display[y].at(lane);
+            return rows;
+        }
+
+        /// @brief average number of lanes sharing each executed instruction. LANES means the lanes never diverged.
+        double average_group_size() const {
+            if (this->groups_executed == 0)
+                return 0.0;
+            return (double)this->lane_instructions_executed / (double)this->groups_executed;
+        }
+    };
+}
+
+#endif
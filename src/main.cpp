@@ -1,18 +1,273 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h> // redefines main for portability reasons
 
+#include "capture.h"
 #include "emulator.h"
+#include "gdb_server.h"
+#include "headless_session.h"
+#include "shared_framebuffer.h"
+#include "terminal_display.h"
+#include "terminal_keypad.h"
+#include "wav_capture.h"
+
+const char* USAGE = (
+    "usage: chip8 <path to a .chip8 file> [options]\n"
+    "options:\n"
+    "  --headless                   run without a window or sound, eg. over ssh. Records the run, so --gdb can step back\n"
+    "  --capture-video <path>       record the display as .y4m, .rgb or raw grayscale. '-' writes y4m to stdout\n"
+    "  --capture-audio <path>       record the sound channel as a .wav\n"
+    "  --terminal                   draw the display in this terminal instead of a window, sending only what changed\n"
+    "                               each frame. Implies --headless. Keys are read from the terminal too, & q quits\n"
+    "  --terminal-braille           like --terminal, but half the size, for terminals with braille in their font\n"
+    "  --speed <multiplier>         run at 0.25x to 8x, or 'uncapped'. 1x (the default) is 720 instructions & 60 timer\n"
+    "                               ticks a second. Press - & = to change it, or hold tab to fast-forward\n"
+    "  --frame-skip                 draw at most once per refresh, dropping frames instead of slowing the program\n"
+    "  --reduce-flicker <or|decay>  blend the last few refreshes, lighting or fading out pixels that were recently on\n"
+    "  --measure-latency            time key events from polling to the screen & print the distribution on exit\n"
+    "  --heatmap <prefix>           count memory accesses & write them to <prefix>.csv & <prefix>.ppm on exit\n"
+#ifndef _WIN32
+    "  --export-framebuffer <name>  publish the display to the shared memory segment /<name>\n"
+    "  --gdb <port>                 serve the gdb remote protocol on 127.0.0.1:<port>\n"
+#endif
+#ifdef __linux__
+    "  --profile-opcodes            sample hardware counters per opcode & print them on exit\n"
+#endif
+);
+
+using Windowed = Chip8::Emulator<false>;
+
+// set by ^C. A lock-free atomic is all a signal handler can safely touch, so a thread passes it on.
+std::atomic<bool> was_interrupted = false;
+
+void on_interrupt(int) {
+    was_interrupted = true;
+}
+
+Windowed& core_of(Windowed& emulator) {
+    return emulator;
+}
+
+Chip8::HeadlessSession::Core& core_of(Chip8::HeadlessSession& session) {
+    return session.core();
+}
+
+/// @brief applies the options to `runner` (the windowed emulator, or a HeadlessSession for --headless), runs the
+/// program until it halts or the window is closed, then reports on the run
+template<typename Runner>
+void run(Runner& runner, int argc, char *argv[]) {
+    constexpr bool IS_HEADLESS = std::is_same_v<Runner, Chip8::HeadlessSession>;
+    auto& core = core_of(runner);
+    // pace instructions like headless frames do (720 a second, see USAGE), so that --speed & the hotkeys scale them
+    // along with the timers
+    if constexpr (!IS_HEADLESS)
+        runner.set_speed(Windowed::DEFAULT_INSTRUCTIONS_PER_FRAME * 60);
+
+    // data tables are never executed, so only warn about what can actually go wrong. chip8-disasm lists the rest
+    for (const std::string& hazard : runner.analysis().hazards())
+        std::cerr << "WARNING: " << hazard << std::endl;
+
+    std::unique_ptr<Chip8::VideoCapture> video_capture;
+    std::unique_ptr<Chip8::WavCapture> audio_capture;
+    // the terminal itself rather than stdout, which may be carrying video
+    std::unique_ptr<std::FILE, decltype(&std::fclose)> tty(nullptr, &std::fclose);
+    std::unique_ptr<Chip8::TerminalDisplay> terminal_display;
+    std::unique_ptr<Chip8::MemoryHeatmap> heatmap;
+    std::string heatmap_prefix;
+    std::unique_ptr<Chip8::OpcodeProfiler> profiler;
+    std::unique_ptr<Chip8::LatencyProbe> latency_probe;
+    bool is_skipping_frames = false;
+#ifndef _WIN32
+    std::unique_ptr<Chip8::SharedFramebuffer> shared_framebuffer;
+    std::unique_ptr<Chip8::GdbServer<Runner>> gdb_server;
+#endif
+
+    for (int arg_i = 2; arg_i < argc; arg_i++) {
+        std::string option(argv[arg_i]);
+        bool has_value = arg_i + 1 < argc;
+
+        if (option == "--headless") {
+            continue;
+        } else if (option == "--capture-video" && has_value) {
+            std::string path(argv[++arg_i]);
+            // the interactive core presents on every draw, so sample it at the video's frame rate. Headless cores
+            // present once per frame already.
+            video_capture = std::make_unique<Chip8::VideoCapture>(
+                path, Chip8::VideoCapture::format_for_path(path),
+                IS_HEADLESS ? Chip8::VideoCapture::Timing::EveryPresent : Chip8::VideoCapture::Timing::WallClock
+            );
+            core.add_frame_sink(*video_capture);
+            continue;
+        } else if (option == "--capture-audio" && has_value) {
+            audio_capture = std::make_unique<Chip8::WavCapture>(argv[++arg_i]);
+            core.add_sound_sink(*audio_capture);
+            continue;
+        } else if (option == "--terminal" || option == "--terminal-braille") {
+#ifndef _WIN32
+            tty.reset(std::fopen("/dev/tty", "w"));
+#endif
+            terminal_display = std::make_unique<Chip8::TerminalDisplay>(
+                (option == "--terminal") ? Chip8::TerminalDisplay::Glyphs::HalfBlock : Chip8::TerminalDisplay::Glyphs::Braille,
+                tty ? tty.get() : stdout
+            );
+            core.add_frame_sink(*terminal_display);
+            continue;
+        } else if (option == "--speed" && has_value) {
+            std::string speed(argv[++arg_i]);
+            runner.set_speed_multiplier((speed == "uncapped") ? std::numeric_limits<double>::infinity() : std::stod(speed));
+            continue;
+        } else if (option == "--heatmap" && has_value) {
+            heatmap_prefix = argv[++arg_i];
+            heatmap = std::make_unique<Chip8::MemoryHeatmap>();
+            core.attach_heatmap(heatmap.get());
+            continue;
+        }
+
+        if constexpr (!IS_HEADLESS) {
+            if (option == "--frame-skip") {
+                runner.skip_frames();
+                is_skipping_frames = true;
+                continue;
+            } else if (option == "--reduce-flicker" && has_value) {
+                std::string mode(argv[++arg_i]);
+                if (mode != "or" && mode != "decay") {
+                    std::cerr << "ERROR: --reduce-flicker expects or or decay\n" << USAGE << std::endl;
+                    exit(1);
+                }
+                runner.reduce_flicker((mode == "or") ? Chip8::FlickerFilter::Mode::Or : Chip8::FlickerFilter::Mode::Decay, 3);
+                continue;
+            } else if (option == "--measure-latency") {
+                latency_probe = std::make_unique<Chip8::LatencyProbe>();
+                runner.attach_latency_probe(latency_probe.get());
+                continue;
+            }
+        } else if (option == "--frame-skip" || option == "--reduce-flicker" || option == "--measure-latency") {
+            std::cerr << "ERROR: " << option << " needs a window, so it can't be used with --headless" << std::endl;
+            exit(1);
+        }
+
+#ifdef __linux__
+        if (option == "--profile-opcodes") {
+            profiler = std::make_unique<Chip8::OpcodeProfiler>();
+            core.attach_profiler(profiler.get());
+            continue;
+        }
+#endif
+#ifndef _WIN32
+        if (option == "--export-framebuffer" && has_value) {
+            shared_framebuffer = std::make_unique<Chip8::SharedFramebuffer>("/" + std::string(argv[++arg_i]));
+            core.attach_display(shared_framebuffer->rows(), &shared_framebuffer->sequence());
+            std::cerr << "Publishing display to shared memory segment " << shared_framebuffer->path() << std::endl;
+            continue;
+        }
+        if (option == "--gdb" && has_value) {
+            gdb_server = std::make_unique<Chip8::GdbServer<Runner>>(runner, std::stoi(argv[++arg_i]));
+            std::cerr << "Debug server listening on 127.0.0.1:" << gdb_server->port() << std::endl;
+            continue;
+        }
+#endif
+
+        std::cerr << "ERROR: unknown option " << option << "\n" << USAGE << std::endl;
+        exit(1);
+    }
+
+    // q or ^C in the terminal, when running in one
+    std::stop_source quit_source;
+#ifndef _WIN32
+    std::unique_ptr<Chip8::TerminalKeypad> keypad;
+    if constexpr (IS_HEADLESS) {
+        if (terminal_display) {
+            keypad = std::make_unique<Chip8::TerminalKeypad>(
+                [&runner](Chip8::Key key, bool is_down){
+                    if (is_down)
+                        runner.press_key(key);
+                    else
+                        runner.release_key(key);
+                },
+                quit_source
+            );
+            if (!keypad->is_reading())
+                std::cerr << "WARNING: no terminal to read keys from" << std::endl;
+        }
+    }
+#endif
+    // the window turns ^C into a quit, but without one it would kill us before the captures & heatmap are written
+    std::jthread interrupt_watcher;
+    if constexpr (IS_HEADLESS) {
+        std::signal(SIGINT, on_interrupt);
+        interrupt_watcher = std::jthread([&quit_source](std::stop_token stop_token){
+            while (!stop_token.stop_requested() && !was_interrupted)
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            if (was_interrupted)
+                quit_source.request_stop();
+        });
+    }
+
+    auto stop_reason = runner.block_run(quit_source.get_token());
+#ifndef _WIN32
+    keypad.reset();
+#endif
+    if constexpr (IS_HEADLESS) {
+        interrupt_watcher.request_stop();
+        interrupt_watcher.join();
+        std::signal(SIGINT, SIG_DFL);
+    }
+    if (audio_capture) {
+        audio_capture->close(core.clock_seconds());
+        core.remove_sound_sink(*audio_capture);
+        std::cerr << "Captured " << audio_capture->written() << " audio samples (" << audio_capture->dropped()
+            << " sound timer writes dropped)" << std::endl;
+    }
+    if (profiler)
+        std::cerr << profiler->report();
+    if (latency_probe)
+        std::cerr << latency_probe->report();
+    if constexpr (!IS_HEADLESS) {
+        if (is_skipping_frames) {
+            auto stats = runner.present_stats();
+            std::cerr << "Presented " << stats.presented << " of " << stats.rendered << " frames (" << stats.skipped
+                << " skipped, " << stats.refreshes_dropped << " refreshes over budget, worst "
+                << std::chrono::duration<double, std::milli>(stats.worst_present_time).count() << "ms)" << std::endl;
+        }
+    }
+    if (heatmap) {
+        if (!heatmap->write_csv(heatmap_prefix + ".csv") || !heatmap->write_ppm(heatmap_prefix + ".ppm"))
+            std::cerr << "ERROR: could not write the heatmap to " << heatmap_prefix << ".csv/.ppm" << std::endl;
+    }
+    if constexpr (!IS_HEADLESS) {
+        if (stop_reason == Chip8::StopReason::Halted)
+            runner.block_until_any_key();
+    }
+
+    if (terminal_display) {
+        core.remove_frame_sink(*terminal_display);
+        terminal_display.reset();
+    }
+    if (video_capture) {
+        core.remove_frame_sink(*video_capture);
+        std::cerr << "Captured " << video_capture->written() << " frames (" << video_capture->dropped() << " dropped)" << std::endl;
+    }
+}
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        std::cout << "ERROR: only accepts a single argument: path to a .chip8 file" << std::endl;
+    if (argc < 2) {
+        std::cerr << "ERROR: expected a path to a .chip8 file\n" << USAGE << std::endl;
         exit(1);
     }
-    
+
     try {
         std::filesystem::path file_path(argv[1]);
         size_t size = std::filesystem::file_size(file_path);
@@ -20,20 +275,30 @@ int main(int argc, char *argv[]) {
         std::ifstream chip8_file(file_path);
         chip8_file.read(program_string.data(), size);
 
-        Chip8::Emulator<false> emulator;
-        if (!emulator.load_program(program_string)) {
-            std::cout << "ERROR: invalid program. please fix error before running again" << std::endl;
-            exit(1);
+        // decided up front, since a headless run never opens a window or an audio device
+        bool is_headless = std::any_of(argv + 2, argv + argc, [](std::string_view arg){
+            return arg == "--headless" || arg == "--terminal" || arg == "--terminal-braille";
+        });
+        auto load_and_run = [&](auto& runner){
+            if (!runner.load_program(program_string)) {
+                std::cerr << "ERROR: invalid program. please fix error before running again" << std::endl;
+                exit(1);
+            }
+            run(runner, argc, argv);
+        };
+        if (is_headless) {
+            Chip8::HeadlessSession session;
+            load_and_run(session);
+        } else {
+            Windowed emulator;
+            load_and_run(emulator);
         }
-
-        emulator.block_run();
-        emulator.block_until_any_key();
         return 0;
     } catch (const std::exception& e) {
-        std::cout << "ERROR: " << e.what() << std::endl;
+        std::cerr << "ERROR: " << e.what() << std::endl;
         exit(1);
     } catch (...) {
-        std::cout << "ERROR: got unknown exception" << std::endl;
+        std::cerr << "ERROR: got unknown exception" << std::endl;
         exit(2);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,31 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include "device.h"
+#include "keyboard.h"
+#include "timer.h"
+
+namespace Chip8 {
+    /// @brief each platform bundles the devices an emulator talks to
+    namespace Platforms {
+        /// @brief an SDL3 window, speaker & keyboard, with timers running against the wall clock
+        struct SDL3 {
+            using Device = Chip8::Device;
+            using Keyboard = Chip8::Keyboard;
+            using Timer = Chip8::Timer60hz;
+
+            constexpr static bool IS_HEADLESS = false;
+        };
+
+        /// @brief no window, speaker or input devices. Timers run against virtual time, advanced once per guest frame.
+        struct Headless {
+            using Device = Chip8::HeadlessDevice;
+            using Keyboard = Chip8::Keypad;
+            using Timer = Chip8::FrameTimer60hz;
+
+            constexpr static bool IS_HEADLESS = true;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <format>
+#include <numeric>
+#include <string>
+#include <string_view>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "decode.h"
+
+namespace Chip8 {
+    /// @brief attributes hardware performance counters to the guest opcodes that caused them, by reading the
+    /// counters around a random sample of instructions. See Emulator::attach_profiler().
+    ///
+    /// The counters are opened with perf_event_open on whichever thread samples first, & only count that thread, so
+    /// attach before the core starts executing & keep it on one thread. Linux only: elsewhere (or when perf events
+    /// aren't allowed, see /proc/sys/kernel/perf_event_paranoid) nothing is ever sampled.
+    class OpcodeProfiler {
+    public:
+        enum Counter : size_t {
+            Cycles,
+            Instructions,
+            BranchMisses,
+            L1DReadMisses,
+        };
+
+        constexpr static size_t NUM_COUNTERS = 4;
+        constexpr static std::array<std::string_view, NUM_COUNTERS> COUNTER_NAMES = {
+            "cycles", "instructions", "branch-misses", "L1D-read-misses",
+        };
+
+        using Reading = std::array<uint64_t, NUM_COUNTERS>;
+
+    private:
+        // back to back reads used to measure the cost of reading
+        constexpr static size_t CALIBRATION_READS = 64;
+
+        std::array<int, NUM_COUNTERS> fds = { -1, -1, -1, -1 };
+        bool has_opened = false;
+        bool is_open = false;
+
+        // what reading the counters costs, taken off every sample
+        Reading overhead = {};
+
+        std::array<Reading, NUM_OPCODES> totals = {};
+        std::array<uint64_t, NUM_OPCODES> samples = {};
+
+        // the gap between samples is random, so that loops can't line up with it & always sample the same instruction
+        const uint32_t mean_interval;
+        uint32_t until_next_sample = 1;
+        uint32_t prng_state = 0x9e3779b9;
+
+        uint32_t next_interval() {
+            uint32_t x = this->prng_state;
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            this->prng_state = x;
+            return 1 + x % (2 * this->mean_interval);
+        }
+
+#ifdef __linux__
+        static int open_counter(uint32_t type, uint64_t config, int group_fd) {
+            perf_event_attr attr = {};
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = group_fd == -1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+        }
+
+        void open() {
+            constexpr uint64_t L1D_READ_MISS = PERF_COUNT_HW_CACHE_L1D
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+            this->fds[Cycles] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+            if (this->fds[Cycles] == -1)
+                return;
+            // the rest are optional: a counter the cpu doesn't have just reads as 0
+            this->fds[Instructions] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, this->fds[Cycles]);
+            this->fds[BranchMisses] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, this->fds[Cycles]);
+            this->fds[L1DReadMisses] = open_counter(PERF_TYPE_HW_CACHE, L1D_READ_MISS, this->fds[Cycles]);
+
+            ioctl(this->fds[Cycles], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(this->fds[Cycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            this->is_open = true;
+
+            this->overhead.fill(UINT64_MAX);
+            for (size_t i = 0; i < CALIBRATION_READS; i++) {
+                Reading start = this->read();
+                Reading end = this->read();
+                for (size_t c = 0; c < NUM_COUNTERS; c++)
+                    this->overhead[c] = std::min(this->overhead[c], end[c] - start[c]);
+            }
+        }
+
+        void close() {
+            for (int& fd : this->fds) {
+                if (fd != -1)
+                    ::close(fd);
+                fd = -1;
+            }
+        }
+#else
+        void open() {}
+        void close() {}
+#endif
+
+    public:
+        /// @param mean_interval instructions between samples, on average. Each sample costs a couple of syscalls.
+        OpcodeProfiler(uint32_t mean_interval = 64) : mean_interval(std::max<uint32_t>(mean_interval, 1)) {}
+
+        OpcodeProfiler(const OpcodeProfiler&) = delete;
+        OpcodeProfiler& operator=(const OpcodeProfiler&) = delete;
+
+        ~OpcodeProfiler() {
+            this->close();
+        }
+
+        /// @brief called before every instruction. Opens the counters on the first call.
+        /// @returns true if this instruction should be measured
+        bool should_sample() {
+            if (--this->until_next_sample != 0)
+                return false;
+            this->until_next_sample = this->next_interval();
+
+            if (!this->has_opened) {
+                this->has_opened = true;
+                this->open();
+            }
+            return this->is_open;
+        }
+
+        Reading read() const {
+            Reading reading = {};
+#ifdef __linux__
+            // PERF_FORMAT_GROUP: the number of counters, then each value in the order they were opened
+            std::array<uint64_t, 1 + NUM_COUNTERS> values = {};
+            if (::read(this->fds[Cycles], values.data(), sizeof(values)) <= 0)
+                return reading;
+
+            size_t value_i = 1;
+            for (size_t c = 0; c < NUM_COUNTERS && value_i <= values[0]; c++)
+                if (this->fds[c] != -1)
+                    reading[c] = values[value_i++];
+#endif
+            return reading;
+        }
+
+        /// @brief charges everything counted since `start` to `opcode`
+        void record(Opcode opcode, const Reading& start) {
+            Reading end = this->read();
+            Reading& total = this->totals[static_cast<size_t>(opcode)];
+            for (size_t c = 0; c < NUM_COUNTERS; c++) {
+                uint64_t delta = end[c] - start[c];
+                total[c] += (delta > this->overhead[c]) ? delta - this->overhead[c] : 0;
+            }
+            this->samples[static_cast<size_t>(opcode)] += 1;
+        }
+
+        /// @returns false if no counters could be opened (yet)
+        bool available() const {
+            return this->is_open;
+        }
+
+        bool has_counter(Counter counter) const {
+            return this->fds[counter] != -1;
+        }
+
+        uint64_t sample_count(Opcode opcode) const {
+            return this->samples[static_cast<size_t>(opcode)];
+        }
+
+        /// @brief the average count per executed instruction of `opcode`
+        double per_instruction(Opcode opcode, Counter counter) const {
+            uint64_t samples = this->sample_count(opcode);
+            return (samples == 0) ? 0.0 : (double)this->totals[static_cast<size_t>(opcode)][counter] / (double)samples;
+        }
+
+        void clear() {
+            this->totals = {};
+            this->samples = {};
+        }
+
+        /// @brief a table of host cost per guest opcode, costliest share of cycles first
+        std::string report() const {
+            if (!this->is_open)
+                return "no hardware counters: needs Linux & perf_event_paranoid <= 2\n";
+
+            uint64_t total_cycles = 0;
+            for (size_t op = 0; op < NUM_OPCODES; op++)
+                total_cycles += this->totals[op][Cycles];
+
+            std::array<size_t, NUM_OPCODES> order;
+            std::iota(order.begin(), order.end(), 0);
+            std::ranges::sort(order, std::ranges::greater(), [this](size_t op){ return this->totals[op][Cycles]; });
+
+            std::string table = std::format(
+                "{:<8}{:>10}{:>8}{:>12}{:>12}{:>15}{:>17}\n",
+                "opcode", "samples", "cycles%", "cycles", "instrs", "branch-misses", "L1D-read-misses"
+            );
+            for (size_t op : order) {
+                if (this->samples[op] == 0)
+                    continue;
+                Opcode opcode = static_cast<Opcode>(op);
+                double share = (total_cycles == 0) ? 0.0 : 100.0 * (double)this->totals[op][Cycles] / (double)total_cycles;
+                table += std::format(
+                    "{:<8}{:>10}{:>8.1f}{:>12.1f}{:>12.1f}{:>15.2f}{:>17.2f}\n",
+                    OPCODE_PATTERNS[op], this->samples[op], share,
+                    this->per_instruction(opcode, Cycles), this->per_instruction(opcode, Instructions),
+                    this->per_instruction(opcode, BranchMisses), this->per_instruction(opcode, L1DReadMisses)
+                );
+            }
+            table += "per executed instruction, after taking off the cost of reading the counters\n";
+            return table;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef PROGRAM_FILE_H
+#define PROGRAM_FILE_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Chip8 {
+    /// @brief reads the .chip8 text format: one 16 bit word per line, written 0x1234.
+    /// treats both \r\n and \n as line breaks
+    /// ignores leading whitespace
+    /// ignores all lines that do not start with 0x (after leading whitespace)
+    /// @returns nullopt if a word can't be read
+    inline std::optional<std::vector<uint8_t>> parse_program_text(const std::string& program_text) {
+        std::vector<uint8_t> bytes;
+
+        size_t next_pos = 0;
+        for (size_t current_pos = 0; current_pos < program_text.size(); current_pos = next_pos) {
+            // index of \n and \r\n can never be equal (unless they're both npos)
+            size_t cr = program_text.find("\n", current_pos);
+            size_t crlf = program_text.find("\r\n", current_pos);
+            if (cr == std::string::npos && crlf == std::string::npos){
+                next_pos = program_text.size();
+            } else if (cr < crlf) {
+                next_pos = cr + 1;
+            } else {
+                next_pos = crlf + 2;
+            }
+
+            std::string line = program_text.substr(current_pos, next_pos - current_pos);
+            if (std::ranges::all_of(line, isspace))
+                continue;
+
+            size_t word_start = line.find_first_not_of(" \t\r\n\v\f");
+            if (!line.substr(word_start, line.size() - word_start).starts_with("0x"))
+                continue;
+
+            try {
+                std::string starts_with_bytes = line.substr(word_start+2, line.size() - (word_start+2));
+                uint16_t word = std::stoi(starts_with_bytes, nullptr, 16);
+                bytes.push_back((word & 0xff00) >> 8);
+                bytes.push_back(word & 0x00ff);
+            } catch (std::invalid_argument const&) {
+                return std::nullopt;
+            } catch (std::out_of_range const&) {
+                return std::nullopt;
+            }
+        }
+
+        return bytes;
+    }
+
+    /// @brief reads a program from disk: .chip8 files as text, anything else (eg. .ch8) as a raw image
+    /// @returns nullopt if the file can't be read
+    inline std::optional<std::vector<uint8_t>> read_program_file(const std::filesystem::path& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return std::nullopt;
+        std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        if (path.extension() == ".chip8")
+            return parse_program_text(contents);
+        return std::vector<uint8_t>(contents.begin(), contents.end());
+    }
+}
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "emulator.h"
+#include "geblib.h"
+
+namespace Chip8 {
+    /// @brief owns many headless emulators and runs them in slices of one guest frame on a work-stealing thread pool.
+    /// Sessions blocked on fx0a or spinning on the delay timer are parked instead of being run.
+    ///
+    /// Sessions run in virtual time, so there is no pacing: run_frames() returns as soon as every session has
+    /// advanced. Keys & sessions may only be changed between calls to run_frames().
+    class Scheduler {
+    public:
+        using Core = Emulator<false, Platforms::Headless>;
+        using SessionId = size_t;
+
+        enum class SessionState {
+            Runnable,
+            /// parked until press_key() is called
+            WaitingForKey,
+            Halted,
+            /// the core threw while executing. See fault().
+            Faulted,
+        };
+
+    private:
+        struct Session {
+            std::unique_ptr<Core> core = std::make_unique<Core>();
+            SessionState state = SessionState::Runnable;
+
+            size_t frames_remaining = 0;
+            size_t frames_elapsed = 0;
+
+            std::string fault;
+        };
+
+        const size_t instructions_per_frame;
+        size_t run_ahead_frames = 0;
+
+        std::vector<std::unique_ptr<Session>> sessions;
+
+        // declared last so that the workers stop before the sessions are destroyed
+        GebLib::Threading::WorkStealingPool<SessionId> pool;
+
+        void run_slice(SessionId id) {
+            Session& session = *this->sessions[id];
+            Core& core = *session.core;
+
+            try {
+                FrameStatus status = core.run_frame(this->instructions_per_frame);
+                session.frames_remaining -= 1;
+                session.frames_elapsed += 1;
+
+                if (status == FrameStatus::Idle) {
+                    // the frame ended early. If the loop only waits for the delay timer to expire, skip straight to
+                    // that frame, otherwise keep going a frame at a time so it sees every value the timer passes
+                    size_t skipped = std::min(core.idle_frames(), session.frames_remaining);
+                    core.advance_timers(skipped);
+                    session.frames_remaining -= skipped;
+                    session.frames_elapsed += skipped;
+                } else if (status == FrameStatus::WaitingForKey) {
+                    // time keeps passing while we wait, but nothing executes
+                    core.advance_timers(session.frames_remaining);
+                    session.frames_elapsed += session.frames_remaining;
+                    session.frames_remaining = 0;
+                    session.state = SessionState::WaitingForKey;
+                } else if (status == FrameStatus::Halted) {
+                    session.frames_remaining = 0;
+                    session.state = SessionState::Halted;
+                }
+            } catch (const std::exception& e) {
+                session.fault = e.what();
+                session.state = SessionState::Faulted;
+                return;
+            }
+
+            if (session.state == SessionState::Runnable && session.frames_remaining > 0)
+                this->pool.submit(id);
+        }
+
+    public:
+        Scheduler(
+            size_t num_workers = std::thread::hardware_concurrency(),
+            size_t instructions_per_frame = Core::DEFAULT_INSTRUCTIONS_PER_FRAME
+        ) :
+            instructions_per_frame(instructions_per_frame),
+            pool(num_workers, [this](SessionId id){ this->run_slice(id); })
+        {}
+
+        /// @brief throws if the program doesn't fit in memory
+        SessionId add_session(const std::vector<uint8_t>& program_bytes) {
+            auto session = std::make_unique<Session>();
+            if (!session->core->load_program_bytes(program_bytes))
+                throw std::runtime_error("program is too large to fit in memory");
+            session->core->set_run_ahead(this->run_ahead_frames);
+
+            this->sessions.push_back(std::move(session));
+            return this->sessions.size() - 1;
+        }
+
+        /// @brief restarts the session's core in place with a new program, with all keys up. The core's rng & attached
+        /// display are kept. Throws if the program doesn't fit in memory.
+        void reset_session(SessionId id, const std::vector<uint8_t>& program_bytes) {
+            Session& session = *this->sessions.at(id);
+            if (!session.core->reload(program_bytes))
+                throw std::runtime_error("program is too large to fit in memory");
+
+            session.state = SessionState::Runnable;
+            session.frames_remaining = 0;
+            session.frames_elapsed = 0;
+            session.fault.clear();
+        }
+
+        /// @brief has every session, including ones added later, show sinks the frame `frames` ahead of where it is.
+        /// See Emulator::set_run_ahead().
+        void set_run_ahead(size_t frames) {
+            this->run_ahead_frames = frames;
+            for (auto& session : this->sessions)
+                session->core->set_run_ahead(frames);
+        }
+
+        size_t num_sessions() const {
+            return this->sessions.size();
+        }
+
+        Core& core(SessionId id) {
+            return *this->sessions.at(id)->core;
+        }
+
+        SessionState state(SessionId id) const {
+            return this->sessions.at(id)->state;
+        }
+
+        size_t frames_elapsed(SessionId id) const {
+            return this->sessions.at(id)->frames_elapsed;
+        }
+
+        const std::string& fault(SessionId id) const {
+            return this->sessions.at(id)->fault;
+        }
+
+        void press_key(SessionId id, Key key) {
+            Session& session = *this->sessions.at(id);
+            session.core->press_key(key);
+            if (session.state == SessionState::WaitingForKey)
+                session.state = SessionState::Runnable;
+        }
+
+        void release_key(SessionId id, Key key) {
+            this->sessions.at(id)->core->release_key(key);
+        }
+
+        /// @brief advances every runnable session by `frames` guest frames & blocks until they're done
+        void run_frames(size_t frames) {
+            if (frames == 0)
+                return;
+
+            for (SessionId id = 0; id < this->sessions.size(); id++) {
+                Session& session = *this->sessions[id];
+                if (session.state != SessionState::Runnable)
+                    continue;
+
+                session.frames_remaining = frames;
+                this->pool.submit(id);
+            }
+
+            this->pool.wait_idle();
+        }
+    };
+}
+
+#endif
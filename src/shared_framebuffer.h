@@ -0,0 +1,156 @@
+#ifndef SHARED_FRAMEBUFFER_H
+#define SHARED_FRAMEBUFFER_H
+
+// POSIX shared memory. There's no Windows equivalent here yet.
+#ifndef _WIN32
+
+#include <atomic>
+#include <format>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "framebuffer.h"
+
+namespace Chip8 {
+    /// @brief the contents of a shared framebuffer segment. The emulator draws straight into `rows`, so publishing a
+    /// frame costs nothing beyond bumping `sequence`.
+    struct SharedFramebufferLayout {
+        constexpr static uint32_t MAGIC = 0x38504843; // "CHP8"
+
+        uint32_t magic;
+        uint16_t width;
+        uint16_t height;
+
+        /// seqlock: odd while the emulator is writing, & increases by 2 for every finished update. A reader that sees
+        /// the same even value before & after copying the rows got a consistent frame.
+        std::atomic<uint64_t> sequence;
+
+        /// pixel x of a row is at bit (63 - x)
+        uint64_t rows[SCREEN_HEIGHT];
+    };
+
+    // readers live in other processes, so the counter can't hide behind a lock
+    static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+    /// @brief creates a named POSIX shared memory segment (/dev/shm/<name> on linux) holding the display
+    class SharedFramebuffer {
+    private:
+        std::string name;
+        int fd = -1;
+        SharedFramebufferLayout* layout = nullptr;
+
+    public:
+        /// @param name must start with a '/', eg. "/chip8-0"
+        SharedFramebuffer(std::string name) : name(std::move(name)) {
+            this->fd = shm_open(this->name.c_str(), O_CREAT | O_RDWR, 0644);
+            if (this->fd == -1)
+                throw std::runtime_error(std::format("shm_open({}) failed with errno={}", this->name, errno));
+
+            if (ftruncate(this->fd, sizeof(SharedFramebufferLayout)) == -1) {
+                close(this->fd);
+                shm_unlink(this->name.c_str());
+                throw std::runtime_error(std::format("ftruncate failed with errno={}", errno));
+            }
+
+            void* mapping = mmap(nullptr, sizeof(SharedFramebufferLayout), PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+            if (mapping == MAP_FAILED) {
+                close(this->fd);
+                shm_unlink(this->name.c_str());
+                throw std::runtime_error(std::format("mmap failed with errno={}", errno));
+            }
+
+            this->layout = new (mapping) SharedFramebufferLayout{};
+            this->layout->width = SCREEN_WIDTH;
+            this->layout->height = SCREEN_HEIGHT;
+            // written last, so readers that check it see an initialized header
+            std::atomic_thread_fence(std::memory_order_release);
+            this->layout->magic = SharedFramebufferLayout::MAGIC;
+        }
+
+        SharedFramebuffer(const SharedFramebuffer&) = delete;
+        SharedFramebuffer& operator=(const SharedFramebuffer&) = delete;
+
+        ~SharedFramebuffer() {
+            munmap(this->layout, sizeof(SharedFramebufferLayout));
+            close(this->fd);
+            shm_unlink(this->name.c_str());
+        }
+
+        std::span<uint64_t, SCREEN_HEIGHT> rows() {
+            return this->layout->rows;
+        }
+
+        std::atomic<uint64_t>& sequence() {
+            return this->layout->sequence;
+        }
+
+        const std::string& path() const {
+            return this->name;
+        }
+    };
+
+    /// @brief maps a segment created by SharedFramebuffer read-only, for viewers, recorders & test oracles
+    class SharedFramebufferReader {
+    private:
+        int fd = -1;
+        const SharedFramebufferLayout* layout = nullptr;
+
+    public:
+        SharedFramebufferReader(const std::string& name) {
+            this->fd = shm_open(name.c_str(), O_RDONLY, 0);
+            if (this->fd == -1)
+                throw std::runtime_error(std::format("shm_open({}) failed with errno={}", name, errno));
+
+            void* mapping = mmap(nullptr, sizeof(SharedFramebufferLayout), PROT_READ, MAP_SHARED, this->fd, 0);
+            if (mapping == MAP_FAILED) {
+                close(this->fd);
+                throw std::runtime_error(std::format("mmap failed with errno={}", errno));
+            }
+
+            this->layout = static_cast<const SharedFramebufferLayout*>(mapping);
+            if (this->layout->magic != SharedFramebufferLayout::MAGIC) {
+                munmap(mapping, sizeof(SharedFramebufferLayout));
+                close(this->fd);
+                throw std::runtime_error(std::format("{} is not a chip8 framebuffer", name));
+            }
+        }
+
+        SharedFramebufferReader(const SharedFramebufferReader&) = delete;
+        SharedFramebufferReader& operator=(const SharedFramebufferReader&) = delete;
+
+        ~SharedFramebufferReader() {
+            munmap((void*)this->layout, sizeof(SharedFramebufferLayout));
+            close(this->fd);
+        }
+
+        /// @brief cheap to poll; changes whenever the display does
+        uint64_t sequence() const {
+            return this->layout->sequence.load(std::memory_order_acquire);
+        }
+
+        /// @brief copies a consistent frame into `out`, retrying while the emulator is mid-update
+        /// @returns the sequence number of the copied frame
+        uint64_t read(std::array<uint64_t, SCREEN_HEIGHT>& out) const {
+            while (true) {
+                uint64_t before = this->layout->sequence.load(std::memory_order_acquire);
+                if (before % 2 == 1)
+                    continue;
+
+                std::copy(std::begin(this->layout->rows), std::end(this->layout->rows), out.begin());
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (this->layout->sequence.load(std::memory_order_relaxed) == before)
+                    return before;
+            }
+        }
+    };
+}
+
+#endif
+
+#endif
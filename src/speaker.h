@@ -0,0 +1,39 @@
+#ifndef SPEAKER_H
+#define SPEAKER_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Chip8 {
+    /// @brief the beep played while the sound timer is non-zero. Shared by the SDL speaker & audio capture so that
+    /// recordings sound exactly like playback.
+    namespace Tone {
+        // TODO: increase sample rate so our sfx sounds more like a square wave!
+        constexpr static int SAMPLE_RATE = 400 * 64;
+        constexpr static uint8_t SILENCE = 0xff / 2;
+
+        /// @brief how many samples a sound timer value lasts for
+        constexpr size_t samples_for(uint8_t sound_timer_value) {
+            // each timer value represents the same time-period as SAMPLE_RATE / 60 samples
+            return (size_t)(sound_timer_value * (SAMPLE_RATE / 60.0));
+        }
+
+        /// @brief the i-th sample of the tone, counting from when it started
+        constexpr uint8_t sample(size_t i) {
+            // a 200hz square wave. The actual shape played depends on SDL3's built-in resampler.
+            return (i % (64*2) < (32*2)) ? 0x00 : 0xff;
+        }
+    }
+
+    /// @brief observes every write to the sound timer, which is all it takes to reproduce the tone. Called on the
+    /// execution thread, so implementations must not block.
+    class SoundSink {
+    public:
+        virtual ~SoundSink() = default;
+
+        /// @param seconds when the write happened, in the emulator's clock (see Emulator::clock_seconds())
+        virtual void on_sound_timer_set(double seconds, uint8_t value) = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,291 @@
+#ifndef TERMINAL_DISPLAY_H
+#define TERMINAL_DISPLAY_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <format>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+#include "framebuffer.h"
+
+namespace Chip8 {
+    /// @brief draws presented frames to an ANSI terminal with Unicode block or braille characters, eg. to watch a
+    /// program over ssh. Only the cells that changed since the last written frame are sent, as cursor moves & glyphs.
+    ///
+    /// Frames are handed to a background thread, which writes at most one frame per refresh interval (in a single
+    /// write) & skips any frames presented in between, so a program that draws thousands of sprites per second
+    /// costs no more than one that draws once per frame.
+    class TerminalDisplay : public FrameSink {
+    public:
+        enum class Glyphs {
+            /// ▀ ▄ █, a cell per 1x2 pixels, so 64x16 cells
+            HalfBlock,
+            /// ⣿, a cell per 2x4 pixels, so 32x8 cells. Smaller, but needs a font with braille
+            Braille,
+        };
+
+    private:
+        using Frame = std::array<uint64_t, SCREEN_HEIGHT>;
+
+        // stray output (or a resized terminal) would stay on screen forever if only changes were ever sent
+        constexpr static auto REPAINT_INTERVAL = std::chrono::seconds(5);
+        // a same-row gap of this many cells or fewer is cheaper to rewrite than to skip with a cursor move
+        constexpr static size_t MAX_REWRITTEN_GAP = 2;
+
+        const Glyphs glyphs;
+        const size_t cell_width;
+        const size_t cell_height;
+        const std::chrono::nanoseconds refresh_interval;
+
+        std::FILE* output;
+
+        std::mutex lock;
+        std::condition_variable frame_ready;
+        Frame pending;
+        bool has_pending = false;
+        bool is_closed = false;
+
+        // only touched by the writer thread
+        Frame shown = {};
+        std::string out;
+        // the cell the terminal's cursor is on, or SIZE_MAX if unknown
+        size_t cursor_row = SIZE_MAX;
+        size_t cursor_column = SIZE_MAX;
+
+        std::atomic<size_t> frames_written = 0;
+        std::atomic<size_t> frames_skipped = 0;
+        std::atomic<size_t> bytes_written = 0;
+
+        // declared last so that it is joined before anything it touches is destroyed
+        std::jthread writer_thread;
+
+        size_t cell_columns() const {
+            return SCREEN_WIDTH / this->cell_width;
+        }
+
+        size_t cell_rows() const {
+            return SCREEN_HEIGHT / this->cell_height;
+        }
+
+        /// @brief the pixels of one cell as a bitmask, row by row from the top & left to right within a row
+        uint32_t cell_pixels(const Frame& frame, size_t row, size_t column) const {
+            uint32_t pixels = 0;
+            size_t shift = SCREEN_WIDTH - this->cell_width * (column + 1);
+            uint64_t mask = (this->cell_width == 2) ? 0b11 : 0b1;
+            for (size_t y = 0; y < this->cell_height; y++)
+                pixels = (pixels << this->cell_width) | (uint32_t)((frame[row * this->cell_height + y] >> shift) & mask);
+            return pixels;
+        }
+
+        void append_glyph(uint32_t pixels) {
+            if (pixels == 0) {
+                this->out += ' ';
+                return;
+            }
+
+            if (this->glyphs == Glyphs::HalfBlock) {
+                constexpr std::array<std::string_view, 4> HALF_BLOCKS = { " ", "▄", "▀", "█" };
+                this->out += HALF_BLOCKS[pixels];
+                return;
+            }
+
+            // braille numbers its dots down the left column, down the right, then across the bottom row
+            constexpr std::array<uint8_t, 8> DOTS = {
+                0x01, 0x08, // top row, left & right
+                0x02, 0x10,
+                0x04, 0x20,
+                0x40, 0x80,
+            };
+            uint8_t dots = 0;
+            for (size_t i = 0; i < 8; i++)
+                if ((pixels >> (7 - i)) & 1)
+                    dots |= DOTS[i];
+
+            // U+2800 + dots, as utf-8
+            this->out += (char)0xe2;
+            this->out += (char)(0xa0 | (dots >> 6));
+            this->out += (char)(0x80 | (dots & 0x3f));
+        }
+
+        void move_cursor(size_t row, size_t column) {
+            if (row == this->cursor_row && column > this->cursor_column && column - this->cursor_column <= MAX_REWRITTEN_GAP) {
+                // the glyphs in between are unchanged, so writing them again is harmless & shorter than a move
+                for (size_t c = this->cursor_column; c < column; c++)
+                    this->append_glyph(this->cell_pixels(this->shown, row, c));
+            } else if (row == this->cursor_row && column > this->cursor_column) {
+                this->out += std::format("\x1b[{}C", column - this->cursor_column);
+            } else if (row != this->cursor_row || column != this->cursor_column) {
+                this->out += std::format("\x1b[{};{}H", row + 1, column + 1);
+            }
+        }
+
+        /// @brief appends what it takes to turn `shown` into `frame`, then remembers `frame` as shown
+        void append_changes(const Frame& frame, bool repaint) {
+            // one bit per pixel column in every mask, so a pair of columns folds onto its left bit for braille cells
+            constexpr uint64_t LEFT_OF_PAIR = 0xaaaaaaaaaaaaaaaa;
+
+            for (size_t row = 0; row < this->cell_rows(); row++) {
+                uint64_t changed = 0;
+                for (size_t y = row * this->cell_height; y < (row + 1) * this->cell_height; y++)
+                    changed |= frame[y] ^ this->shown[y];
+                if (repaint)
+                    changed = UINT64_MAX;
+                if (this->cell_width == 2)
+                    changed = (changed | (changed << 1)) & LEFT_OF_PAIR;
+
+                while (changed != 0) {
+                    size_t x = std::countl_zero(changed);
+                    changed &= ~(1ull << (SCREEN_WIDTH - 1 - x));
+
+                    size_t column = x / this->cell_width;
+                    this->move_cursor(row, column);
+                    this->append_glyph(this->cell_pixels(frame, row, column));
+
+                    // writing the last column leaves the cursor wherever the terminal's wrapping puts it
+                    this->cursor_row = row;
+                    this->cursor_column = (column + 1 < this->cell_columns()) ? column + 1 : SIZE_MAX;
+                }
+
+                for (size_t y = row * this->cell_height; y < (row + 1) * this->cell_height; y++)
+                    this->shown[y] = frame[y];
+            }
+        }
+
+        /// @brief writes the whole buffer in one go where the platform allows it
+        bool flush() {
+#ifdef _WIN32
+            bool ok = std::fwrite(this->out.data(), 1, this->out.size(), this->output) == this->out.size()
+                && std::fflush(this->output) == 0;
+#else
+            // anything already buffered by stdio has to go first
+            std::fflush(this->output);
+            int fd = fileno(this->output);
+            size_t offset = 0;
+            bool ok = true;
+            while (offset < this->out.size()) {
+                ssize_t count = ::write(fd, this->out.data() + offset, this->out.size() - offset);
+                if (count < 0 && errno == EINTR)
+                    continue;
+                if (count <= 0) {
+                    ok = false;
+                    break;
+                }
+                offset += (size_t)count;
+            }
+#endif
+            this->bytes_written += this->out.size();
+            this->out.clear();
+            return ok;
+        }
+
+        void write_frames() {
+            using Clock = std::chrono::steady_clock;
+            auto next_write = Clock::now();
+            auto next_repaint = Clock::now();
+            bool is_first = true;
+
+            while (true) {
+                Frame frame;
+                {
+                    std::unique_lock lock(this->lock);
+                    this->frame_ready.wait(lock, [this](){ return this->has_pending || this->is_closed; });
+                    if (!this->has_pending)
+                        break;
+                    frame = this->pending;
+                    this->has_pending = false;
+                }
+
+                auto now = Clock::now();
+                bool repaint = now >= next_repaint;
+                if (repaint) {
+                    // hide the cursor, & clear whatever was there before the first frame
+                    this->out += is_first ? "\x1b[?25l\x1b[2J" : "\x1b[?25l";
+                    this->cursor_row = SIZE_MAX;
+                    next_repaint = now + REPAINT_INTERVAL;
+                    is_first = false;
+                }
+
+                this->append_changes(frame, repaint);
+                if (!this->out.empty() && !this->flush())
+                    break;
+                this->frames_written += 1;
+
+                // anything presented while waiting for the next refresh is folded into the next write
+                next_write = std::max(next_write + this->refresh_interval, now);
+                std::this_thread::sleep_until(next_write);
+            }
+
+            // leave the cursor visible & below the display
+            this->out += std::format("\x1b[{};1H\x1b[?25h", this->cell_rows() + 1);
+            this->flush();
+        }
+
+    public:
+        /// @param output a terminal, usually stdout. Anything else printed to it will be painted over eventually.
+        /// @param refresh_rate the most frames per second to write
+        TerminalDisplay(Glyphs glyphs = Glyphs::HalfBlock, std::FILE* output = stdout, double refresh_rate = 60.0) :
+            glyphs(glyphs),
+            cell_width((glyphs == Glyphs::Braille) ? 2 : 1),
+            cell_height((glyphs == Glyphs::Braille) ? 4 : 2),
+            refresh_interval(std::chrono::nanoseconds((int64_t)(1e9 / std::max(refresh_rate, 1.0)))),
+            output(output)
+        {
+            // a full repaint is a few kilobytes at most
+            this->out.reserve(4096);
+            this->writer_thread = std::jthread([this](){ this->write_frames(); });
+        }
+
+        TerminalDisplay(const TerminalDisplay&) = delete;
+        TerminalDisplay& operator=(const TerminalDisplay&) = delete;
+
+        /// @brief writes the last presented frame, then restores the cursor
+        ~TerminalDisplay() {
+            {
+                std::scoped_lock lock(this->lock);
+                this->is_closed = true;
+            }
+            this->frame_ready.notify_one();
+            this->writer_thread.join();
+        }
+
+        void on_present(std::span<const uint64_t, SCREEN_HEIGHT> rows) override {
+            {
+                std::scoped_lock lock(this->lock);
+                if (this->has_pending)
+                    this->frames_skipped += 1;
+                std::ranges::copy(rows, this->pending.begin());
+                this->has_pending = true;
+            }
+            this->frame_ready.notify_one();
+        }
+
+        size_t written() const {
+            return this->frames_written;
+        }
+
+        /// @brief frames that were replaced by a newer one before they could be written
+        size_t skipped() const {
+            return this->frames_skipped;
+        }
+
+        size_t bytes() const {
+            return this->bytes_written;
+        }
+    };
+}
+
+#endif
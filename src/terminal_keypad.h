@@ -0,0 +1,147 @@
+#ifndef TERMINAL_KEYPAD_H
+#define TERMINAL_KEYPAD_H
+
+// termios. There's no console version here yet.
+#ifndef _WIN32
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "keyboard.h"
+
+namespace Chip8 {
+    /// @brief reads the hex keypad from the controlling terminal, for running without a window (eg. over ssh). The
+    /// keys are 0-9 & a-f, like the window's, & q or ^C quits.
+    ///
+    /// Terminals only send bytes when a key goes down or auto-repeats, never when it comes up, so a key counts as held
+    /// until HOLD_TIME passes without another byte for it.
+    class TerminalKeypad {
+    public:
+        // long enough to bridge auto-repeat, short enough that a tap isn't read as a long press
+        constexpr static auto HOLD_TIME = std::chrono::milliseconds(150);
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        std::function<void(Key key, bool is_down)> on_key;
+        std::stop_source quit_source;
+
+        int tty_fd = -1;
+        termios original_mode = {};
+
+        // when each held key is let go, if it's held
+        std::array<std::optional<Clock::time_point>, 16> release_at;
+
+        // declared last so that it is joined before anything it touches is destroyed
+        std::jthread reader_thread;
+
+        static std::optional<Key> key_for_byte(char c) {
+            if (c >= '0' && c <= '9')
+                return static_cast<Key>(c - '0');
+            else if (c >= 'a' && c <= 'f')
+                return static_cast<Key>(0xa + (c - 'a'));
+            else if (c >= 'A' && c <= 'F')
+                return static_cast<Key>(0xa + (c - 'A'));
+            return std::nullopt;
+        }
+
+        void handle(char c) {
+            if (c == 'q' || c == 'Q' || c == '\x03') {
+                this->quit_source.request_stop();
+                return;
+            }
+
+            auto key = key_for_byte(c);
+            if (!key.has_value())
+                return;
+            if (!this->release_at[key.value()].has_value())
+                this->on_key(key.value(), true);
+            this->release_at[key.value()] = Clock::now() + HOLD_TIME;
+        }
+
+        void release_expired(bool release_all) {
+            auto now = Clock::now();
+            for (size_t key_i = 0; key_i < this->release_at.size(); key_i++) {
+                auto& release_at = this->release_at[key_i];
+                if (release_at.has_value() && (release_all || now >= release_at.value())) {
+                    release_at.reset();
+                    this->on_key(static_cast<Key>(key_i), false);
+                }
+            }
+        }
+
+        void read_keys(std::stop_token stop_token) {
+            while (!stop_token.stop_requested()) {
+                pollfd tty = { this->tty_fd, POLLIN, 0 };
+                if (poll(&tty, 1, 10) > 0) {
+                    std::array<char, 64> buffer;
+                    ssize_t size = ::read(this->tty_fd, buffer.data(), buffer.size());
+                    if (size <= 0)
+                        break;
+                    for (ssize_t i = 0; i < size; i++)
+                        this->handle(buffer[i]);
+                }
+                this->release_expired(false);
+            }
+            this->release_expired(true);
+        }
+
+    public:
+        /// @param on_key called from the keypad's own thread as keys go down & come up
+        /// @param quit_source stopped when q or ^C is pressed
+        TerminalKeypad(std::function<void(Key key, bool is_down)> on_key, std::stop_source quit_source) :
+            on_key(std::move(on_key)), quit_source(std::move(quit_source))
+        {
+            this->tty_fd = ::open("/dev/tty", O_RDONLY | O_NOCTTY);
+            if (this->tty_fd == -1 || tcgetattr(this->tty_fd, &this->original_mode) == -1) {
+                if (this->tty_fd != -1)
+                    close(this->tty_fd);
+                this->tty_fd = -1;
+                return;
+            }
+
+            // bytes as they're typed: no line editing or echo, & ^C is read here instead of killing the process
+            // with the terminal left in this mode
+            termios raw = this->original_mode;
+            raw.c_lflag &= ~(ICANON | ECHO | ISIG);
+            raw.c_cc[VMIN] = 0;
+            raw.c_cc[VTIME] = 0;
+            tcsetattr(this->tty_fd, TCSANOW, &raw);
+
+            this->reader_thread = std::jthread([this](std::stop_token stop_token){ this->read_keys(stop_token); });
+        }
+
+        TerminalKeypad(const TerminalKeypad&) = delete;
+        TerminalKeypad& operator=(const TerminalKeypad&) = delete;
+
+        /// @brief lets go of any held keys & puts the terminal back the way it was
+        ~TerminalKeypad() {
+            if (this->tty_fd == -1)
+                return;
+
+            this->reader_thread.request_stop();
+            this->reader_thread.join();
+            tcsetattr(this->tty_fd, TCSANOW, &this->original_mode);
+            close(this->tty_fd);
+        }
+
+        /// @returns false if there's no controlling terminal to read from
+        bool is_reading() const {
+            return this->tty_fd != -1;
+        }
+    };
+}
+
+#endif
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef TIME_TRAVEL_H
+#define TIME_TRAVEL_H
+
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "debugger.h"
+#include "emulator.h"
+
+namespace Chip8 {
+    /// @brief records a headless core's run so that it can be stepped backwards.
+    ///
+    /// Headless cores are deterministic given their inputs, so only the inputs are logged: key presses, key releases
+    /// & timer ticks, each stamped with the number of instructions executed before it. A snapshot of the whole core
+    /// is kept every `snapshot_interval` instructions. Going back restores the nearest snapshot at or before the
+    /// target & replays the log up to it, so the cost is bounded by the interval no matter how long the session is.
+    ///
+    /// Drive the core through this class while recording. Running forward from a point in the past forks the
+    /// timeline: everything recorded after it is dropped.
+    template<typename Core = Emulator<false, Platforms::Headless>>
+    class TimeTravel {
+    public:
+        // at 12 instructions a frame, a snapshot every ~14s of guest time: ~1 MiB of snapshots per hour, & a
+        // reverse step replays at most this many instructions
+        constexpr static uint64_t DEFAULT_SNAPSHOT_INTERVAL = 10'000;
+
+    private:
+        struct Event {
+            enum class Kind : uint8_t {
+                /// `value` frames of timer ticks
+                Frames,
+                Press,
+                Release,
+            };
+
+            uint64_t at;
+            Kind kind;
+            uint32_t value;
+        };
+
+        struct Checkpoint {
+            uint64_t at;
+            // events before this index had already happened when the snapshot was taken
+            size_t next_event;
+            typename Core::Snapshot snapshot;
+        };
+
+        Core& core;
+        const uint64_t snapshot_interval;
+
+        std::vector<Event> events;
+        std::vector<Checkpoint> checkpoints;
+
+        // the first event the core hasn't seen. Behind events.size() only after travelling back.
+        size_t next_event = 0;
+        // how far the recording goes
+        uint64_t recorded_end = 0;
+
+        void apply(const Event& event) {
+            switch (event.kind) {
+                case Event::Kind::Frames:
+                    this->core.advance_timers(event.value);
+                    break;
+                case Event::Kind::Press:
+                    this->core.press_key(static_cast<Key>(event.value));
+                    break;
+                case Event::Kind::Release:
+                    this->core.release_key(static_cast<Key>(event.value));
+                    break;
+            }
+        }
+
+        /// @brief forgets everything recorded after the current position, so that new inputs start a new timeline
+        void fork() {
+            if (this->next_event == this->events.size() && this->position() == this->recorded_end)
+                return;
+
+            this->events.resize(this->next_event);
+            std::erase_if(this->checkpoints, [this](const Checkpoint& checkpoint){
+                return checkpoint.at > this->position() || checkpoint.next_event > this->next_event;
+            });
+            this->recorded_end = this->position();
+        }
+
+        void record(typename Event::Kind kind, uint32_t value) {
+            this->events.push_back(Event{ this->position(), kind, value });
+            this->next_event = this->events.size();
+        }
+
+        void finish_recording() {
+            this->recorded_end = this->position();
+            if (this->position() - this->checkpoints.back().at >= this->snapshot_interval)
+                this->checkpoints.push_back(Checkpoint{ this->position(), this->events.size(), this->core.snapshot() });
+        }
+
+        /// @brief the newest checkpoint at or before `target`
+        const Checkpoint& checkpoint_before(uint64_t target) const {
+            auto after = std::ranges::upper_bound(this->checkpoints, target, {}, &Checkpoint::at);
+            return *std::prev(after);
+        }
+
+        void restore(const Checkpoint& checkpoint) {
+            this->core.restore(checkpoint.snapshot);
+            this->next_event = checkpoint.next_event;
+        }
+
+        /// @brief replays the log from the current position up to `target`, which can't be behind it. Position N means
+        /// N instructions executed & every input stamped N applied.
+        /// @param debugger if set, checked before each instruction short of `target`
+        /// @returns the last position the debugger would have stopped at, & why
+        std::optional<std::pair<uint64_t, DebugHit>> replay_to(uint64_t target, Debugger* debugger = nullptr) {
+            std::optional<std::pair<uint64_t, DebugHit>> last_hit;
+            while (true) {
+                uint64_t at = this->position();
+                while (this->next_event < this->events.size() && this->events[this->next_event].at == at)
+                    this->apply(this->events[this->next_event++]);
+                if (at >= target)
+                    break;
+
+                if (debugger != nullptr && debugger->wants_check(this->core.machine_state().program_counter)) {
+                    auto hit = debugger->check(this->core.machine_state());
+                    if (hit.has_value()) {
+                        last_hit = std::make_pair(at, hit.value());
+                        // find every later hit too, even at the same address
+                        debugger->resync(this->core.machine_state());
+                    }
+                }
+                this->core.step_instruction();
+            }
+            return last_hit;
+        }
+
+    public:
+        /// @brief starts recording from wherever `core` is now
+        TimeTravel(Core& core, uint64_t snapshot_interval = DEFAULT_SNAPSHOT_INTERVAL) :
+            core(core), snapshot_interval(std::max<uint64_t>(snapshot_interval, 1))
+        {
+            this->rebase();
+        }
+
+        /// @brief forgets the whole recording & starts a new one from wherever the core is now. Call after changing the
+        /// core other than through this class (eg. loading a program, or a debugger writing to memory), since replays
+        /// only know about what was logged.
+        void rebase() {
+            this->events.clear();
+            this->checkpoints.clear();
+            this->next_event = 0;
+            this->recorded_end = this->position();
+            this->checkpoints.push_back(Checkpoint{ this->position(), 0, this->core.snapshot() });
+        }
+
+        /// @brief instructions executed by the core so far
+        uint64_t position() const {
+            return this->core.instructions_executed();
+        }
+
+        uint64_t start() const {
+            return this->checkpoints.front().at;
+        }
+
+        uint64_t end() const {
+            return this->recorded_end;
+        }
+
+        #pragma region Recording
+
+        FrameStatus run_frame(size_t instructions = Core::DEFAULT_INSTRUCTIONS_PER_FRAME) {
+            this->fork();
+            FrameStatus status = this->core.run_frame(instructions);
+            // run_frame ticks the timers once after its instructions, unless the debugger stopped it partway through
+            if (status != FrameStatus::Breakpoint)
+                this->record(Event::Kind::Frames, 1);
+            this->finish_recording();
+            return status;
+        }
+
+        /// @brief executes one instruction without ticking the timers, eg. to single-step in a debugger
+        /// @returns true if the program halted
+        bool step_instruction() {
+            this->fork();
+            bool has_halted = this->core.step_instruction();
+            this->finish_recording();
+            return has_halted;
+        }
+
+        void advance_timers(size_t frames) {
+            this->fork();
+            this->core.advance_timers(frames);
+            this->record(Event::Kind::Frames, (uint32_t)frames);
+            this->finish_recording();
+        }
+
+        void press_key(Key key) {
+            this->fork();
+            this->core.press_key(key);
+            this->record(Event::Kind::Press, key);
+        }
+
+        void release_key(Key key) {
+            this->fork();
+            this->core.release_key(key);
+            this->record(Event::Kind::Release, key);
+        }
+
+        #pragma endregion
+
+        /// @brief moves the core to any recorded position, backwards or forwards, without recording anything
+        void seek(uint64_t target) {
+            if (target < this->start() || target > this->end())
+                throw std::out_of_range("can only seek within the recording");
+
+            if (target < this->position())
+                this->restore(this->checkpoint_before(target));
+            this->replay_to(target);
+            this->core.display_buffer().present();
+        }
+
+        /// @returns false, without moving, if that would go back past the start of the recording
+        bool reverse_step(uint64_t instructions = 1) {
+            if (this->position() < this->start() + instructions)
+                return false;
+            this->seek(this->position() - instructions);
+            return true;
+        }
+
+        /// @brief runs backwards to the last point before the current position where `debugger` would have stopped.
+        /// Stays put at the start of the recording if there is none.
+        /// @returns why the debugger would have stopped there
+        std::optional<DebugHit> reverse_continue(Debugger& debugger) {
+            Debugger* attached = this->core.attached_debugger();
+            this->core.attach_debugger(&debugger);
+
+            // search one checkpoint's worth of history at a time, newest first
+            uint64_t segment_end = this->position();
+            std::optional<std::pair<uint64_t, DebugHit>> hit;
+            for (size_t i = this->checkpoints.size(); i-- > 0 && !hit.has_value();) {
+                const Checkpoint& checkpoint = this->checkpoints[i];
+                if (checkpoint.at >= segment_end)
+                    continue;
+
+                this->restore(checkpoint);
+                debugger.resync(this->core.machine_state());
+                hit = this->replay_to(segment_end, &debugger);
+                segment_end = checkpoint.at;
+            }
+
+            this->core.attach_debugger(attached);
+            this->seek(hit.has_value() ? hit->first : this->start());
+
+            // mark the stop, so that running forward again doesn't stop on the same breakpoint straight away
+            debugger.resync(this->core.machine_state());
+            if (hit.has_value())
+                debugger.check(this->core.machine_state());
+            return hit.has_value() ? std::optional<DebugHit>(hit->second) : std::nullopt;
+        }
+    };
+}
+
+#endif
@@ -2,28 +2,51 @@
 #define TIMER_H
 
 #include <chrono>
+#include <cstdint>
+#include <mutex>
 
 namespace Chip8 {
+    /// @brief a 60hz timer against the wall clock, which can be sped up or slowed down with set_rate(). Safe to use from
+    /// several threads, since the speaker's audio thread reads the sound timer while the execution worker sets it.
     class Timer60hz {
     private:
-        uint8_t _value;
+        // the fields below only make sense together
+        mutable std::mutex lock;
+
+        uint8_t _value = 0;
         std::chrono::time_point<std::chrono::steady_clock> timestamp;
 
-    public:
-        uint8_t value() {
-            if (this->_value == 0)
-                return this->_value;
+        // guest seconds per wall clock second. At 0 only advance() moves the timer
+        double rate = 1.0;
+        // guest time passed since the timestamp on top of the wall clock's share, from advance() & rate changes
+        int64_t advanced_us = 0;
 
-            // timer should decrease by 60 per 1000 * 1000 us
-            // we can reasonably round this to 16667 us per value
+        /// @brief guest time since the timer was set
+        int64_t elapsed_us() const {
             auto current = std::chrono::steady_clock::now();
             auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
                 current - this->timestamp
             ).count();
+            if (this->rate != 1.0)
+                duration = (int64_t)((double)duration * this->rate);
+            return duration + this->advanced_us;
+        }
 
+        static size_t ticks_for(int64_t duration) {
             // separate this into 1s amounts (no error) and smaller amounts
             // (there are a few steady_clock tick errors b/c 16667 != 16666.66666...)
-            size_t ticks_elapsed = 60 * (duration / (1000*1000)) + ((duration % (1000*1000)) / 16667);
+            return 60 * (duration / (1000*1000)) + ((duration % (1000*1000)) / 16667);
+        }
+
+    public:
+        uint8_t value() {
+            std::scoped_lock lock(this->lock);
+            if (this->_value == 0)
+                return this->_value;
+
+            // timer should decrease by 60 per 1000 * 1000 us
+            // we can reasonably round this to 16667 us per value
+            size_t ticks_elapsed = ticks_for(this->elapsed_us());
             if (ticks_elapsed >= (size_t)this->_value) {
                 return 0;
             } else {
@@ -31,8 +54,50 @@ namespace Chip8 {
             }
         }
         void set(uint8_t new_value) {
+            std::scoped_lock lock(this->lock);
             this->_value = new_value;
             this->timestamp = std::chrono::steady_clock::now();
+            this->advanced_us = 0;
+        }
+
+        /// @brief from now on, counts `rate` guest seconds per wall clock second. Time already counted is kept.
+        void set_rate(double rate) {
+            std::scoped_lock lock(this->lock);
+            int64_t elapsed = this->elapsed_us();
+            size_t ticks = ticks_for(elapsed);
+            this->_value = (ticks >= (size_t)this->_value) ? 0 : this->_value - (uint8_t)ticks;
+            this->timestamp = std::chrono::steady_clock::now();
+            // keep the part of a tick that had already passed
+            this->advanced_us = (this->_value == 0) ? 0 : (elapsed % (1000*1000)) % 16667;
+            this->rate = rate;
+        }
+
+        /// @brief counts `duration` of guest time on top of the wall clock's share
+        void advance(std::chrono::microseconds duration) {
+            std::scoped_lock lock(this->lock);
+            this->advanced_us += duration.count();
+        }
+    };
+
+    /// @brief a 60hz timer driven by virtual time instead of the wall clock. The owner calls tick() once per guest
+    /// frame, so headless cores can run faster (or slower) than realtime & still observe consistent timer values.
+    class FrameTimer60hz {
+    private:
+        uint8_t _value = 0;
+
+    public:
+        uint8_t value() const {
+            return this->_value;
+        }
+        void set(uint8_t new_value) {
+            this->_value = new_value;
+        }
+        void tick(size_t frames = 1) {
+            if (frames >= (size_t)this->_value) {
+                this->_value = 0;
+            } else {
+                this->_value -= (uint8_t)frames;
+            }
         }
     };
 }
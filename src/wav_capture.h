@@ -0,0 +1,165 @@
+#ifndef WAV_CAPTURE_H
+#define WAV_CAPTURE_H
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "geblib.h"
+#include "speaker.h"
+
+namespace Chip8 {
+    /// @brief records the tone to a .wav file. The emulator only reports sound timer writes; a background thread turns
+    /// them into samples in large batches, timed against the emulator's clock rather than an audio device. For a
+    /// headless core this makes the recording sample-accurate & identical from run to run.
+    class WavCapture : public SoundSink {
+    private:
+        struct Event {
+            double seconds;
+            uint8_t value;
+            // the final event, marking where the recording ends
+            bool is_end = false;
+        };
+
+        constexpr static size_t BATCH_SIZE = 64 * 1024;
+        constexpr static size_t HEADER_SIZE = 44;
+
+        std::FILE* output = nullptr;
+
+        GebLib::Threading::SpscQueue<Event> queue;
+        std::atomic<size_t> events_dropped = 0;
+        std::atomic<size_t> samples_written = 0;
+        bool is_closed = false;
+
+        // declared last so that it is joined before anything it touches is destroyed
+        std::jthread writer_thread;
+
+        static void put_u32(uint8_t* out, uint32_t value) {
+            for (size_t i = 0; i < 4; i++)
+                out[i] = (value >> (8 * i)) & 0xff;
+        }
+
+        static void put_u16(uint8_t* out, uint16_t value) {
+            out[0] = value & 0xff;
+            out[1] = value >> 8;
+        }
+
+        void write_header(size_t num_samples) {
+            // 8-bit unsigned mono pcm, which is exactly what the speaker streams
+            uint8_t header[HEADER_SIZE] = {
+                'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+                'f', 'm', 't', ' ', 16, 0, 0, 0,
+            };
+            // chunks are padded to an even size, but the pad byte isn't part of the data chunk's size
+            put_u32(header + 4, (uint32_t)(36 + num_samples + num_samples % 2));
+            put_u16(header + 20, 1); // pcm
+            put_u16(header + 22, 1); // channels
+            put_u32(header + 24, Tone::SAMPLE_RATE);
+            put_u32(header + 28, Tone::SAMPLE_RATE); // bytes per second
+            put_u16(header + 32, 1); // bytes per sample
+            put_u16(header + 34, 8); // bits per sample
+            std::memcpy(header + 36, "data", 4);
+            put_u32(header + 40, (uint32_t)num_samples);
+
+            std::fseek(this->output, 0, SEEK_SET);
+            std::fwrite(header, 1, HEADER_SIZE, this->output);
+        }
+
+        void write_samples() {
+            std::vector<uint8_t> batch;
+            batch.reserve(BATCH_SIZE);
+
+            size_t next_sample = 0;
+            // the tone plays for samples in [tone_start, tone_end)
+            size_t tone_start = 0;
+            size_t tone_end = 0;
+
+            auto flush = [&](){
+                std::fwrite(batch.data(), 1, batch.size(), this->output);
+                this->samples_written += batch.size();
+                batch.clear();
+            };
+
+            auto render_until = [&](size_t end_sample){
+                for (; next_sample < end_sample; next_sample++) {
+                    bool is_playing = next_sample >= tone_start && next_sample < tone_end;
+                    batch.push_back(is_playing ? Tone::sample(next_sample - tone_start) : Tone::SILENCE);
+                    if (batch.size() == BATCH_SIZE)
+                        flush();
+                }
+            };
+
+            while (auto event = this->queue.wait_pop()) {
+                // the emulator's clock never goes backwards, but rounding might
+                size_t at_sample = std::max((size_t)(event->seconds * Tone::SAMPLE_RATE), next_sample);
+                render_until(at_sample);
+                if (event->is_end)
+                    break;
+
+                tone_start = at_sample;
+                tone_end = at_sample + Tone::samples_for(event->value);
+            }
+
+            flush();
+            if (this->samples_written % 2 != 0)
+                std::fputc(0, this->output);
+            this->write_header(this->samples_written);
+        }
+
+    public:
+        /// @param queue_capacity sound timer writes that may wait for the writer. Writes beyond that are dropped.
+        WavCapture(const std::string& path, size_t queue_capacity = 4096) : queue(queue_capacity) {
+            this->output = std::fopen(path.c_str(), "wb");
+            if (this->output == nullptr)
+                throw std::runtime_error(std::format("could not open {} for audio capture", path));
+
+            // sizes are patched in once we know them
+            this->write_header(0);
+
+            this->writer_thread = std::jthread([this](){ this->write_samples(); });
+        }
+
+        WavCapture(const WavCapture&) = delete;
+        WavCapture& operator=(const WavCapture&) = delete;
+
+        ~WavCapture() {
+            if (!this->is_closed)
+                this->close(0.0);
+            std::fclose(this->output);
+        }
+
+        void on_sound_timer_set(double seconds, uint8_t value) override {
+            if (!this->queue.try_push(Event{ seconds, value }))
+                this->events_dropped += 1;
+        }
+
+        /// @brief ends the recording at `end_seconds` on the emulator's clock, & blocks until it's written. Call it from
+        /// the thread that runs the emulator, once the emulator has stopped.
+        void close(double end_seconds) {
+            if (this->is_closed)
+                return;
+            this->is_closed = true;
+
+            while (!this->queue.try_push(Event{ end_seconds, 0, true }))
+                std::this_thread::yield();
+            this->queue.close();
+            this->writer_thread.join();
+        }
+
+        size_t written() const {
+            return this->samples_written;
+        }
+
+        /// @brief non-zero means the recording is missing some sound timer writes
+        size_t dropped() const {
+            return this->events_dropped;
+        }
+    };
+}
+
+#endif